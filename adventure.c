@@ -40,14 +40,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "assert.h"
 #include "input.h"
 #include "modex.h"
 #include "photo.h"
 #include "text.h"
+#include "trace.h"
 #include "world.h"
 
 
@@ -63,21 +67,70 @@ static int sanity_check(void);
 
 
 /* a few constants */
-#define TICK_USEC      50000 /* tick length in microseconds          */
+#define TICK_USEC      50000 /* simulation step length in microseconds */
 #define STATUS_MSG_LEN 40    /* maximum length of status message     */
 #define MOTION_SPEED   2     /* pixels moved per command             */
 
+/*
+ * Rendering runs at ADVENTURE_FPS frames per second(default DEFAULT_FPS,
+ * at least MIN_FPS).  When frames take too long, only every second,
+ * third, ... frame is rendered, down to at least MIN_RENDER_FPS.  After
+ * a long stall, at most MAX_CATCH_UP simulation steps are run; the rest
+ * are skipped.
+ */
+#define DEFAULT_FPS    60
+#define MIN_FPS        1
+#define MAX_FPS        1000
+#define MIN_RENDER_FPS 5
+#define MAX_CATCH_UP   20
+
+/* histogram bin widths and counts for loop timing(see loop_stats_t) */
+#define LATE_BIN_USEC  10
+#define LATE_BINS      (TICK_USEC / LATE_BIN_USEC + 1)
+#define FRAME_BIN_USEC 100
+#define FRAME_BINS     (4 * TICK_USEC / FRAME_BIN_USEC + 1)
+
 /* outcome of the game */
 typedef enum {GAME_WON, GAME_QUIT} game_condition_t;
 
 /* structure used to hold game information */
 typedef struct {
     room_t*      where;          /* current room for player               */
-    unsigned int map_x, map_y;   /* current upper left display pixel      */
+    unsigned int map_x, map_y;   /* simulated upper left display pixel    */
+    unsigned int step_x, step_y; /* map_x and map_y at start of the step  */
+    unsigned int view_x, view_y; /* upper left pixel in the view window   */
     int          x_speed;        /* number of pixels of x motion per move */
     int          y_speed;        /* number of pixels of y motion per move */
 } game_info_t;
 
+/*
+ * Timing of the event loop.  A frame's lateness is the time from its
+ * scheduled start until the event loop wakes up for it; frame time is the
+ * time between the ends of successive rendered frames.  The last bin of
+ * each histogram counts everything beyond the others.
+ */
+typedef struct loop_stats_t loop_stats_t;
+struct loop_stats_t {
+    uint32_t        steps;              /* simulation steps run            */
+    uint32_t        skipped;            /* steps skipped after stalls      */
+    uint32_t        frames;             /* frame periods passed            */
+    uint32_t        wakes;              /* wake-ups for frames             */
+    uint32_t        rendered;           /* frames rendered                 */
+    uint32_t        input_wakes;        /* wake-ups for input alone        */
+    uint32_t        max_every;          /* largest render_every used       */
+    uint64_t        late_usec;          /* total lateness of wake-ups      */
+    uint32_t        late[LATE_BINS];    /* lateness histogram              */
+    uint32_t        frame[FRAME_BINS];  /* frame time histogram            */
+    struct timespec start;              /* time of frame 0(monotonic)      */
+    struct timespec shown;              /* end of the last rendered frame  */
+    struct rusage   start_usage;        /* CPU time used before frame 0    */
+};
+
+/* sources of event loop wake-ups(see wait_for_frame) */
+#define WAKE_FRAME     0
+#define WAKE_KEYBOARD  1
+#define WAKE_TUX       2
+
 
 /*
  * enumerated values, structure, and static data used for parsing typed
@@ -141,14 +194,25 @@ static void move_photo_down(void);
 static void move_photo_left(void);
 static void move_photo_right(void);
 static void move_photo_up(void);
+static uint32_t percentile(const uint32_t* hist, int32_t bins, uint32_t count, uint32_t pct);
+static void print_stats(void);
 static void redraw_room(void);
+static void scroll_view(int32_t x, int32_t y);
+static int32_t start_clock(void);
 static void* status_thread(void* ignore);
-static int time_is_after(struct timeval* t1, struct timeval* t2);
+static void stop_clock(void* ignore);
+static void update_status_bar(void);
+static int64_t usec_since(const struct timespec* t);
+static int64_t wait_for_frame(int32_t* tux_ready);
 
 
 /* file-scope variables */
 
 static game_info_t game_info; /* game information */
+static int frame_fd = -1;       /* timer expiring once per frame      */
+static int wait_fd = -1;        /* epoll set of frame timer and input */
+static int32_t frame_usec;      /* frame period in microseconds       */
+static loop_stats_t loop_stats; /* event loop timing(see print_stats) */
 static char input[32];
 static int status_flag = 0;
 
@@ -195,31 +259,29 @@ static void cancel_status_thread(void* ignore) {
  *   SIDE EFFECTS: drives the display, etc.
  */
 static game_condition_t game_loop() {
-    /*
-     * Variables used to carry information between event loop ticks; see
-     * initialization below for explanations of purpose.
-     */
-    struct timeval start_time, tick_time;
-
-    struct timeval cur_time; /* current time(during tick)      */
+    int64_t frames = 0;      /* frame periods since the loop started */
+    int64_t steps = 0;       /* simulation steps run                 */
+    int64_t due;             /* steps due by now                     */
+    int64_t n;               /* frame periods passed while waiting   */
+    int64_t last_render = 0; /* frame period last rendered           */
+    int64_t calm = 0;        /* frame periods without overload       */
+    int32_t render_every = 1;/* frame periods per rendered frame     */
+    int32_t render;          /* render a frame on this pass          */
+    int32_t refresh;         /* update the status bar on this pass   */
+    int32_t sub;             /* time into the current step(us)       */
+    int64_t bin;             /* frame time histogram bin             */
+    struct timespec begin;   /* start of rendering                   */
+    int32_t tux_ready;       /* Tux controller input arrived     */
     cmd_t cmd;               /* command issued by input control */
 	cmd_t cmd_tux;			 /* command issued by tux controller */
+    cmd_t motion = CMD_NONE; /* motion awaiting the next step    */
     int32_t enter_room;      /* player has changed rooms        */
 	int time_tux_curr = 0;   /* time currently displayed on tux controller */
 	int time_tux_next = 0;   /* time to be displayed on tux controller */
 
-    /* Record the starting time--assume success. */
-    (void)gettimeofday(&start_time, NULL);
-
-    /* Calculate the time at which the first event loop tick should occur. */
-    tick_time = start_time;
-    if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-        tick_time.tv_sec++;
-        tick_time.tv_usec -= 1000000;
-    }
-
     /* The player has just entered the first room. */
     enter_room = 1;
+    render = refresh = 1;
 
     /* The main event loop. */
     while (1) {
@@ -230,9 +292,14 @@ static game_condition_t game_loop() {
          * once you have it working).
          */
         if (enter_room) {
+            TRACE_BEGIN("enter room");
+
             /* Reset the view window to(0,0). */
             game_info.map_x = game_info.map_y = 0;
-            set_view_window(game_info.map_x, game_info.map_y);
+            game_info.step_x = game_info.step_y = 0;
+            game_info.view_x = game_info.view_y = 0;
+            set_view_window(game_info.view_x, game_info.view_y);
+            motion = CMD_NONE;
 
             /* Discard any partially-typed command. */
             reset_typed_command();
@@ -247,88 +314,117 @@ static game_condition_t game_loop() {
             enter_room = 0;
 			/* Initialize a blue status bar */
 			add_status_bar('C', " ");
+            TRACE_END("enter room");
+        }
+
+        /*
+         * If the room was drawn from a preview of its photo, draw it
+         * again once the photo itself has been read.
+         */
+        else if (room_photo_ready(game_info.where)) {
+            prep_room(game_info.where);
+            redraw_room();
         }
 		
-		
-		/* 
-		 * This area calls the function from modex.c to add components to the status bar
-		 * depending on the action took
-		 */
-		 
-		 /* Start of a critical section */
-		(void)pthread_mutex_lock(&msg_lock);
-		
-		/* Conditional check if the new input exceeds the size and prevent writing on top of other words */
-		if(strcmp(input, get_typed_command())) {
-			add_status_bar('C', " ");
-			strcpy(input, get_typed_command());
-		}
-		
-		/* If no status message, display the room name and allow user to type command */
-		if (status_msg[0] == '\0') {
-			/* If status bar exists, clear it */
-			if (status_flag == 1) {
-				add_status_bar('C', " ");
-				status_flag = 0;
-			}
-			add_status_bar ('R', room_name(game_info.where));
-			add_status_bar('T', get_typed_command());
-		}
-		
-		/* If there is an incoming status message, clear all the components and display the message */
-		else {
-			add_status_bar('S', status_msg);	
-			status_flag = 1;
-		}
-		(void)pthread_mutex_unlock (&msg_lock);
-		/* End of a critical section */
-		
-        show_screen();
+        /* Show any change to the status bar. */
+        if (render || refresh) {
+            update_status_bar();
+        }
 
         /*
-         * Wait for tick.  The tick defines the basic timing of our
-         * event loop, and is the minimum amount of time between events.
+         * Render a frame.  The view is drawn at the fraction of the
+         * current simulation step that has passed between the positions
+         * at the start and the end of the step, so motion is spread over
+         * the frames of each step.
          */
-        do {
-            if (gettimeofday(&cur_time, NULL) != 0) {
-                /* Panic!(should never happen) */
-                clear_mode_X();
-                shutdown_input();
-                perror("gettimeofday");
-                exit(3);
+        if (render) {
+            TRACE_BEGIN("render");
+            (void)clock_gettime(CLOCK_MONOTONIC, &begin);
+            sub = frames * frame_usec - steps * TICK_USEC;
+            sub = (0 > sub ? 0 : sub);
+            scroll_view(game_info.step_x + ((int32_t)game_info.map_x - (int32_t)game_info.step_x) * sub / TICK_USEC,
+                        game_info.step_y + ((int32_t)game_info.map_y - (int32_t)game_info.step_y) * sub / TICK_USEC);
+            show_screen();
+
+            /* Record the time since the previous frame was rendered. */
+            if (0 < loop_stats.rendered) {
+                bin = usec_since(&loop_stats.shown) / FRAME_BIN_USEC;
+                loop_stats.frame[FRAME_BINS - 1 < bin ? FRAME_BINS - 1 : bin]++;
             }
-        } while (!time_is_after(&cur_time, &tick_time));
+            (void)clock_gettime(CLOCK_MONOTONIC, &loop_stats.shown);
+            loop_stats.rendered++;
+            last_render = frames;
+
+            /*
+             * If rendering takes most of the time between rendered
+             * frames, render less often; the simulation keeps its pace.
+             */
+            if (usec_since(&begin) > frame_usec * render_every * 3 / 4 &&
+                MIN_RENDER_FPS * frame_usec * (render_every + 1) <= 1000000) {
+                render_every++;
+                calm = 0;
+            }
+            TRACE_END("render");
+        }
 
         /*
-         * Advance the tick time.  If we missed one or more ticks completely,
-         * i.e., if the current time is already after the time for the next
-         * tick, just skip the extra ticks and advance the clock to the one
-         * that we haven't missed.
+         * Sleep until the next frame or until input arrives, whichever
+         * comes first.  If we missed one or more frames completely, the
+         * timer reports them all together.
          */
-        do {
-            if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-                tick_time.tv_sec++;
-                tick_time.tv_usec -= 1000000;
-            }
-        } while (time_is_after(&cur_time, &tick_time));
+        TRACE_BEGIN("wait_for_frame");
+        n = wait_for_frame(&tux_ready);
+        TRACE_END("wait_for_frame");
+        if (-1 == n) {
+            /* Panic!(should never happen) */
+            clear_mode_X();
+            shutdown_input();
+            perror("wait for frame");
+            exit(3);
+        }
+        frames += n;
+
+        /*
+         * Missing frames right after rendering one also means that we
+         * are overloaded(lateness after idle waits is only timer noise).
+         * After a second without trouble, try rendering more often again.
+         */
+        if (render && render_every < n && MIN_RENDER_FPS * frame_usec * (render_every + 1) <= 1000000) {
+            render_every++;
+            calm = 0;
+        }
+        else if (1000000 <= (calm += n) * frame_usec && 1 < render_every) {
+            render_every--;
+            calm = 0;
+        }
+        loop_stats.max_every = (render_every > loop_stats.max_every ? render_every : loop_stats.max_every);
+        /*
+         * Render when due; refresh the status bar on every frame pass
+         * (typing shows up at the next frame), but not on wake-ups that
+         * only bring input.
+         */
+        render = (0 < n && frames - last_render >= render_every);
+        refresh = (0 < n);
 
         /*
          * Handle asynchronous events.  These events use real time rather
          * than tick counts for timing, although the real time is rounded
-         * off to the nearest tick by definition.
+         * off to the nearest frame by definition.
          */
 		 
         /* This calculates the num_seconds elapsed since the beginning of the game */
-		time_tux_next = tick_time.tv_sec - start_time.tv_sec;
+		time_tux_next = frames * frame_usec / 1000000;
 		if (time_tux_next != time_tux_curr) {
 			display_time_on_tux(time_tux_next);
 			time_tux_curr = time_tux_next;
 		}
 		
         /*
-         * Handle synchronous events--in this case, only player commands.
-         * Note that typed commands that move objects may cause the room
-         * to be redrawn.
+         * Handle player commands.  Note that typed commands that move
+         * objects may cause the room to be redrawn.  Commands other than
+         * motion take effect at once; motion waits for the next
+         * simulation step, so the view moves at most once per step
+         * however fast keys repeat or frames are rendered.
          */
 		 
 		 /*
@@ -337,20 +433,31 @@ static game_condition_t game_loop() {
 		  *
 		  * If there's an input from tux controller, use the command from tux controller.
 		  * If not, use the keyboard. 
+		  *
+		  * The tux controller reports buttons held down, so it is polled only on
+		  * frames and when it sends new input, not when woken by the keyboard.
 		  */
+        TRACE_BEGIN("msg_lock wait");
 		(void)pthread_mutex_lock(&msg_lock);
+        TRACE_END("msg_lock wait");
+        TRACE_BEGIN("msg_lock");
+        TRACE_BEGIN("get_command");
         cmd = get_command();
-		cmd_tux = get_command_tux();
+		cmd_tux = (0 < n || tux_ready ? get_command_tux() : CMD_NONE);
 		if (cmd_tux != CMD_NONE) {
 			cmd = cmd_tux;
 		}
+        TRACE_END("get_command");
+        TRACE_END("msg_lock");
 		(void)pthread_mutex_unlock (&msg_lock);
 		
         switch (cmd) {
-            case CMD_UP:    move_photo_down();  break;
-            case CMD_RIGHT: move_photo_left();  break;
-            case CMD_DOWN:  move_photo_up();    break;
-            case CMD_LEFT:  move_photo_right(); break;
+            case CMD_UP:
+            case CMD_RIGHT:
+            case CMD_DOWN:
+            case CMD_LEFT:
+                motion = cmd;
+                break;
             case CMD_MOVE_LEFT:
                 enter_room = (TC_CHANGE_ROOM == try_to_move_left(&game_info.where));
                 break;
@@ -373,6 +480,37 @@ static game_condition_t game_loop() {
         if (NULL == game_info.where) {
             return GAME_WON;
         }
+
+        /* A new room is drawn at once. */
+        if (enter_room) {
+            render = 1;
+            continue;
+        }
+
+        /*
+         * Run the simulation steps that are due.  If we stalled for a
+         * long time, skip all but the last MAX_CATCH_UP steps.
+         */
+        due = frames * frame_usec / TICK_USEC;
+        if (MAX_CATCH_UP < due - steps) {
+            loop_stats.skipped += due - steps - MAX_CATCH_UP;
+            steps = due - MAX_CATCH_UP;
+        }
+        for (; due > steps; steps++) {
+            TRACE_BEGIN("step");
+            loop_stats.steps++;
+            game_info.step_x = game_info.map_x;
+            game_info.step_y = game_info.map_y;
+            switch (motion) {
+                case CMD_UP:    move_photo_down();  break;
+                case CMD_RIGHT: move_photo_left();  break;
+                case CMD_DOWN:  move_photo_up();    break;
+                case CMD_LEFT:  move_photo_right(); break;
+                default: break;
+            }
+            motion = CMD_NONE;
+            TRACE_END("step");
+        }
     } /* end of the main event loop */
 }
 
@@ -524,23 +662,16 @@ static void init_game() {
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: shifts view window
+ *   SIDE EFFECTS: changes the simulated view position(see scroll_view)
  */
 static void move_photo_down() {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over rows to redraw.         */
 
     /* Calculate the number of pixels by which to move. */
     delta = (game_info.y_speed > game_info.map_y ? game_info.map_y : game_info.y_speed);
 
     /* Shift the logical view upward. */
     game_info.map_y -= delta;
-    set_view_window(game_info.map_x, game_info.map_y);
-
-    /* Draw the newly exposed lines. */
-    for (idx = 0; delta > idx; idx++) {
-        (void)draw_horiz_line(idx);
-    }
 }
 
 
@@ -552,11 +683,10 @@ static void move_photo_down() {
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: shifts view window
+ *   SIDE EFFECTS: changes the simulated view position(see scroll_view)
  */
 static void move_photo_left() {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over columns to redraw.      */
 
     /* Calculate the number of pixels by which to move. */
     delta = room_photo_width(game_info.where) - SCROLL_X_DIM - game_info.map_x;
@@ -564,12 +694,6 @@ static void move_photo_left() {
 
     /* Shift the logical view to the right. */
     game_info.map_x += delta;
-    set_view_window(game_info.map_x, game_info.map_y);
-
-    /* Draw the newly exposed lines. */
-    for (idx = 1; delta >= idx; idx++) {
-        (void)draw_vert_line(SCROLL_X_DIM - idx);
-    }
 }
 
 
@@ -581,23 +705,16 @@ static void move_photo_left() {
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: shifts view window
+ *   SIDE EFFECTS: changes the simulated view position(see scroll_view)
  */
 static void move_photo_right() {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over columns to redraw.      */
 
     /* Calculate the number of pixels by which to move. */
     delta = (game_info.x_speed > game_info.map_x ? game_info.map_x : game_info.x_speed);
 
     /* Shift the logical view to the left. */
     game_info.map_x -= delta;
-    set_view_window(game_info.map_x, game_info.map_y);
-
-    /* Draw the newly exposed lines. */
-    for (idx = 0; delta > idx; idx++) {
-        (void)draw_vert_line(idx);
-    }
 }
 
 
@@ -609,11 +726,10 @@ static void move_photo_right() {
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: shifts view window
+ *   SIDE EFFECTS: changes the simulated view position(see scroll_view)
  */
 static void move_photo_up() {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over rows to redraw.         */
 
     /* Calculate the number of pixels by which to move. */
     delta = room_photo_height(game_info.where) - SCROLL_Y_DIM - game_info.map_y;
@@ -621,12 +737,244 @@ static void move_photo_up() {
 
     /* Shift the logical view upward. */
     game_info.map_y += delta;
-    set_view_window(game_info.map_x, game_info.map_y);
+}
+
+
+/*
+ * start_clock
+ *   DESCRIPTION: Start the event loop frame timer and prepare to sleep
+ *                until a frame or input arrives.  The ADVENTURE_FPS
+ *                environment variable sets the frame rate.  Descriptors
+ *                that cannot be polled(such as stdin redirected from a
+ *                file) are left out and simply read on each frame.  Tux
+ *                controller data is consumed by the controller's line
+ *                discipline rather than read by us, so only new arrivals
+ *                wake us(edge-triggered).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: creates the frame timer and epoll descriptors; the first
+ *                 frame occurs one frame period from now
+ */
+static int32_t start_clock() {
+    struct itimerspec  period;   /* frame timer setting            */
+    struct epoll_event ev;       /* event registration             */
+    const char*        env;      /* value of ADVENTURE_FPS         */
+    long               fps;      /* frames per second              */
+    int                kbd_fd;   /* keyboard input descriptor      */
+    int                tux_fd;   /* Tux controller descriptor      */
+
+    fps = (NULL != (env = getenv("ADVENTURE_FPS")) ? strtol(env, NULL, 10) : DEFAULT_FPS);
+    fps = (MIN_FPS > fps ? MIN_FPS : (MAX_FPS < fps ? MAX_FPS : fps));
+    frame_usec = 1000000 / fps;
+
+    if (-1 == (frame_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) ||
+        -1 == (wait_fd = epoll_create1(EPOLL_CLOEXEC))) {
+        stop_clock(NULL);
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u32 = WAKE_FRAME;
+    if (0 != epoll_ctl(wait_fd, EPOLL_CTL_ADD, frame_fd, &ev)) {
+        stop_clock(NULL);
+        return -1;
+    }
+    input_fds(&kbd_fd, &tux_fd);
+    ev.data.u32 = WAKE_KEYBOARD;
+    (void)epoll_ctl(wait_fd, EPOLL_CTL_ADD, kbd_fd, &ev);
+    if (0 <= tux_fd) {
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.u32 = WAKE_TUX;
+        (void)epoll_ctl(wait_fd, EPOLL_CTL_ADD, tux_fd, &ev);
+    }
+
+    /* Frame k starts k * frame_usec microseconds after frame 0(now). */
+    (void)getrusage(RUSAGE_SELF, &loop_stats.start_usage);
+    (void)clock_gettime(CLOCK_MONOTONIC, &loop_stats.start);
+    period.it_interval.tv_sec = 0;
+    period.it_interval.tv_nsec = frame_usec * 1000L;
+    period.it_value = loop_stats.start;
+    if ((period.it_value.tv_nsec += frame_usec * 1000L) >= 1000000000L) {
+        period.it_value.tv_sec++;
+        period.it_value.tv_nsec -= 1000000000L;
+    }
+    if (0 != timerfd_settime(frame_fd, TFD_TIMER_ABSTIME, &period, NULL)) {
+        stop_clock(NULL);
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * stop_clock
+ *   DESCRIPTION: Stop the event loop frame timer.
+ *   INPUTS: none(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: closes the frame timer and epoll descriptors
+ */
+static void stop_clock(void* ignore) {
+    if (-1 != wait_fd) {
+        (void)close(wait_fd);
+        wait_fd = -1;
+    }
+    if (-1 != frame_fd) {
+        (void)close(frame_fd);
+        frame_fd = -1;
+    }
+}
+
+
+/*
+ * usec_since
+ *   DESCRIPTION: Measure the time elapsed since a given time.
+ *   INPUTS: t -- the earlier time(CLOCK_MONOTONIC)
+ *   OUTPUTS: none
+ *   RETURN VALUE: microseconds elapsed since t
+ *   SIDE EFFECTS: none
+ */
+static int64_t usec_since(const struct timespec* t) {
+    struct timespec now; /* current time */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t->tv_sec) * 1000000LL + (now.tv_nsec - t->tv_nsec) / 1000;
+}
+
+
+/*
+ * wait_for_frame
+ *   DESCRIPTION: Sleep until the next frame period starts or input
+ *                arrives, whichever comes first.
+ *   INPUTS: none
+ *   OUTPUTS: tux_ready -- 1 if Tux controller input arrived, 0 if not
+ *   RETURN VALUE: number of frame periods that started while waiting
+ *                 (more than one if frames were missed; 0 if woken only
+ *                 by input), or -1 on failure
+ *   SIDE EFFECTS: records wake-up timing in loop_stats
+ */
+static int64_t wait_for_frame(int32_t* tux_ready) {
+    struct epoll_event events[3];  /* wake-up sources          */
+    uint64_t           expired;    /* frame timer expirations  */
+    int64_t            frames = 0; /* frame periods started    */
+    int64_t            late;       /* lateness in microseconds */
+    int                n;          /* number of events         */
+    int                i;          /* loop index over events   */
+
+    *tux_ready = 0;
+    do {
+        n = epoll_wait(wait_fd, events, 3, -1);
+    } while (-1 == n && EINTR == errno);
+    if (-1 == n) {
+        return -1;
+    }
+    for (i = 0; n > i; i++) {
+        if (WAKE_TUX == events[i].data.u32) {
+            *tux_ready = 1;
+        }
+        else if (WAKE_FRAME == events[i].data.u32 &&
+                 sizeof (expired) == read(frame_fd, &expired, sizeof (expired))) {
+            frames = expired;
+        }
+    }
+    if (0 == frames) {
+        loop_stats.input_wakes++;
+        return 0;
+    }
+
+    /* Measure lateness from the start of the latest frame period. */
+    loop_stats.frames += frames;
+    loop_stats.wakes++;
+    late = usec_since(&loop_stats.start) - (int64_t)loop_stats.frames * frame_usec;
+    late = (0 > late ? 0 : late);
+    loop_stats.late_usec += late;
+    loop_stats.late[LATE_BINS - 1 < late / LATE_BIN_USEC ? LATE_BINS - 1 : late / LATE_BIN_USEC]++;
+    return frames;
+}
 
-    /* Draw the newly exposed lines. */
-    for (idx = 1; delta >= idx; idx++) {
-        (void)draw_horiz_line(SCROLL_Y_DIM - idx);
+
+/*
+ * percentile
+ *   DESCRIPTION: Find a percentile of the values counted in a histogram.
+ *   INPUTS: hist -- the histogram
+ *           bins -- number of bins in the histogram
+ *           count -- number of values counted
+ *           pct -- the percentile(0 to 100)
+ *   OUTPUTS: none
+ *   RETURN VALUE: index of the bin holding the percentile
+ *   SIDE EFFECTS: none
+ */
+static uint32_t percentile(const uint32_t* hist, int32_t bins, uint32_t count, uint32_t pct) {
+    uint64_t seen; /* values in bins up to the one found */
+    int32_t  bin;  /* loop index over bins               */
+
+    for (bin = 0, seen = hist[0]; bins - 1 > bin && seen * 100 < (uint64_t)count * pct; ) {
+        seen += hist[++bin];
     }
+    return bin;
+}
+
+
+/*
+ * print_stats
+ *   DESCRIPTION: Print performance counters to stderr for use in
+ *                tuning.  Nothing is printed unless the ADVENTURE_STATS
+ *                environment variable is set.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void print_stats() {
+    room_photo_stats_t photos; /* room photo residency counters  */
+    modex_stats_t      video;  /* video memory traffic counters  */
+    struct rusage      usage;  /* CPU time used so far           */
+    uint64_t           cpu_ms; /* CPU time used since frame 0    */
+    uint64_t           run_us; /* real time since frame 0        */
+    uint32_t           shown;  /* frame times counted            */
+
+    if (NULL == getenv("ADVENTURE_STATS")) {
+        return;
+    }
+    (void)getrusage(RUSAGE_SELF, &usage);
+    run_us = usec_since(&loop_stats.start);
+    cpu_ms = ((usage.ru_utime.tv_sec + usage.ru_stime.tv_sec -
+               loop_stats.start_usage.ru_utime.tv_sec - loop_stats.start_usage.ru_stime.tv_sec) * 1000000LL +
+              usage.ru_utime.tv_usec + usage.ru_stime.tv_usec -
+              loop_stats.start_usage.ru_utime.tv_usec - loop_stats.start_usage.ru_stime.tv_usec) / 1000;
+    shown = (0 < loop_stats.rendered ? loop_stats.rendered - 1 : 0);
+    fprintf(stderr, "loop: %u steps, %u skipped; %u input wake-ups; %llu ms CPU in %llu ms\n",
+            loop_stats.steps, loop_stats.skipped, loop_stats.input_wakes,
+            (unsigned long long)cpu_ms, (unsigned long long)(run_us / 1000));
+    fprintf(stderr, "frames: %u rendered of %u at %d fps; %.1f fps achieved; rendered 1 in %u at worst\n",
+            loop_stats.rendered, loop_stats.frames, 1000000 / frame_usec,
+            loop_stats.rendered * 1e6 / (run_us ? run_us : 1), loop_stats.max_every);
+    fprintf(stderr, "frames: frame time %u us p50, %u us p90, %u us p99; wake-up lateness %llu us mean, "
+            "%u us p99\n", (percentile(loop_stats.frame, FRAME_BINS, shown, 50) + 1) * FRAME_BIN_USEC,
+            (percentile(loop_stats.frame, FRAME_BINS, shown, 90) + 1) * FRAME_BIN_USEC,
+            (percentile(loop_stats.frame, FRAME_BINS, shown, 99) + 1) * FRAME_BIN_USEC,
+            (unsigned long long)(loop_stats.late_usec / (loop_stats.wakes ? loop_stats.wakes : 1)),
+            (percentile(loop_stats.late, LATE_BINS, loop_stats.wakes, 99) + 1) * LATE_BIN_USEC);
+    modex_stats(&video);
+    fprintf(stderr, "video: %u frames, %u unchanged; %llu rows copied, %u whole windows on canvas; "
+            "%u of %u status bar updates unchanged\n", video.frames, video.frames_skipped,
+            video.rows_copied, video.canvas_moves, video.status_skipped, video.status_updates);
+    room_photo_stats(&photos);
+    fprintf(stderr, "room photos: %u hits, %u misses, %u waits, %u failures, %u evictions\n",
+            photos.hits, photos.misses, photos.waits, photos.failures, photos.evictions);
+    fprintf(stderr, "room photos: %u of %u room changes warm, %u prefetched, %u prefetches cancelled\n",
+            photos.warm_transitions, photos.transitions, photos.prefetches,
+            photos.prefetch_cancels);
+    fprintf(stderr, "room photos: %u previews; first frame %llu us avg, %llu us max; "
+            "final frame %llu us avg, %llu us max\n", photos.previews,
+            (unsigned long long)(photos.first_frame_usec / (photos.transitions ? photos.transitions : 1)),
+            (unsigned long long)photos.first_frame_max_usec,
+            (unsigned long long)(photos.final_frame_usec / (photos.final_frames ? photos.final_frames : 1)),
+            (unsigned long long)photos.final_frame_max_usec);
+    fprintf(stderr, "room photos: %u resident, %llu bytes(%llu in column/plane copies), "
+            "%llu peak, %llu budget\n", photos.resident, (unsigned long long)photos.bytes,
+            (unsigned long long)photos.copy_bytes, (unsigned long long)photos.peak_bytes,
+            (unsigned long long)photos.budget);
 }
 
 
@@ -639,12 +987,112 @@ static void move_photo_up() {
  *   SIDE EFFECTS: Draws the entire screen(but not the status bar).
  */
 static void redraw_room() {
-    int32_t i; /* index over rows */
+    TRACE_BEGIN("redraw_room");
+
+    /* Draw all lines in the scroll region as one block. */
+    (void)draw_horiz_lines(0, SCROLL_Y_DIM);
 
-    /* Draw all lines in the scroll region. */
-    for (i = 0; i < SCROLL_Y_DIM; i++) {
-        (void)draw_horiz_line(i);
+    TRACE_END("redraw_room");
+}
+
+
+/*
+ * update_status_bar
+ *   DESCRIPTION: Show the status message, or the room name and the
+ *                player's typing, on the status bar.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws the status bar
+ */
+static void update_status_bar() {
+    /*
+     * This area calls the function from modex.c to add components to the status bar
+     * depending on the action took
+     */
+
+    TRACE_BEGIN("update_status_bar");
+
+    /* Start of a critical section */
+    TRACE_BEGIN("msg_lock wait");
+    (void)pthread_mutex_lock(&msg_lock);
+    TRACE_END("msg_lock wait");
+    TRACE_BEGIN("msg_lock");
+
+    /* Conditional check if the new input exceeds the size and prevent writing on top of other words */
+    if(strcmp(input, get_typed_command())) {
+        add_status_bar('C', " ");
+        strcpy(input, get_typed_command());
+    }
+
+    /* If no status message, display the room name and allow user to type command */
+    if (status_msg[0] == '\0') {
+        /* If status bar exists, clear it */
+        if (status_flag == 1) {
+            add_status_bar('C', " ");
+            status_flag = 0;
+        }
+        add_status_bar ('R', room_name(game_info.where));
+        add_status_bar('T', get_typed_command());
     }
+
+    /* If there is an incoming status message, clear all the components and display the message */
+    else {
+        add_status_bar('S', status_msg);
+        status_flag = 1;
+    }
+    TRACE_END("msg_lock");
+    (void)pthread_mutex_unlock (&msg_lock);
+    /* End of a critical section */
+
+    TRACE_END("update_status_bar");
+}
+
+
+/*
+ * scroll_view
+ *   DESCRIPTION: Move the view window, drawing only the lines that it
+ *                exposes(or the whole window if it moves by a screen or
+ *                more).
+ *   INPUTS: (x,y) -- new upper left pixel of the view window
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: shifts the view window; draws into the build buffer
+ */
+static void scroll_view(int32_t x, int32_t y) {
+    int32_t dx = x - (int32_t)game_info.view_x; /* horizontal motion */
+    int32_t dy = y - (int32_t)game_info.view_y; /* vertical motion   */
+
+    if (0 == dx && 0 == dy) {
+        return;
+    }
+    TRACE_BEGIN("scroll_view");
+    game_info.view_x = x;
+    game_info.view_y = y;
+    set_view_window(x, y);
+    if (SCROLL_X_DIM <= abs(dx) || SCROLL_Y_DIM <= abs(dy)) {
+        redraw_room();
+        TRACE_END("scroll_view");
+        return;
+    }
+
+    /*
+     * Columns are drawn over the full height of the new window, so any
+     * corner exposed by diagonal motion is drawn with them.
+     */
+    if (0 < dx) {
+        (void)draw_vert_lines(SCROLL_X_DIM - dx, dx);
+    }
+    else if (0 > dx) {
+        (void)draw_vert_lines(0, -dx);
+    }
+    if (0 < dy) {
+        (void)draw_horiz_lines(SCROLL_Y_DIM - dy, dy);
+    }
+    else if (0 > dy) {
+        (void)draw_horiz_lines(0, -dy);
+    }
+    TRACE_END("scroll_view");
 }
 
 
@@ -663,6 +1111,7 @@ static void redraw_room() {
 static void* status_thread(void* ignore) {
     struct timespec ts; /* absolute wake-up time */
 
+    trace_thread_name("status");
     while (1) {
         /*
          * Wait for a message to appear.  Note that we must check the
@@ -713,25 +1162,6 @@ else {
 }
 
 
-/*
- * time_is_after
- *   DESCRIPTION: Check whether one time is at or after a second time.
- *   INPUTS: t1 -- the first time
- *           t2 -- the second time
- *   OUTPUTS: none
- *   RETURN VALUE: 1 if t1 >= t2
- *                 0 if t1 < t2
- *   SIDE EFFECTS: none
- */
-static int time_is_after(struct timeval* t1, struct timeval* t2) {
-    if (t1->tv_sec == t2->tv_sec)
-        return (t1->tv_usec >= t2->tv_usec);
-    if (t1->tv_sec > t2->tv_sec)
-        return 1;
-    return 0;
-}
-
-
 /*
  * show_status(interface function; declared in world.h)
  *   DESCRIPTION: Show a specific status message of up to STATUS_MSG_LEN
@@ -773,6 +1203,10 @@ int main() {
     /* Randomize for more fun(remove for deterministic layout). */
     srand(time(NULL));
 
+    /* Start tracing if requested; the trace is written on exit. */
+    trace_init();
+    push_cleanup(trace_dump, NULL);
+
     /* Provide some protection against fatal errors. */
     clean_on_signals();
 
@@ -792,9 +1226,10 @@ int main() {
 
 
     /* Start mode X. */
-    if (0 != set_mode_X(fill_horiz_buffer, fill_vert_buffer)) {
+    if (0 != set_mode_X(fill_horiz_block, fill_vert_block)) {
         PANIC("cannot initialize mode X");
     }
+    set_horiz_planes_fn(fill_horiz_planes);
     push_cleanup((cleanup_fn_t)clear_mode_X, NULL);
 
     /* Initialize the keyboard and/or Tux controller. */
@@ -803,17 +1238,28 @@ int main() {
     }
     push_cleanup((cleanup_fn_t)shutdown_input, NULL);
 
+    /* Start the event loop frame timer. */
+    if (0 != start_clock()) {
+        PANIC("cannot start frame timer");
+    }
+    push_cleanup(stop_clock, NULL);
+
     game = game_loop();
 
     pop_cleanup(1);
     pop_cleanup(1);
     pop_cleanup(1);
+    pop_cleanup(1);
 
     /* Print a message about the outcome. */
     switch (game) {
         case GAME_WON: printf("You win the game! CONGRATULATIONS!\n"); break;
         case GAME_QUIT: printf("Quitter!\n"); break;
     }
+    print_stats();
+
+    /* Write the trace. */
+    pop_cleanup(1);
 
     /* Return success. */
     return 0;
@@ -70,7 +70,7 @@
 
 /* stores original terminal settings */
 static struct termios tio_orig;
-static int fd;
+static int fd = -1;  /* Tux controller, or -1 if not open */
 static cmd_t pushed_cmd = CMD_NONE;
 
 /*
@@ -382,6 +382,24 @@ cmd_t get_command_tux() {
 	return CMD_NONE;
 }
 
+/*
+ * input_fds
+ *   DESCRIPTION: Get the file descriptors on which input arrives, so that
+ *                the caller can sleep until input is available.  Commands
+ *                are still read with get_command and get_command_tux.
+ *   INPUTS: none
+ *   OUTPUTS: keyboard_fd -- descriptor for keyboard input(stdin)
+ *            tux_fd -- descriptor for the Tux controller, or -1 if the
+ *                      controller is not open
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void input_fds(int* keyboard_fd, int* tux_fd) {
+    *keyboard_fd = fileno(stdin);
+    *tux_fd = fd;
+}
+
+
 /*
  * shutdown_input
  *   DESCRIPTION: Cleans up state associated with input control.  Restores
@@ -79,6 +79,12 @@ extern const char* get_typed_command();
 /* Reset typed command. */
 extern void reset_typed_command();
 
+/*
+ * Get the descriptors on which keyboard and Tux controller input arrive
+ * (tux_fd is -1 if the controller is not open).
+ */
+extern void input_fds(int* keyboard_fd, int* tux_fd);
+
 /* Shut down the input device. */
 extern void shutdown_input();
 
@@ -40,42 +40,61 @@
  *        Split fill_palette by mode and cleaned up code for release.
  */
 
-#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/io.h>
-#include <sys/mman.h>
-#include <unistd.h>
 
 #include "modex.h"
+#include "simd.h"
 #include "text.h"
+#include "trace.h"
+#include "vga.h"
 
 
 /*
  * Calculate the image build buffer parameters. SCROLL_SIZE is the space
- * needed for one plane of an image. SCREEN_SIZE is the space needed for
- * all four planes. The extra +1 supports logical view x coordinates that
- * are not multiples of four. In these cases, some plane addresses are
- * shifted by 1 byte forward. The planes are stored in the build buffer
- * in reverse order to allow those planes that shift forward to do so
- * without running into planes that aren't shifted. For example, when
- * the leftmost x pixel in the logical view is 3 mod 4, planes 2, 1, and 0
- * are shifted forward, while plane 3 is not, so there is one unused byte
- * between the image of plane 3 and that of plane 2. BUILD_BUF_SIZE is
- * the size of the space allocated for building images. We add 20000 bytes
- * to reduce the number of memory copies required during scrolling.
- * Strictly speaking(try it), no extra space is necessary, but the minimum
- * means an extra 64kB memory copy with every scroll pixel. Finally,
- * BUILD_BASE_INIT places initial(or transferred) logical view in the
- * middle of the available buffer area.
+ * needed for one plane of an image. Each plane of the build buffer is a
+ * ring of RING_SIZE bytes, in which the pixel at logical view
+ * coordinates(x,y) is stored at offset(x / 4 + y * SCROLL_X_WIDTH)
+ * modulo RING_SIZE(see BUILD_OFF). A ring holds any one screen of
+ * SCROLL_SIZE bytes(plus one for planes whose first pixel falls in the
+ * next address when the logical view x coordinate is not a multiple of
+ * four), so moving the logical view never moves data already drawn; new
+ * lines simply overwrite pixels that have left the screen.
+ *
+ * Lines are drawn into each plane as though it were not a ring: the
+ * RING_GUARD bytes that follow each ring receive any pixels drawn past
+ * its end, and are then moved to the start of the ring(see unwrap_guard).
+ * A guard of one screen allows a whole screen to be drawn at once.
+ * BUILD_BUF_SIZE is the size of the space allocated for building images.
  */
 #define SCROLL_SIZE        (SCROLL_X_WIDTH * SCROLL_Y_DIM)
-#define SCREEN_SIZE        (SCROLL_SIZE * 4 + 1)
-#define BUILD_BUF_SIZE     (SCREEN_SIZE + 20000)
-#define BUILD_BASE_INIT    ((BUILD_BUF_SIZE - SCREEN_SIZE) / 2)
+#define RING_SIZE          16384
+#define RING_GUARD         SCROLL_SIZE
+#define PLANE_SPAN         (RING_SIZE + RING_GUARD)
+#define BUILD_BUF_SIZE     (PLANE_SPAN * 4)
+
+/*
+ * Calculate the video memory layout for panning presentation(see
+ * show_canvas).  Rather than two screen pages, video memory holds a
+ * single canvas with rows CANVAS_WIDTH bytes apart, in which the pixel at
+ * logical view coordinates(x,y) is at canvas_org + x / 4 + y *
+ * CANVAS_WIDTH.  A screen displayed from the canvas spans CANVAS_SPAN
+ * bytes(one more than SCROLL_X_WIDTH per row, as the VGA fetches another
+ * byte when the pixels are panned).  The remaining bytes of each row are
+ * never displayed, so the view can move by up to PAN_MAX_STEP bytes to
+ * either side without writing to any displayed byte.  The status bar
+ * rows use the same row width, and the canvas lies in the video memory
+ * after them, starting at CANVAS_START.
+ */
+#define CANVAS_WIDTH       88
+#define CANVAS_SPAN        ((SCROLL_Y_DIM - 1) * CANVAS_WIDTH + SCROLL_X_WIDTH + 1)
+#define PAN_MAX_STEP       (CANVAS_WIDTH - SCROLL_X_WIDTH - 1)
+#define STATUS_ROWS        (STATUS_BAR_SIZE / 4 / IMAGE_X_WIDTH)
+#define CANVAS_START       (STATUS_ROWS * CANVAS_WIDTH)
 
 /* Mode X and general VGA parameters */
-#define VID_MEM_SIZE        131072
 #define MODE_X_MEM_SIZE      65536
 #define NUM_SEQUENCER_REGS       5
 #define NUM_CRTC_REGS           25
@@ -129,7 +148,6 @@ static unsigned short text_graphics[NUM_GRAPHICS_REGS] = {
 };
 
 /* local functions--see function headers for details */
-static int open_memory_and_ports ();
 static void VGA_blank (int blank_bit);
 static void set_seq_regs_and_reset (unsigned short table[NUM_SEQUENCER_REGS],
 				    unsigned char val);
@@ -140,8 +158,18 @@ static void fill_palette_mode_x ();
 static void fill_palette_text ();
 static void write_font_data ();
 static void set_text_mode_3 (int clear_scr);
-static void copy_image (unsigned char* img, unsigned short scr_addr);
-static void copy_status_bar(unsigned char* img, unsigned short scr_addr);
+static void copy_image (unsigned char* img, unsigned short scr_addr, int len);
+static void copy_from_ring(unsigned char* ring, int off, unsigned short scr_addr, int len);
+static void mark_rows_dirty(int y, int count);
+static void show_canvas();
+static void set_attr_register(unsigned char index, unsigned char val);
+static void count_port_write(unsigned short port);
+static void end_frame();
+static void print_traffic();
+#ifndef TEXT_RESTORE_PROGRAM
+static void note_drawn(int x, int y, int width, int height);
+static void unwrap_guard(unsigned char* ring, int off, int len);
+#endif /* !defined(TEXT_RESTORE_PROGRAM) */
 
 /*
  * Images are built in this buffer, then copied to the video memory.
@@ -152,15 +180,10 @@ static void copy_status_bar(unsigned char* img, unsigned short scr_addr);
  * the number of video memory writes; unfortunately, these techniques
  * are slower in emulation...).
  *
- * The size allows the four plane images to move within an area of
- * about twice the size necessary(to reduce the need to deal with
- * the boundary conditions by moving the data within the buffer).
- *
- * Plane 3 is first, followed by 2, 1, and 0. The reverse ordering
- * is used because the logical address of 0 increases first; if plane
- * 0 were first, we would need a buffer byte to keep it from colliding
- * with plane 1 when plane 0 was offset by 1 from plane 1, i.e., when
- * displaying a one-pixel left shift.
+ * Each plane is a ring followed by its guard(see above), so the plane
+ * images never move within the buffer, however far the logical view
+ * scrolls. Plane 3 is first, followed by 2, 1, and 0, so the plane of
+ * pixel x is found at plane offset 3 - (x & 3).
  *
  * The memory fence(included when NDEBUG is not defined) allocates
  * the build buffer with extra space on each side. The extra space
@@ -176,21 +199,96 @@ static void copy_status_bar(unsigned char* img, unsigned short scr_addr);
 #endif
 #define MEM_FENCE_MAGIC 0xF3
 static unsigned char build[BUILD_BUF_SIZE + 2 * MEM_FENCE_WIDTH];
-static int img3_off;            /* offset of upper left pixel  */
-static unsigned char* img3;     /* pointer to upper left pixel */
 static int show_x, show_y;      /* logical view coordinates    */
 
+/* ring of build buffer plane at plane offset p_off(see above) */
+#define BUILD_PLANE(p_off) (build + MEM_FENCE_WIDTH + (p_off) * PLANE_SPAN)
+
+/* offset within a plane ring of the pixel at logical coordinates(x,y) */
+#define BUILD_OFF(x,y)     ((((x) >> 2) + (y) * SCROLL_X_WIDTH) & (RING_SIZE - 1))
+
 /* displayed video memory variables */
-static unsigned char* mem_image;    /* pointer to start of video memory */
 static unsigned short target_img;   /* offset of displayed screen image */
 
+/*
+ * Damage tracking for the two screen pages in video memory.  The page at
+ * offset target_img is PAGE_OF(target_img).  A row of the scrolling region
+ * is marked in page_dirty for each page whose copy of the row may differ
+ * from the logical view window in the build buffer; page_dirty_rows counts
+ * the marked rows of each page.  show_screen copies only the marked rows
+ * to the page that it displays next, and does nothing at all while the
+ * displayed page is up to date.
+ */
+#define PAGE_OF(scr_addr) (((scr_addr) >> 14) & 1)
+static unsigned char page_dirty[2][SCROLL_Y_DIM];
+static int page_dirty_rows[2];
+
+/*
+ * copy of the status bar in video memory, so that add_status_bar writes
+ * only rows that change; valid only when status_shown_ok is set
+ */
+static unsigned char status_shown[STATUS_BAR_SIZE];
+static int status_shown_ok = 0;
+
+/*
+ * Panning presentation state(see show_canvas).  When canvas_ok is set,
+ * the canvas in video memory holds the logical view window at(pan_x,
+ * pan_y), and canvas_org is the video memory address of logical(0,0)
+ * (which may lie outside of video memory).  When canvas_shown is set,
+ * the display shows the canvas.
+ */
+static int pan_mode = 0;        /* set to use panning presentation  */
+static int status_width = IMAGE_X_WIDTH; /* status bar row width    */
+static int canvas_ok = 0;       /* canvas holds window(pan_x,pan_y) */
+static int canvas_shown = 0;    /* canvas is on the display         */
+static int canvas_org;          /* address of logical(0,0)          */
+static int pan_x, pan_y;        /* logical view window on canvas    */
+
+/* video memory traffic counters(see modex_stats) */
+static modex_stats_t stats;
+
+/*
+ * Histograms of the video traffic in each frame.  Each call to show_screen
+ * ends a frame, and the traffic since the end of the previous frame is
+ * added to one histogram for each kind of traffic(see end_frame).  Bin 0
+ * counts frames without that traffic, and bin k counts frames with from
+ * 2^(k-1) to 2^k - 1 units of it; the last bin also counts anything more.
+ */
+#define TRAFFIC_BINS 24
+enum {
+    TRAFFIC_VRAM, TRAFFIC_STATUS_VRAM, TRAFFIC_MASKS, TRAFFIC_PALETTE,
+    TRAFFIC_CRTC, TRAFFIC_PORTS, TRAFFIC_STATUS_CALLS, NUM_TRAFFIC
+};
+static const char* const traffic_name[NUM_TRAFFIC] = {
+    "vram_bytes", "status_bytes", "write_masks", "palette_writes",
+    "crtc_writes", "port_writes", "status_bar_calls"
+};
+static unsigned long long traffic_base[NUM_TRAFFIC]; /* totals at last frame */
+static unsigned long long traffic_max[NUM_TRAFFIC];  /* most in one frame    */
+static unsigned int traffic_hist[NUM_TRAFFIC][TRAFFIC_BINS]; /* histograms   */
+
 /*
  * functions provided by the caller to set_mode_X() and used to obtain
- * graphic images of lines(pixels) to be mapped into the build buffer
- * planes for display in mode X
+ * graphic images of blocks of lines(pixels) to be mapped into the build
+ * buffer planes for display in mode X
  */
-static void(*horiz_line_fn)(int, int, unsigned char[SCROLL_X_DIM]);
-static void(*vert_line_fn)(int, int, unsigned char[SCROLL_Y_DIM]);
+static void(*horiz_line_fn)(int, int, int, unsigned char*);
+static void(*vert_line_fn)(int, int, int, unsigned char*);
+
+/*
+ * optional function used by draw_horiz_lines to draw lines directly into
+ * the build buffer planes(see set_horiz_planes_fn)
+ */
+static int(*horiz_planes_fn)(int, int, int, unsigned char*[4]) = NULL;
+
+#ifndef TEXT_RESTORE_PROGRAM
+/*
+ * Images of blocks of lines are built in this buffer before being
+ * mapped into the build buffer planes; it holds every line of the
+ * logical view window in either direction.
+ */
+static unsigned char lines[SCROLL_X_DIM * SCROLL_Y_DIM];
+#endif /* !defined(TEXT_RESTORE_PROGRAM) */
 
 /*
  * macro used to target a specific video plane or planes when writing
@@ -199,39 +297,22 @@ static void(*vert_line_fn)(int, int, unsigned char[SCROLL_Y_DIM]);
  */
 #define SET_WRITE_MASK(mask_hi_bits)                    \
 do {                                                    \
-    asm volatile("                                    \n\
-        movw $0x03C4, %%dx  /* set write mask */      \n\
-        movb $0x02, %b0                               \n\
-        outw %w0, (%%dx)                              \n\
-        "                                               \
-        :                                               \
-        : "a"((mask_hi_bits))                           \
-        : "edx", "memory"                               \
-    );                                                  \
+    stats.write_masks++;                                \
+    OUTW(0x03C4, ((mask_hi_bits) & 0xFF00) | 0x02);     \
 } while (0)
 
 /* macro used to write a byte to a port */
 #define OUTB(port, val)                                 \
 do {                                                    \
-    asm volatile("                                    \n\
-        outb %b1, (%w0)                               \n\
-        "                                               \
-        : /* no outputs */                              \
-        : "d"((port)), "a"((val))                       \
-        : "memory", "cc"                                \
-    );                                                  \
+    count_port_write(port);                             \
+    vga_outb((port), (val));                            \
 } while (0)
 
 /* macro used to write two bytes to two consecutive ports */
 #define OUTW(port, val)                                 \
 do {                                                    \
-    asm volatile("                                    \n\
-        outw %w1, (%w0)                               \n\
-        "                                               \
-        : /* no outputs */                              \
-        : "d"((port)), "a"((val))                       \
-        : "memory", "cc"                                \
-    );                                                  \
+    count_port_write(port);                             \
+    vga_outw((port), (val));                            \
 } while (0)
 
 /*
@@ -239,17 +320,10 @@ do {                                                    \
  */
 #define REP_OUTSW(port, source, count)                  \
 do {                                                    \
-    asm volatile("                                    \n\
-        1: movw 0(%1), %%ax                           \n\
-        outw %%ax, (%w2)                              \n\
-        addl $2, %1                                   \n\
-        decl %0                                       \n\
-        jne 1b                                        \n\
-        "                                               \
-        : /* no outputs */                              \
-        : "c"((count)), "S"((source)), "d"((port))      \
-        : "eax", "memory", "cc"                         \
-    );                                                  \
+    const unsigned short* _src = (const unsigned short*)(source); \
+    int _n;                                             \
+    for (_n = (count); _n > 0; _n--)                    \
+        OUTW((port), *_src++);                          \
 } while (0)
 
 /*
@@ -257,37 +331,36 @@ do {                                                    \
  */
 #define REP_OUTSB(port, source, count)                  \
 do {                                                    \
-    asm volatile("                                    \n\
-        1: movb 0(%1), %%al                           \n\
-        outb %%al, (%w2)                              \n\
-        incl %1                                       \n\
-        decl %0                                       \n\
-        jne 1b                                        \n\
-        "                                               \
-        : /* no outputs */                              \
-        : "c"((count)), "S"((source)), "d"((port))      \
-        : "eax", "memory", "cc"                         \
-    );                                                  \
+    const unsigned char* _src = (const unsigned char*)(source); \
+    int _n;                                             \
+    for (_n = (count); _n > 0; _n--)                    \
+        OUTB((port), *_src++);                          \
 } while (0)
 
 /*
  * set_mode_X
  *   DESCRIPTION: Puts the VGA into mode X.
  *   INPUTS: horiz_fill_fn -- this function is used as a callback (by
- *   			      draw_horiz_line) to obtain a graphical 
- *   			      image of a particular logical line for 
- *   			      drawing to the build buffer
+ *   			      draw_horiz_lines) to obtain a graphical
+ *   			      image of a block of consecutive logical
+ *   			      lines for drawing to the build buffer; it
+ *   			      is given the first line's leftmost pixel,
+ *   			      the number of lines, and a buffer in which
+ *   			      line k starts at k * SCROLL_X_DIM
  *           vert_fill_fn -- this function is used as a callback (by
- *   			     draw_vert_line) to obtain a graphical 
- *   			     image of a particular logical line for 
- *   			     drawing to the build buffer
+ *   			     draw_vert_lines) to obtain a graphical
+ *   			     image of a block of consecutive logical
+ *   			     lines for drawing to the build buffer; line
+ *   			     k of its buffer starts at k * SCROLL_Y_DIM
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success, -1 on failure
- *   SIDE EFFECTS: initializes the logical view window; maps video memory
- *                 and obtains permission for VGA ports; clears video memory
+ *   SIDE EFFECTS: initializes the logical view window; opens the VGA
+ *                 backend(see vga.h); clears video memory;
+ *                 selects panning presentation(see show_canvas) if the
+ *                 ADVENTURE_PAN environment variable is set and not 0
  */   
-int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
-               void(*vert_fill_fn)(int, int, unsigned char[SCROLL_Y_DIM])) {
+int set_mode_X(void(*horiz_fill_fn)(int, int, int, unsigned char*),
+               void(*vert_fill_fn)(int, int, int, unsigned char*)) {
     int i; /* loop index for filling memory fence with magic numbers */
 
     /* 
@@ -301,8 +374,13 @@ int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
 
     /* Initialize the logical view window to position (0,0). */
     show_x = show_y = 0;
-    img3_off = BUILD_BASE_INIT;
-    img3 = build + img3_off + MEM_FENCE_WIDTH;
+
+    /*
+     * Use panning presentation(see show_canvas) if the ADVENTURE_PAN
+     * environment variable is set to something other than 0.
+     */
+    pan_mode = (NULL != getenv("ADVENTURE_PAN") && 0 != atoi(getenv("ADVENTURE_PAN")));
+    status_width = (pan_mode ? CANVAS_WIDTH : IMAGE_X_WIDTH);
 
     /* Set up the memory fence on the build buffer. */
     for (i = 0; i < MEM_FENCE_WIDTH; i++) {
@@ -313,8 +391,8 @@ int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
     /* One display page goes at the start of video memory. */
     target_img = STATUS_BAR_SIZE; 
 
-    /* Map video memory and obtain permission for VGA port access. */
-    if (open_memory_and_ports () == -1)
+    /* Open the VGA(or its model; see vga.h). */
+    if (vga_open() == -1)
         return -1;
 
     /* 
@@ -334,6 +412,11 @@ int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
     set_CRTC_registers (mode_X_CRTC);            /* CRT control registers */
     set_attr_registers (mode_X_attr);            /* attribute registers   */
     set_graphics_registers (mode_X_graphics);    /* graphics registers    */
+    if (pan_mode) {
+        /* Widen rows to the canvas, and do not pan the status bar. */
+        OUTW (0x03D4, ((CANVAS_WIDTH / 2) << 8) | 0x13);
+        set_attr_register (0x10, 0x61);
+    }
     fill_palette_mode_x ();			 /* palette colors        */
     clear_screens ();				 /* zero video memory     */
     VGA_blank (0);			         /* unblank the screen    */
@@ -342,6 +425,30 @@ int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
     return 0;
 }
 
+/*
+ * set_horiz_planes_fn
+ *     DESCRIPTION: Provide a function that draw_horiz_lines uses to draw
+ *                  lines directly into the build buffer planes rather than
+ *                  obtaining an image of the lines and distributing their
+ *                  pixels among the planes.  The function is given the
+ *                  logical coordinates of the first line, the number of
+ *                  lines, and pointers to the build buffer addresses for
+ *                  pixels x, x + 1, x + 2, and x + 3 of the first line;
+ *                  successive addresses in each plane hold every fourth
+ *                  pixel, and each following line starts SCROLL_X_WIDTH
+ *                  bytes after the one before it.  If the function returns
+ *                  -1, the lines are drawn with the function given to
+ *                  set_mode_X.
+ *     INPUTS: planes_fn -- the function, or NULL to always use the one
+ *                          given to set_mode_X
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: none
+ */
+void set_horiz_planes_fn(int(*planes_fn)(int, int, int, unsigned char*[4])) {
+    horiz_planes_fn = planes_fn;
+}
+
 /*
  * clear_mode_X
  *     DESCRIPTION: Puts the VGA into text mode 3(color text).
@@ -349,7 +456,9 @@ int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
  *     OUTPUTS: none
  *     RETURN VALUE: none
  *     SIDE EFFECTS: restores font data to video memory; clears screens;
- *                   unmaps video memory; checks memory fence integrity
+ *                   closes the VGA backend; checks memory fence integrity;
+ *                   prints the video traffic histograms(see print_traffic)
+ *                   if the ADVENTURE_STATS environment variable is set
  */
 void clear_mode_X() {
     int i;     /* loop index for checking memory fence */
@@ -357,8 +466,8 @@ void clear_mode_X() {
     /* Put VGA into text mode, restore font data, and clear screens. */
     set_text_mode_3(1);
 
-    /* Unmap video memory. */
-    (void)munmap(mem_image, VID_MEM_SIZE);
+    /* Release video memory. */
+    vga_close();
 
     /* Check validity of build buffer memory fence.    Report breakage. */
     for (i = 0; i < MEM_FENCE_WIDTH; i++) {
@@ -373,125 +482,42 @@ void clear_mode_X() {
             break;
         }
     }
+
+    /* Summarize the video traffic. */
+    if (NULL != getenv("ADVENTURE_STATS"))
+        print_traffic();
 }
 
 /*
  * set_view_window
- *     DESCRIPTION: Set the logical view window, moving its location within
- *                  the build buffer if necessary to keep all on-screen data
- *                  in the build buffer. If the location within the build
- *                  buffer moves, this function copies all data from the old
- *                  window that are within the new screen to the appropriate
- *                  new location, so only data not previously on the screen
- *                  must be drawn before calling show_screen.
+ *     DESCRIPTION: Set the logical view window.  Each plane of the build
+ *                  buffer is a ring addressed by logical coordinates(see
+ *                  BUILD_OFF), so all data from the old window that are
+ *                  within the new screen remain where they are, and only
+ *                  data not previously on the screen must be drawn before
+ *                  calling show_screen.
  *     INPUTS:(scr_x,scr_y) -- new upper left pixel of logical view window
  *     OUTPUTS: none
  *     RETURN VALUE: none
- *     SIDE EFFECTS: may shift position of logical view window within build
- *                   buffer
+ *     SIDE EFFECTS: marks the whole screen as changed if the window moves
  */
 void set_view_window(int scr_x, int scr_y) {
-    int old_x, old_y;       /* old position of logical view window                              */
-    int start_x, start_y;   /* starting position for copying from old to new                    */
-    int end_x, end_y;       /* ending position for copying from old to new                      */
-    int start_off;          /* offset of copy start relative to old build buffer start position */
-    int length;             /* amount of data to be copied                                      */
-    int i;                  /* copy loop index                                                  */
-    unsigned char* start_addr;      /* starting memory address of copy                          */
-    unsigned char* target_addr;     /* destination memory address for copy                      */
-
-    /* Record the old position. */
-    old_x = show_x;
-    old_y = show_y;
-
-    /* Keep track of the new view window. */
+    /* Every row of the screen changes when the window moves. */
+    if (scr_x != show_x || scr_y != show_y)
+        mark_rows_dirty(0, SCROLL_Y_DIM);
+
     show_x = scr_x;
     show_y = scr_y;
-
-    /*
-     * If the new view window fits within the boundaries of the build
-     * buffer, we need move nothing around.
-     */
-    if (img3_off + (scr_x >> 2) + scr_y * SCROLL_X_WIDTH >= 0 &&
-        img3_off + 3 * SCROLL_SIZE + ((scr_x + SCROLL_X_DIM - 1) >> 2) +
-        (scr_y + SCROLL_Y_DIM - 1) * SCROLL_X_WIDTH < BUILD_BUF_SIZE)
-        return;
-
-    /*
-     * If the new screen does not overlap at all with the old screen, none
-     * of the old data need to be saved, and we can simply reposition the
-     * valid window of the build buffer in the middle of that buffer.
-     */
-    if (scr_x <= old_x - SCROLL_X_DIM || scr_x >= old_x + SCROLL_X_DIM ||
-        scr_y <= old_y - SCROLL_Y_DIM || scr_y >= old_y + SCROLL_Y_DIM) {
-        img3_off = BUILD_BASE_INIT -(scr_x >> 2) - scr_y * SCROLL_X_WIDTH;
-        img3 = build + img3_off + MEM_FENCE_WIDTH;
-        return;
-    }
-
-    /*
-     * Any still-visible portion of the old screen should be retained.
-     * Rather than clipping exactly, we copy all contiguous data between
-     * a clipped starting point to a clipped ending point(which may
-     * include non-visible data).
-     *
-     * The starting point is the maximum(x,y) coordinates between the
-     * new and old screens.    The ending point is the minimum(x,y)
-     * coordinates between the old and new screens(offset by the screen
-     * size).
-     */
-    if (scr_x > old_x) {
-        start_x = scr_x;
-        end_x = old_x;
-    }
-    else {
-        start_x = old_x;
-        end_x = scr_x;
-    }
-    end_x += SCROLL_X_DIM - 1;
-    if (scr_y > old_y) {
-        start_y = scr_y;
-        end_y = old_y;
-    }
-    else {
-        start_y = old_y;
-        end_y = scr_y;
-    }
-    end_y += SCROLL_Y_DIM - 1;
-
-    /*
-     * We now calculate the starting and ending addresses for the copy
-     * as well as the new offsets for use with the build buffer.    The
-     * length to be copied is basically the ending offset minus the starting
-     * offset plus one(plus the three screens in between planes 3 and 0).
-     */
-    start_off = (start_x >> 2) + start_y * SCROLL_X_WIDTH;
-    start_addr = img3 + start_off;
-    length = (end_x >> 2) + end_y * SCROLL_X_WIDTH + 1 - start_off + 3 * SCROLL_SIZE;
-    img3_off = BUILD_BASE_INIT -(show_x >> 2) - show_y * SCROLL_X_WIDTH;
-    img3 = build + img3_off + MEM_FENCE_WIDTH;
-    target_addr = img3 + start_off;
-
-    /*
-     * Copy the relevant portion of the screen from the old location to the
-     * new one.    The areas may overlap, so copy direction is important.
-     *(You should be able to explain why!)
-     */
-    if (start_addr < target_addr) {
-        for (i = length; i-- > 0; ) {
-            target_addr[i] = start_addr[i];
-        }
-    }
-    else {
-        for (i = 0; i < length; i++) {
-            target_addr[i] = start_addr[i];
-        }
-    }
 }
 
 /*
  * show_screen
  *     DESCRIPTION: Show the logical view window on the video display.
+ *                  Only the rows of the scrolling region that have changed
+ *                  since the other screen page was last shown are copied;
+ *                  if the displayed page is already up to date, nothing is
+ *                  done.  With panning presentation, the window is shown
+ *                  from the canvas instead(see show_canvas).
  *     INPUTS: none
  *     OUTPUTS: none
  *     RETURN VALUE: none
@@ -499,9 +525,30 @@ void set_view_window(int scr_x, int scr_y) {
  *                   shifts the VGA display source to point to the new image
  */
 void show_screen() {
-    unsigned char* addr;    /* source address for copy             */
-    int p_off;              /* plane offset of first display plane */
-    int i;                  /* loop index over video planes        */
+    unsigned char* ring;    /* build buffer plane copied               */
+    int off;                /* offset of screen within ring            */
+    int p_off;              /* plane offset of first display plane     */
+    int page;               /* screen page drawn                       */
+    int y;                  /* first row of a run of changed rows      */
+    int end;                /* row after the run                       */
+    int i;                  /* loop index over video planes            */
+
+    stats.frames++;
+    if (pan_mode) {
+        TRACE_BEGIN("show_canvas");
+        show_canvas();
+        TRACE_END("show_canvas");
+        end_frame();
+        return;
+    }
+
+    /* Leave the display alone if it already shows the view window. */
+    if (0 == page_dirty_rows[PAGE_OF(target_img)]) {
+        stats.frames_skipped++;
+        end_frame();
+        return;
+    }
+    TRACE_BEGIN("show_screen");
 
     /*
      * Calculate offset of build buffer plane to be mapped into plane 0
@@ -511,15 +558,30 @@ void show_screen() {
 
     /* Switch to the other target screen in video memory. */
     target_img ^= 0x4000;
+    page = PAGE_OF(target_img);
 
-    /* Calculate the source address. */
-    addr = img3 + (show_x >> 2) + show_y * SCROLL_X_WIDTH;
-
-    /* Draw to each plane in the video memory. */
+    /*
+     * Draw to each plane in the video memory, copying each run of
+     * changed rows with a single copy(or two, if the run wraps past the
+     * end of the plane's ring).
+     */
     for (i = 0; i < 4; i++) {
         SET_WRITE_MASK(1 << (i + 8));
-        copy_image(addr + ((p_off - i + 4) & 3) * SCROLL_SIZE + (p_off < i), target_img);
+        ring = BUILD_PLANE((p_off - i + 4) & 3);
+        off = BUILD_OFF(show_x, show_y) + (p_off < i);
+        for (y = 0; y < SCROLL_Y_DIM; y = end + 1) {
+            for (end = y; end < SCROLL_Y_DIM && page_dirty[page][end]; end++);
+            if (end > y) {
+                copy_from_ring(ring, off + y * SCROLL_X_WIDTH, target_img + y * SCROLL_X_WIDTH,
+                               (end - y) * SCROLL_X_WIDTH);
+            }
+        }
     }
+    stats.rows_copied += page_dirty_rows[page];
+
+    /* The page drawn now matches the build buffer. */
+    memset(page_dirty[page], 0, SCROLL_Y_DIM);
+    page_dirty_rows[page] = 0;
 
     /*
      * Change the VGA registers to point the top left of the screen
@@ -527,6 +589,8 @@ void show_screen() {
      */
     OUTW(0x03D4, (target_img & 0xFF00) | 0x0C);
     OUTW(0x03D4, ((target_img & 0x00FF) << 8) | 0x0D);
+    end_frame();
+    TRACE_END("show_screen");
 }
 
 
@@ -536,38 +600,340 @@ void show_screen() {
  *     INPUTS: none
  *     OUTPUTS: none
  *     RETURN VALUE: none
- *     SIDE EFFECTS: fills all 256kB of VGA video memory with zeroes
+ *     SIDE EFFECTS: fills all 256kB of VGA video memory with zeroes;
+ *                   marks both screen pages and the status bar as changed
  */
 void clear_screens() {
     /* Write to all four planes at once. */
     SET_WRITE_MASK(0x0F00);
 
     /* Set 64kB to zero(times four planes = 256kB). */
-    memset(mem_image, 0, MODE_X_MEM_SIZE);
+    vga_fill(0, 0, MODE_X_MEM_SIZE);
+
+    /* Nothing in video memory matches the build buffer any longer. */
+    mark_rows_dirty(0, SCROLL_Y_DIM);
+    status_shown_ok = 0;
+    canvas_ok = canvas_shown = 0;
 }
 
 
+/*
+ * show_canvas
+ *     DESCRIPTION: Show the logical view window on the video display by
+ *                  panning over the canvas in video memory.  If the canvas
+ *                  holds pixels of the window shown last, and the new
+ *                  window lies within the canvas and has moved by no more
+ *                  than PAN_MAX_STEP bytes horizontally, only the pixels
+ *                  that were not in the old window are copied, all of which
+ *                  go to bytes that are not displayed; the CRTC start
+ *                  address and the horizontal pel panning register then
+ *                  move the display to the new window.  Otherwise, the
+ *                  whole window is copied to a part of the canvas that
+ *                  does not overlap the displayed window.
+ *     INPUTS: none
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: copies from the build buffer to video memory; changes
+ *                   the VGA display start address and pel panning
+ */
+static void show_canvas() {
+    unsigned char* ring;   /* build buffer plane copied                     */
+    int start;             /* video memory address of new window            */
+    int old_start;         /* ... and of the window displayed now           */
+    int gap;               /* size of space below the displayed window      */
+    int old_col, new_col;  /* first logical byte column of plane in windows */
+    int from, to;          /* logical byte columns copied                   */
+    int y;                 /* loop index over logical rows                  */
+    int i;                 /* loop index over video planes                  */
+
+    /* Leave the display alone if it already shows the view window. */
+    if (canvas_ok && pan_x == show_x && pan_y == show_y) {
+        stats.frames_skipped++;
+        return;
+    }
+
+    /* Check whether the canvas can be panned to the new window. */
+    if (canvas_ok) {
+        start = canvas_org + (show_x >> 2) + show_y * CANVAS_WIDTH;
+        if ((show_x >> 2) - (pan_x >> 2) > PAN_MAX_STEP ||
+            (pan_x >> 2) - (show_x >> 2) > PAN_MAX_STEP ||
+            start < CANVAS_START || start + CANVAS_SPAN > MODE_X_MEM_SIZE)
+            canvas_ok = 0;
+    }
+
+    /*
+     * If not, center the new window in the larger space on either side
+     * of the displayed one(or in the whole canvas), and copy all of it.
+     */
+    if (!canvas_ok) {
+        if (canvas_shown) {
+            old_start = canvas_org + (pan_x >> 2) + pan_y * CANVAS_WIDTH;
+            gap = old_start - CANVAS_START;
+            if (gap > MODE_X_MEM_SIZE - old_start - CANVAS_SPAN)
+                start = CANVAS_START + (gap - CANVAS_SPAN) / 2;
+            else
+                start = old_start + CANVAS_SPAN + (MODE_X_MEM_SIZE - old_start - 2 * CANVAS_SPAN) / 2;
+        }
+        else {
+            start = CANVAS_START + (MODE_X_MEM_SIZE - CANVAS_START - CANVAS_SPAN) / 2;
+        }
+        canvas_org = start - (show_x >> 2) - show_y * CANVAS_WIDTH;
+        stats.canvas_moves++;
+    }
+
+    /*
+     * Copy each plane.  The bytes of video plane i in a window start at
+     * the first pixel of the window in that plane, which is stored at
+     * plane offset 3 - i in the build buffer.
+     */
+    for (i = 0; i < 4; i++) {
+        SET_WRITE_MASK(1 << (i + 8));
+        ring = BUILD_PLANE(3 - i);
+        new_col = (show_x + ((i - show_x) & 3)) >> 2;
+        old_col = (pan_x + ((i - pan_x) & 3)) >> 2;
+        for (y = show_y; y < show_y + SCROLL_Y_DIM; y++) {
+            from = new_col;
+            to = new_col + SCROLL_X_WIDTH;
+            if (canvas_ok && y >= pan_y && y < pan_y + SCROLL_Y_DIM) {
+                /* Copy only the pixels of the row not in the old window. */
+                if (new_col > old_col)
+                    from = (old_col + SCROLL_X_WIDTH > from ? old_col + SCROLL_X_WIDTH : from);
+                else
+                    to = (old_col < to ? old_col : to);
+            }
+            if (from < to) {
+                copy_from_ring(ring, from + y * SCROLL_X_WIDTH,
+                               canvas_org + from + y * CANVAS_WIDTH, to - from);
+            }
+        }
+    }
+    y = (pan_y > show_y ? pan_y - show_y : show_y - pan_y);
+    stats.rows_copied += (canvas_ok && y < SCROLL_Y_DIM ? y : SCROLL_Y_DIM);
+
+    /* The canvas now holds the new window. */
+    canvas_ok = canvas_shown = 1;
+    pan_x = show_x;
+    pan_y = show_y;
+
+    /*
+     * Point the display at the new window, and pan it by the pixels
+     * before the window in the first byte(two pel units per pixel in
+     * 256-color modes).  The CRTC latches the start address only at
+     * vertical retrace, whereas a new pan takes effect on the next
+     * scan line, so the start address is written while the display is
+     * enabled(bit 0 of input status 1 clear) and the pan is written
+     * once retrace begins(bit 3 set); otherwise the rest of the frame
+     * would show the new pan with the old start address.
+     */
+    start = canvas_org + (show_x >> 2) + show_y * CANVAS_WIDTH;
+    while (0 != (vga_inb(0x03DA) & 0x01));
+    OUTW(0x03D4, (start & 0xFF00) | 0x0C);
+    OUTW(0x03D4, ((start & 0x00FF) << 8) | 0x0D);
+    while (0 == (vga_inb(0x03DA) & 0x08));
+    set_attr_register(0x13, (show_x & 3) * 2);
+}
+
+
+/*
+ * mark_rows_dirty
+ *     DESCRIPTION: Record that rows of the logical view window have
+ *                  changed in the build buffer, and so must be copied to
+ *                  both screen pages in video memory.
+ *     INPUTS: y -- the first row changed
+ *             count -- number of rows changed
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: updates damage tracking for both pages
+ */
+static void mark_rows_dirty(int y, int count) {
+    int page; /* loop index over screen pages */
+    int i;    /* loop index over rows         */
+
+    for (page = 0; page < 2; page++) {
+        for (i = y; i < y + count; i++) {
+            if (!page_dirty[page][i]) {
+                page_dirty[page][i] = 1;
+                page_dirty_rows[page]++;
+            }
+        }
+    }
+}
+
+
+/*
+ * modex_stats
+ *     DESCRIPTION: Get counters describing the traffic to video memory.
+ *     INPUTS: none
+ *     OUTPUTS: s -- the counters
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: none
+ */
+void modex_stats(modex_stats_t* s) {
+    *s = stats;
+}
+
+
+/*
+ * count_port_write
+ *     DESCRIPTION: Count a write to a VGA port(see modex_stats).  A
+ *                  two-byte write to two consecutive ports counts once,
+ *                  as it takes a single OUT instruction.
+ *     INPUTS: port -- the port written(the first, for two-byte writes)
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: updates the traffic counters
+ */
+static void count_port_write(unsigned short port) {
+    stats.port_writes++;
+    if (port >= 0x03C7 && port <= 0x03C9)
+        stats.palette_writes++;
+    else if (port == 0x03D4 || port == 0x03D5)
+        stats.crtc_writes++;
+}
+
+
+/*
+ * end_frame
+ *     DESCRIPTION: Add the video traffic since the end of the previous
+ *                  frame to the per-frame histograms.
+ *     INPUTS: none
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: updates the histograms
+ */
+static void end_frame() {
+    unsigned long long now[NUM_TRAFFIC]; /* traffic totals so far    */
+    unsigned long long n;                /* traffic in this frame    */
+    int bin;                             /* histogram bin of n       */
+    int i;                               /* loop index over traffic  */
+
+    now[TRAFFIC_VRAM] = stats.vram_bytes;
+    now[TRAFFIC_STATUS_VRAM] = stats.status_bytes;
+    now[TRAFFIC_MASKS] = stats.write_masks;
+    now[TRAFFIC_PALETTE] = stats.palette_writes;
+    now[TRAFFIC_CRTC] = stats.crtc_writes;
+    now[TRAFFIC_PORTS] = stats.port_writes;
+    now[TRAFFIC_STATUS_CALLS] = stats.status_updates;
+    for (i = 0; i < NUM_TRAFFIC; i++) {
+        n = now[i] - traffic_base[i];
+        for (bin = 0; bin < TRAFFIC_BINS - 1 && (n >> bin) != 0; bin++);
+        traffic_hist[i][bin]++;
+        if (n > traffic_max[i])
+            traffic_max[i] = n;
+        traffic_base[i] = now[i];
+    }
+}
+
+
+/*
+ * print_traffic
+ *     DESCRIPTION: Print the video traffic per frame to stderr: for each
+ *                  kind of traffic, the total, the mean, the 50th, 90th,
+ *                  and 99th percentiles(as the upper bounds of their
+ *                  histogram bins, or the maximum if less), and the most
+ *                  in one frame.  If the
+ *                  ADVENTURE_STATS environment variable is "json", print
+ *                  instead one line of JSON holding the totals, maxima,
+ *                  and histogram bins(see traffic_hist).
+ *     INPUTS: none
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: none
+ */
+static void print_traffic() {
+    static const int pct[3] = {50, 90, 99}; /* percentiles printed       */
+    unsigned int frames;                    /* frames in the histograms  */
+    unsigned int seen;                      /* frames in bins so far     */
+    unsigned long long bound;               /* upper bound of a bin      */
+    int json;                               /* print JSON                */
+    int bin;                                /* loop index over bins      */
+    int i;                                  /* loop index over traffic   */
+    int k;                                  /* loop index over pct       */
+
+    for (frames = 0, bin = 0; bin < TRAFFIC_BINS; bin++)
+        frames += traffic_hist[0][bin];
+    json = (0 == strcmp(getenv("ADVENTURE_STATS"), "json"));
+
+    if (json) {
+        fprintf(stderr, "{\"video_traffic\":{\"frames\":%u", frames);
+        for (i = 0; i < NUM_TRAFFIC; i++) {
+            fprintf(stderr, ",\"%s\":{\"total\":%llu,\"max\":%llu,\"hist\":[",
+                    traffic_name[i], traffic_base[i], traffic_max[i]);
+            for (bin = 0; bin < TRAFFIC_BINS; bin++)
+                fprintf(stderr, "%s%u", (bin ? "," : ""), traffic_hist[i][bin]);
+            fprintf(stderr, "]}");
+        }
+        fprintf(stderr, "}}\n");
+        return;
+    }
+
+    fprintf(stderr, "video traffic per frame(%u frames):\n", frames);
+    for (i = 0; i < NUM_TRAFFIC; i++) {
+        fprintf(stderr, "  %-16s total %llu, mean %llu", traffic_name[i],
+                traffic_base[i], traffic_base[i] / (frames ? frames : 1));
+        for (k = 0, seen = 0, bin = 0; k < 3; k++) {
+            while (bin < TRAFFIC_BINS - 1 &&
+                   (unsigned long long)(seen + traffic_hist[i][bin]) * 100 <
+                   (unsigned long long)frames * pct[k])
+                seen += traffic_hist[i][bin++];
+            bound = (bin ? (1ULL << bin) - 1 : 0);
+            fprintf(stderr, ", p%d %llu", pct[k], (bound < traffic_max[i] ? bound : traffic_max[i]));
+        }
+        fprintf(stderr, ", max %llu\n", traffic_max[i]);
+    }
+}
+
 
 /*
  * add_status_bar
  *   DESCRIPTION: Add the components (converted text-graph) to the allocated status bar area.
+ *                Only the rows of the status bar that differ from those in
+ *                video memory are written.
  *   INPUTS: Input flag (4 types) and the input message.
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: copies from the build buffer to video memory;
- *                 shifts the VGA display source to point to the new image
+ *   SIDE EFFECTS: copies the status bar image to video memory
  */ 
- /* buffer is used to hold the text-graph */ 
-extern unsigned char buffer[STATUS_BAR_SIZE];
 void add_status_bar(char input_type, const char* input_message) {
-	int i;
+	unsigned char* plane;	/* one plane of the status bar image    */
+	unsigned char* shown;	/* the same plane in video memory        */
+	int i;			/* loop index over planes                */
+	int y;			/* offset of first row of a changed run  */
+	int end;		/* offset of row after the run           */
+	int k;			/* loop index over rows of the run       */
+	int changed = 0;	/* set once any row has been written     */
 	
+	TRACE_BEGIN("add_status_bar");
 	text_to_graphics(input_type, input_message);
+	stats.status_updates++;
 	
 	for(i = 0; i < 4; i++) {
-		SET_WRITE_MASK (1 << (i + TEXT_PIXEL_WIDTH));
-		copy_status_bar (buffer + (i * STATUS_BAR_SIZE / 4), 0x0000);
+		plane = buffer + (i * STATUS_BAR_SIZE / 4);
+		shown = status_shown + (i * STATUS_BAR_SIZE / 4);
+		for (y = 0; y < STATUS_BAR_SIZE / 4; y = end + IMAGE_X_WIDTH) {
+			for (end = y; end < STATUS_BAR_SIZE / 4 && (!status_shown_ok ||
+			     0 != memcmp(plane + end, shown + end, IMAGE_X_WIDTH)); end += IMAGE_X_WIDTH);
+			if (end > y) {
+				SET_WRITE_MASK (1 << (i + TEXT_PIXEL_WIDTH));
+				stats.status_bytes += end - y;
+				if (status_width == IMAGE_X_WIDTH) {
+					copy_image (plane + y, y, end - y);
+				}
+				else {
+					/* rows are farther apart with panning */
+					for (k = y; k < end; k += IMAGE_X_WIDTH) {
+						copy_image (plane + k, k / IMAGE_X_WIDTH * status_width, IMAGE_X_WIDTH);
+					}
+				}
+				memcpy(shown + y, plane + y, end - y);
+				changed = 1;
+			}
+		}
 	}
+	status_shown_ok = 1;
+	if (!changed)
+		stats.status_skipped++;
+	TRACE_END("add_status_bar");
 	return;
 }
 
@@ -581,134 +947,225 @@ void add_status_bar(char input_type, const char* input_message) {
 
 
 /*
- * draw_vert_line
- *     DESCRIPTION: Draw a vertical map line into the build buffer. The
- *                  line should be offset from the left side of the logical
- *                  view window screen by the given number of pixels.
- *     INPUTS: x -- the 0-based pixel column number of the line to be drawn
- *                  within the logical view window (equivalent to the number
- *                  of pixels from the leftmost pixel to the line to be
- *                  drawn)
+ * note_drawn
+ *     DESCRIPTION: Record that a rectangle of the logical view window has
+ *                  been drawn in the build buffer.  Drawing any pixel of
+ *                  the window held by the canvas means that the canvas no
+ *                  longer matches the build buffer.
+ *     INPUTS: (x,y) -- upper left pixel drawn, relative to the window
+ *             width -- number of columns drawn
+ *             height -- number of rows drawn
  *     OUTPUTS: none
- *     RETURN VALUE: Returns 0 on success. If x is outside of the valid
- *                   SCROLL range, the function returns -1.
- *     SIDE EFFECTS: draws into the build buffer
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: updates damage tracking
  */
-int draw_vert_line(int x) {
-    /* to be written... */
-	unsigned char buf[SCROLL_Y_DIM];
-	unsigned char* addr;
-	int p_off;
-	int i;
-	
-	if (x < 0 || x >= SCROLL_X_DIM)
-	return -1;
-
-	x += show_x;
-	(*vert_line_fn)(x, show_y, buf);
-	
-	addr = img3 + (x >> 2) + show_y * SCROLL_X_WIDTH;
-	p_off = (3 - (x & 3));
-	
-	
-	/* Copy image data into appropriate planes in build buffer. */
-    for (i = 0; i < SCROLL_Y_DIM; i++) {
-        addr[p_off * SCROLL_SIZE] = buf[i];
-        addr += SCROLL_X_WIDTH;
-    }
+static void note_drawn(int x, int y, int width, int height) {
+    mark_rows_dirty(y, height);
 
-    /* Return success. */
-    return 0;
+    x += show_x;
+    y += show_y;
+    if (x < pan_x + SCROLL_X_DIM && x + width > pan_x &&
+        y < pan_y + SCROLL_Y_DIM && y + height > pan_y)
+        canvas_ok = 0;
 }
 
 
 /*
- * draw_horiz_line
- *     DESCRIPTION: Draw a horizontal map line into the build buffer. The
- *                  line should be offset from the top of the logical view
- *                  window screen by the given number of pixels.
- *     INPUTS: y -- the 0-based pixel row number of the line to be drawn
- *                  within the logical view window (equivalent to the number
- *                  of pixels from the top pixel to the line to be drawn)
+ * unwrap_guard
+ *     DESCRIPTION: Move the pixels just drawn into a build buffer plane
+ *                  that fell past the end of its ring(into the ring guard)
+ *                  to the corresponding addresses at the start of the ring.
+ *     INPUTS: ring -- the build buffer plane
+ *             off -- offset of the first byte drawn within the ring
+ *             len -- number of contiguous bytes drawn
  *     OUTPUTS: none
- *     RETURN VALUE: Returns 0 on success. If y is outside of the valid
- *                   SCROLL range, the function returns -1.
- *     SIDE EFFECTS: draws into the build buffer
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: copies within the build buffer
  */
-int draw_horiz_line(int y) {
-    unsigned char buf[SCROLL_X_DIM]; /* buffer for graphical image of line                            */
-    unsigned char* addr;             /* address of first pixel in build buffer (without plane offset) */
-    int p_off;                       /* offset of plane of first pixel                                */
-    int i;                           /* loop index over pixels                                        */
+static void unwrap_guard(unsigned char* ring, int off, int len) {
+    int start;  /* first byte past the end of the ring */
 
-    /* Check whether requested line falls in the logical view window. */
-    if (y < 0 || y >= SCROLL_Y_DIM)
-    return -1;
+    if (off + len <= RING_SIZE)
+        return;
+    start = (off > RING_SIZE ? off : RING_SIZE);
+    memcpy(ring + start - RING_SIZE, ring + start, off + len - start);
+}
 
-    /* Adjust y to the logical row value. */
-    y += show_y;
 
-    /* Get the image of the line. */
-    (*horiz_line_fn)(show_x, y, buf);
+/*
+ * draw_vert_lines
+ *     DESCRIPTION: Draw a block of consecutive vertical map lines into the
+ *                  build buffer. The first line should be offset from the
+ *                  left side of the logical view window screen by the
+ *                  given number of pixels.  The images of all of the lines
+ *                  are obtained with a single call to the callback given
+ *                  to set_mode_X.
+ *     INPUTS: x -- the 0-based pixel column number of the first line to be
+ *                  drawn within the logical view window (equivalent to the
+ *                  number of pixels from the leftmost pixel to the line to
+ *                  be drawn)
+ *             count -- number of lines to be drawn
+ *     OUTPUTS: none
+ *     RETURN VALUE: Returns 0 on success. If any of the lines is outside of
+ *                   the valid SCROLL range, the function returns -1.
+ *     SIDE EFFECTS: draws into the build buffer
+ */
+int draw_vert_lines(int x, int count) {
+    unsigned char* ring;  /* build buffer plane of first line in a plane */
+    int off;              /* offset of first line within ring            */
+    int width;            /* number of lines drawn into a plane          */
+    int rows;             /* number of rows starting within the ring     */
+    int k;                /* loop index over first lines in each plane   */
+
+    /* Check whether requested lines fall in the logical view window. */
+    if (x < 0 || count < 0 || x + count > SCROLL_X_DIM)
+        return -1;
+    if (count == 0)
+        return 0;
+
+    TRACE_BEGIN("draw_vert_lines");
 
-    /* Calculate starting address in build buffer. */
-    addr = img3 + (show_x >> 2) + y * SCROLL_X_WIDTH;
+    /* Record the changed columns. */
+    note_drawn(x, 0, count, SCROLL_Y_DIM);
 
-    /* Calculate plane offset of first pixel. */
-    p_off = (3 - (show_x & 3));
+    /* Adjust x to the logical column value and get the line images. */
+    x += show_x;
+    (*vert_line_fn)(x, show_y, count, lines);
 
-    /* Copy image data into appropriate planes in build buffer. */
-    for (i = 0; i < SCROLL_X_DIM; i++) {
-        addr[p_off * SCROLL_SIZE] = buf[i];
-        if (--p_off < 0) {
-            p_off = 3;
-            addr++;
-        }
+    /*
+     * Copy the line images into the build buffer planes.  Pixel x lies in
+     * plane x & 3, which is stored at plane offset 3 - (x & 3), so lines
+     * k, k + 4, k + 8, ... fill adjacent addresses of one plane, and are
+     * written together as the rows of that plane.  Rows that start past
+     * the end of the ring are written at the start of the ring instead,
+     * so only a row that straddles the end needs to be unwrapped.
+     */
+    for (k = 0; k < 4 && k < count; k++, x++) {
+        ring = BUILD_PLANE(3 - (x & 3));
+        off = BUILD_OFF(x, show_y);
+        width = (count - k + 3) / 4;
+        rows = (RING_SIZE - off + SCROLL_X_WIDTH - 1) / SCROLL_X_WIDTH;
+        if (rows > SCROLL_Y_DIM)
+            rows = SCROLL_Y_DIM;
+        simd_transpose(ring + off, SCROLL_X_WIDTH, lines + k * SCROLL_Y_DIM, 4 * SCROLL_Y_DIM,
+                       width, rows);
+        unwrap_guard(ring, off + (rows - 1) * SCROLL_X_WIDTH, width);
+        if (rows < SCROLL_Y_DIM)
+            simd_transpose(ring + off + rows * SCROLL_X_WIDTH - RING_SIZE, SCROLL_X_WIDTH,
+                           lines + k * SCROLL_Y_DIM + rows, 4 * SCROLL_Y_DIM,
+                           width, SCROLL_Y_DIM - rows);
     }
+    TRACE_END("draw_vert_lines");
 
     /* Return success. */
     return 0;
 }
 
-#endif /* !defined(TEXT_RESTORE_PROGRAM) */
 
 /*
- * open_memory_and_ports
- *     DESCRIPTION: Map video memory into our address space; obtain permission
- *                  to access VGA ports.
- *     INPUTS: none
+ * draw_vert_line
+ *     DESCRIPTION: Draw a vertical map line into the build buffer(see
+ *                  draw_vert_lines).
+ *     INPUTS: x -- the 0-based pixel column number of the line to be drawn
+ *                  within the logical view window
  *     OUTPUTS: none
- *     RETURN VALUE: 0 on success, -1 on failure
- *     SIDE EFFECTS: prints an error message to stdout on failure
+ *     RETURN VALUE: Returns 0 on success. If x is outside of the valid
+ *                   SCROLL range, the function returns -1.
+ *     SIDE EFFECTS: draws into the build buffer
  */
-static int open_memory_and_ports() {
-    int mem_fd;    /* file descriptor for physical memory image */
+int draw_vert_line(int x) {
+    return draw_vert_lines(x, 1);
+}
 
-    /* Obtain permission to access ports 0x03C0 through 0x03DA. */
-    if (ioperm(0x03C0, 0x03DA - 0x03C0 + 1, 1) == -1) {
-        perror("set port permissions");
-        return -1;
-    }
 
-    /* Open file to access physical memory. */
-    if ((mem_fd = open("/dev/mem", O_RDWR)) == -1) {
-        perror("open /dev/mem");
+/*
+ * draw_horiz_lines
+ *     DESCRIPTION: Draw a block of consecutive horizontal map lines into
+ *                  the build buffer. The first line should be offset from
+ *                  the top of the logical view window screen by the given
+ *                  number of pixels.  The images of all of the lines are
+ *                  obtained with a single call to a callback.
+ *     INPUTS: y -- the 0-based pixel row number of the first line to be
+ *                  drawn within the logical view window (equivalent to the
+ *                  number of pixels from the top pixel to the line to be
+ *                  drawn)
+ *             count -- number of lines to be drawn
+ *     OUTPUTS: none
+ *     RETURN VALUE: Returns 0 on success. If any of the lines is outside of
+ *                   the valid SCROLL range, the function returns -1.
+ *     SIDE EFFECTS: draws into the build buffer
+ */
+int draw_horiz_lines(int y, int count) {
+    int k;                           /* loop index over lines                                         */
+    int i;                           /* loop index over planes                                        */
+    unsigned char* rings[4];         /* build buffer planes of first four pixels                      */
+    int offs[4];                     /* offsets of first four pixels within their rings               */
+    unsigned char* planes[4];        /* build buffer addresses of first four pixels                   */
+
+    /* Check whether requested lines fall in the logical view window. */
+    if (y < 0 || count < 0 || y + count > SCROLL_Y_DIM)
         return -1;
+    if (count == 0)
+        return 0;
+
+    TRACE_BEGIN("draw_horiz_lines");
+
+    /* Record the changed rows, then adjust y to the logical row value. */
+    note_drawn(0, y, SCROLL_X_DIM, count);
+    y += show_y;
+
+    /*
+     * Pixel show_x + i lies in plane(show_x + i) & 3, which is stored at
+     * plane offset 3 - ((show_x + i) & 3) in the build buffer.  If
+     * possible, draw the lines straight into the four planes.
+     */
+    for (i = 0; i < 4; i++) {
+        rings[i] = BUILD_PLANE(3 - ((show_x + i) & 3));
+        offs[i] = BUILD_OFF(show_x + i, y);
+        planes[i] = rings[i] + offs[i];
+    }
+    if (NULL == horiz_planes_fn || 0 != (*horiz_planes_fn)(show_x, y, count, planes)) {
+        /*
+         * Otherwise get the images of the lines and split each one among
+         * the planes: pixel show_x + 4j + i goes to planes[i][j].
+         */
+        (*horiz_line_fn)(show_x, y, count, lines);
+        for (k = 0; k < count; k++) {
+            simd_deinterleave(planes, lines + k * SCROLL_X_DIM, SCROLL_X_DIM);
+            for (i = 0; i < 4; i++) {
+                planes[i] += SCROLL_X_WIDTH;
+            }
+        }
     }
 
-    /* Map video memory(0xA0000 - 0xBFFFF) into our address space. */
-    if ((mem_image = mmap(0, VID_MEM_SIZE, PROT_READ | PROT_WRITE,
-                          MAP_SHARED, mem_fd, 0xA0000)) == MAP_FAILED) {
-        perror("mmap video memory");
-        return -1;
+    /* Move any pixels drawn past the ends of the rings to their starts. */
+    for (i = 0; i < 4; i++) {
+        unwrap_guard(rings[i], offs[i], count * SCROLL_X_WIDTH);
     }
+    TRACE_END("draw_horiz_lines");
 
-    /* Close /dev/mem file descriptor and return success. */
-    (void)close(mem_fd);
+    /* Return success. */
     return 0;
 }
 
 
+/*
+ * draw_horiz_line
+ *     DESCRIPTION: Draw a horizontal map line into the build buffer(see
+ *                  draw_horiz_lines).
+ *     INPUTS: y -- the 0-based pixel row number of the line to be drawn
+ *                  within the logical view window
+ *     OUTPUTS: none
+ *     RETURN VALUE: Returns 0 on success. If y is outside of the valid
+ *                   SCROLL range, the function returns -1.
+ *     SIDE EFFECTS: draws into the build buffer
+ */
+int draw_horiz_line(int y) {
+    return draw_horiz_lines(y, 1);
+}
+
+#endif /* !defined(TEXT_RESTORE_PROGRAM) */
+
 /*
  * VGA_blank
  *     DESCRIPTION: Blank or unblank the VGA display.
@@ -724,25 +1181,13 @@ static void VGA_blank(int blank_bit) {
      */
     blank_bit = ((blank_bit & 1) << 5);
 
-    asm volatile("                                                      \n\
-        movb $0x01, %%al        /* Set sequencer index to 1 */          \n\
-        movw $0x03C4, %%dx                                              \n\
-        outb %%al, (%%dx)                                               \n\
-        incw %%dx                                                       \n\
-        inb (%%dx), %%al        /* Read old value */                    \n\
-        andb $0xDF, %%al        /* Calculate new value */               \n\
-        orl %0,%%eax                                                    \n\
-        outb %%al, (%%dx)       /* Write new value */                   \n\
-        movw $0x03DA, %%dx      /* Enable display(0x20->P[0x3C0]) */    \n\
-        inb (%%dx), %%al        /* Set attr reg state to index */       \n\
-        movw $0x03C0, %%dx      /* Write index 0x20 to enable */        \n\
-        movb $0x20, %%al                                                \n\
-        outb %%al, (%%dx)                                               \n\
-        "
-        :
-        : "g"(blank_bit)
-        : "eax", "edx", "memory"
-    );
+    /* Set the blanking bit in sequencer register 1. */
+    OUTB(0x03C4, 0x01);
+    OUTB(0x03C5, (vga_inb(0x03C5) & 0xDF) | blank_bit);
+
+    /* Enable display(0x20->P[0x3C0]) after setting attr reg state to index. */
+    (void)vga_inb(0x03DA);
+    OUTB(0x03C0, 0x20);
 }
 
 
@@ -803,17 +1248,29 @@ static void set_CRTC_registers(unsigned short table[NUM_CRTC_REGS]) {
  */
 static void set_attr_registers(unsigned char table[NUM_ATTR_REGS * 2]) {
     /* Reset attribute register to write index next rather than data. */
-    asm volatile("          \n\
-        inb (%%dx), %%al    \n\
-        "
-        :
-        : "d"(0x03DA)
-        : "eax", "memory"
-    );
+    (void)vga_inb(0x03DA);
     REP_OUTSB(0x03C0, table, NUM_ATTR_REGS * 2);
 }
 
 
+/*
+ * set_attr_register
+ *     DESCRIPTION: Set one VGA attribute controller register, leaving the
+ *                  display enabled.
+ *     INPUTS: index -- the register index
+ *             val -- the new value
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: resets the attribute controller address flip-flop
+ */
+static void set_attr_register(unsigned char index, unsigned char val) {
+    /* Reset attribute register to write index next rather than data. */
+    (void)vga_inb(0x03DA);
+    OUTB(0x03C0, index | 0x20);
+    OUTB(0x03C0, val);
+}
+
+
 /*
  * set_graphics_registers
  *     DESCRIPTION: Set VGA graphics registers.
@@ -947,9 +1404,7 @@ static void fill_palette_text() {
  *     SIDE EFFECTS: leaves VGA registers in final text mode state
  */
 static void write_font_data() {
-    int i;                /* loop index over characters                   */
-    int j;                /* loop index over font bytes within characters */
-    unsigned char* fonts; /* pointer into video memory                    */
+    int i;                /* loop index over characters */
 
     /* Prepare VGA to write font data into video memory. */
     OUTW(0x3C4, 0x0402);
@@ -959,11 +1414,8 @@ static void write_font_data() {
     OUTW(0x3CE, 0x0204);
 
     /* Copy font data from array into video memory. */
-    for (i = 0, fonts = mem_image; i < 256; i++) {
-        for (j = 0; j < 16; j++) {
-            fonts[j] = font_data[i][j];
-        }
-        fonts += 32; /* skip 16 bytes between characters */
+    for (i = 0; i < 256; i++) {
+        vga_write(i * 32, font_data[i], 16); /* skip 16 bytes between */
     }
 
     /* Prepare VGA for text mode. */
@@ -984,8 +1436,8 @@ static void write_font_data() {
  *     SIDE EFFECTS: may clear screens; writes font data to video memory
  */
 static void set_text_mode_3(int clear_scr) {
-    unsigned long* txt_scr; /* pointer to text screens in video memory */
-    int i;                  /* loop over text screen words             */
+    uint32_t txt_row[64];   /* blank text(0x0720 words) to write      */
+    int i;                  /* loop over text screen words and writes */
 
     VGA_blank(1);           /* blank the screen */
 
@@ -1000,9 +1452,11 @@ static void set_text_mode_3(int clear_scr) {
     set_graphics_registers(text_graphics);   /* graphics registers      */
     fill_palette_text();                     /* palette colors          */
     if (clear_scr) {                         /* clear screens if needed */
-        txt_scr = (unsigned long*)(mem_image + 0x18000);
-        for (i = 0; i < 8192; i++) {
-            *txt_scr++ = 0x07200720;
+        for (i = 0; i < 64; i++) {
+            txt_row[i] = 0x07200720;
+        }
+        for (i = 0; i < 8192 * 4; i += sizeof (txt_row)) {
+            vga_write(0x18000 + i, txt_row, sizeof (txt_row));
         }
     }
     write_font_data();   /* copy fonts to video mem */
@@ -1012,55 +1466,43 @@ static void set_text_mode_3(int clear_scr) {
 
 /*
  * copy_image
- *     DESCRIPTION: Copy one plane of a screen from the build buffer to the video memory.
- *     INPUTS: img -- a pointer to a single screen plane in the build buffer
+ *     DESCRIPTION: Copy bytes of one plane of an image(a screen from the
+ *                  build buffer, or the status bar) to the video memory.
+ *     INPUTS: img -- a pointer to the bytes to copy
  *             scr_addr -- the destination offset in video memory
+ *             len -- number of bytes to copy
  *     OUTPUTS: none
  *     RETURN VALUE: none
- *     SIDE EFFECTS: copies a plane from the build buffer to video memory
+ *     SIDE EFFECTS: copies to video memory; counts the bytes copied
  */
-static void copy_image(unsigned char* img, unsigned short scr_addr) {
-    /*
-     * memcpy is actually probably good enough here, and is usually
-     * implemented using ISA-specific features like those below,
-     * but the code here provides an example of x86 string moves
-     */
-    asm volatile("                                                  \n\
-        cld                                                         \n\
-        movl $16000, %%ecx                                          \n\
-        rep movsb        /* copy ECX bytes from M[ESI] to M[EDI] */ \n\
-        "
-        : /* no outputs */
-        : "S"(img), "D"(mem_image + scr_addr)
-        : "eax", "ecx", "memory"
-    );
+static void copy_image(unsigned char* img, unsigned short scr_addr, int len) {
+    stats.vram_bytes += len;
+    vga_write(scr_addr, img, len);
 }
 
+
 /*
- * copy_status_bar
- *     DESCRIPTION: Copy one plane of a screen from the build buffer to the video memory.
- *					reused from copy_image besides that the size is 5760 / 4 instead of 16000
- *     INPUTS: img -- a pointer to a single screen plane in the build buffer
+ * copy_from_ring
+ *     DESCRIPTION: Copy bytes of one plane of the screen from a build
+ *                  buffer plane ring to the video memory, in two parts if
+ *                  they wrap past the end of the ring.
+ *     INPUTS: ring -- the build buffer plane
+ *             off -- offset of the first byte within the ring(taken
+ *                    modulo RING_SIZE)
  *             scr_addr -- the destination offset in video memory
+ *             len -- number of bytes to copy
  *     OUTPUTS: none
  *     RETURN VALUE: none
- *     SIDE EFFECTS: copies a plane from the build buffer to video memory
+ *     SIDE EFFECTS: copies from the build buffer to video memory
  */
-static void copy_status_bar (unsigned char* img, unsigned short scr_addr) {
-    /*
-     * memcpy is actually probably good enough here, and is usually
-     * implemented using ISA-specific features like those below,
-     * but the code here provides an example of x86 string moves
-     */
-    asm volatile("                                                  \n\
-        cld                                                         \n\
-        movl $1440, %%ecx                                          \n\
-        rep movsb        /* copy ECX bytes from M[ESI] to M[EDI] */ \n\
-        "
-        : /* no outputs */
-        : "S"(img), "D"(mem_image + scr_addr)
-        : "eax", "ecx", "memory"
-    );
+static void copy_from_ring(unsigned char* ring, int off, unsigned short scr_addr, int len) {
+    int first;  /* bytes copied before the end of the ring */
+
+    off &= RING_SIZE - 1;
+    first = (RING_SIZE - off < len ? RING_SIZE - off : len);
+    copy_image(ring + off, scr_addr, first);
+    if (first < len)
+        copy_image(ring, scr_addr + first, len - first);
 }
 
 
@@ -1077,15 +1519,15 @@ static void copy_status_bar (unsigned char* img, unsigned short scr_addr) {
  *     RETURN VALUE: 0 on success, 3 in panic scenarios
  */
 int main() {
-    /* Map video memory and obtain permission for VGA port access. */
-    if (open_memory_and_ports() == -1)
+    /* Open the VGA(or its model; see vga.h). */
+    if (vga_open() == -1)
         return 3;
 
     /* Put VGA into text mode without clearing the screen. */
     set_text_mode_3(0);
 
-    /* Unmap video memory. */
-    (void)munmap(mem_image, VID_MEM_SIZE);
+    /* Release video memory. */
+    vga_close();
 
     /* Return success. */
     return 0;
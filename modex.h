@@ -70,7 +70,7 @@
  * the buffer holding the status bar
  * size is 320 * 18 = 5760
  */
-unsigned char buffer[STATUS_BAR_SIZE];
+extern unsigned char buffer[STATUS_BAR_SIZE];
 
 /*
  * NOTES
@@ -121,13 +121,32 @@ unsigned char buffer[STATUS_BAR_SIZE];
  * within a logical space defined by the program. For example, if this
  * window shifts one pixel to the left, only the left border of the screen
  * is drawn. Other data are left untouched in most cases.
+ *
+ * Optionally(with ADVENTURE_PAN set), the screen is instead shown from a
+ * single canvas in video memory that is larger than the screen, and the
+ * viewing window is moved with the CRTC start address and horizontal pel
+ * panning registers. Only the newly exposed border is then copied to
+ * video memory when the window shifts. The status bar remains fixed at
+ * the start of video memory through the line compare(split screen)
+ * register.
  */
 
 /* configure VGA for mode X; initializes logical view to (0, 0) */
-extern int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
-                      void(*vert_fill_fn)(int, int, unsigned char[SCROLL_Y_DIM]));
+extern int set_mode_X(void(*horiz_fill_fn)(int, int, int, unsigned char*),
+                      void(*vert_fill_fn)(int, int, int, unsigned char*));
+
+/*
+ * optionally draw horizontal lines directly into the build buffer planes
+ * (pointers to pixels x to x + 3 of the first line; each plane holds
+ * every fourth pixel, and lines are SCROLL_X_WIDTH bytes apart)
+ */
+extern void set_horiz_planes_fn(int(*planes_fn)(int, int, int, unsigned char*[4]));
 
-/* return to text mode */
+/*
+ * return to text mode; if the ADVENTURE_STATS environment variable is
+ * set, also print histograms of the video traffic per frame(as one line
+ * of JSON if it is set to "json")
+ */
 extern void clear_mode_X();
 
 /* set logical view window coordinates */
@@ -147,9 +166,35 @@ extern void clear_screens();
 /* draw a horizontal line at vertical pixel y within the logical view window */
 extern int draw_horiz_line(int y);
 
+/* draw count horizontal lines starting at vertical pixel y */
+extern int draw_horiz_lines(int y, int count);
+
 /* draw a vertical line at horizontal pixel x within the logical view window */
 extern int draw_vert_line(int x);
 
+/* draw count vertical lines starting at horizontal pixel x */
+extern int draw_vert_lines(int x, int count);
+
+/* counters describing traffic to video memory(see modex_stats) */
+typedef struct modex_stats_t modex_stats_t;
+struct modex_stats_t {
+    unsigned int frames;             /* calls to show_screen              */
+    unsigned int frames_skipped;     /* ... with the display up to date   */
+    unsigned long long rows_copied;  /* scrolling region rows copied      */
+    unsigned int canvas_moves;       /* windows copied whole(panning)     */
+    unsigned int status_updates;     /* calls to add_status_bar           */
+    unsigned int status_skipped;     /* ... that left video memory alone  */
+    unsigned long long vram_bytes;   /* bytes copied to video memory      */
+    unsigned long long status_bytes; /* ... of them for the status bar    */
+    unsigned long long write_masks;  /* sequencer map mask writes         */
+    unsigned long long palette_writes; /* writes to DAC palette ports     */
+    unsigned long long crtc_writes;  /* writes to CRTC ports              */
+    unsigned long long port_writes;  /* writes to all VGA ports           */
+};
+
+/* get counters describing traffic to video memory */
+extern void modex_stats(modex_stats_t* stats);
+
 /* fill the remaining 192 palette colors by calling octree processing in photo.c */
 extern void fill_my_palette(unsigned char my_palette[192][3]);
 
@@ -0,0 +1,687 @@
+/* tab:4
+ *
+ * mp2bench.c - benchmark program for the adventure game's drawing and
+ *              photo kernels
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      mp2bench.c
+ */
+
+
+/*
+ * This file is a standalone benchmark program(run by "make bench" from
+ * the game's directory, so that the images can be found).  Each
+ * benchmark is named; with no arguments all of them are run, otherwise
+ * only those named on the command line.  Every measurement is the best
+ * of BENCH_TRIALS runs, since other activity on the machine only ever
+ * makes a run slower.  The program is built with the game's CFLAGS, so
+ * it measures the code as the game runs it.
+ *
+ *   startup  -- time to read every room photo with the photo cache
+ *               disabled, with an empty cache(cold), and with a full
+ *               cache(warm)
+ *   quantize -- time to read and quantize each room photo, with the
+ *               palette mapped by octree node and by lookup table
+ *   kernels  -- pixels per second for the histogram and remap kernels
+ *               in each kernel version
+ *   lines    -- CPU cycles per line for simd_deinterleave and
+ *               simd_transpose in each kernel version, called as the
+ *               mode X code calls them(nanoseconds where the time stamp
+ *               counter cannot be read)
+ *   draw     -- time per call of the line fill functions used by the
+ *               mode X code, averaged over the rooms
+ *   objects  -- the same in a synthetic room holding hundreds of
+ *               objects, and the cost of finding the objects on a row
+ *               through the room's index and by walking its contents
+ *
+ * The world is built first, and the rooms and their photos are found
+ * through it; the synthetic room is filled with room_add_objects.
+ */
+
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define BENCH_UNIT "cycles"
+#else
+#define BENCH_UNIT "ns"
+#endif
+
+#include "modex.h"
+#include "photo.h"
+#include "photo_headers.h"
+#include "simd.h"
+#include "world.h"
+
+
+#define BENCH_TRIALS 5    /* runs of each measurement               */
+#define LINE_REPEAT  2000 /* calls timed in one run                 */
+#define LINE_BATCH   64   /* lines given to each call at most       */
+#define DRAW_CALLS   200  /* fill calls timed in each room           */
+#define MAX_EXTRA    600  /* objects added to the synthetic room     */
+
+
+/* a named benchmark */
+typedef struct bench_t bench_t;
+struct bench_t {
+    const char* name;     /* name given on the command line */
+    void (*run)(void);    /* runs the benchmark             */
+};
+
+
+/* local functions--see function headers for details */
+static void bench_draw(void);
+static double bench_fills(const room_t* r, int32_t calls, double* vert, double* planes);
+static void bench_kernels(void);
+static void bench_lines(void);
+static uint64_t bench_now(void);
+static uint64_t bench_nsec(void);
+static void bench_objects(void);
+static double bench_read_all(void);
+static void bench_quantize(void);
+static void bench_startup(void);
+static void clear_cache_dir(const char* dir);
+
+
+/* file-scope variables */
+static const bench_t benches[] = {
+    { "startup",  bench_startup  },
+    { "quantize", bench_quantize },
+    { "kernels",  bench_kernels  },
+    { "lines",    bench_lines    },
+    { "draw",     bench_draw     },
+    { "objects",  bench_objects  }
+};
+
+/* kernel versions, in the order shown */
+static const char* const versions[] = { "scalar", "sse2", "ssse3", "avx2" };
+
+
+/*
+ * fill_my_palette
+ *   DESCRIPTION: Stand-in for the mode X palette function called by
+ *                prep_room; the benchmarks do not touch the VGA.
+ *   INPUTS: palette -- the room photo's colors
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void fill_my_palette(unsigned char palette[192][3]) {
+}
+
+
+/*
+ * show_status
+ *   DESCRIPTION: Stand-in for the game's status message function, which
+ *                the world code calls.
+ *   INPUTS: s -- the message
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void show_status(const char* s) {
+}
+
+
+/*
+ * bench_now
+ *   DESCRIPTION: Read the clock used for per-line measurements.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: time stamp counter, or CLOCK_MONOTONIC in nanoseconds
+ *                 where the counter cannot be read
+ *   SIDE EFFECTS: none
+ */
+static uint64_t bench_now() {
+#if defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return bench_nsec();
+#endif
+}
+
+
+/*
+ * bench_nsec
+ *   DESCRIPTION: Read the clock used for other measurements.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: CLOCK_MONOTONIC in nanoseconds
+ *   SIDE EFFECTS: none
+ */
+static uint64_t bench_nsec() {
+    struct timespec ts;  /* current time */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/*
+ * clear_cache_dir
+ *   DESCRIPTION: Remove the files in a photo cache directory.
+ *   INPUTS: dir -- the directory
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: removes files
+ */
+static void clear_cache_dir(const char* dir) {
+    DIR*           d;              /* the directory   */
+    struct dirent* e;              /* one entry       */
+    char           path[PATH_MAX]; /* path of a file  */
+
+    if (NULL == (d = opendir(dir))) {
+        return;
+    }
+    while (NULL != (e = readdir(d))) {
+        if ('.' != e->d_name[0] &&
+            (int32_t)sizeof (path) > snprintf(path, sizeof (path), "%s/%s", dir, e->d_name)) {
+            (void)unlink(path);
+        }
+    }
+    (void)closedir(d);
+}
+
+
+/*
+ * bench_read_all
+ *   DESCRIPTION: Read and release every room photo once.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: time taken in milliseconds
+ *   SIDE EFFECTS: may write photo cache files
+ */
+static double bench_read_all() {
+    uint64_t start = bench_nsec(); /* clock at start   */
+    photo_t* p;                    /* photo read       */
+    room_t*  r;                    /* room of photo    */
+    int32_t  i;                    /* index over rooms */
+
+    for (i = 0; NULL != (r = room_by_index(i)); i++) {
+        if (NULL != (p = read_photo(room_photo_file(r)))) {
+            free_photo(p);
+        }
+    }
+    return (bench_nsec() - start) / 1e6;
+}
+
+
+/*
+ * bench_startup
+ *   DESCRIPTION: Measure reading every room photo without the photo
+ *                cache, with an empty cache, and with a full cache.  A
+ *                new cache directory is used and removed afterwards.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets ADVENTURE_PHOTO_CACHE; prints the times
+ */
+static void bench_startup() {
+    char   dir[] = "/tmp/mp2bench.XXXXXX"; /* cache directory        */
+    double best[3];                        /* fastest run of each case */
+    double t;                              /* time of run             */
+    int32_t trial;                         /* index over runs         */
+    int32_t n_rooms;                       /* rooms in the world      */
+
+    if (NULL == mkdtemp(dir)) {
+        perror("mp2bench: mkdtemp");
+        return;
+    }
+    best[0] = best[1] = best[2] = 1e30;
+    for (trial = 0; BENCH_TRIALS > trial; trial++) {
+        (void)setenv("ADVENTURE_PHOTO_CACHE", "", 1);
+        if (best[0] > (t = bench_read_all())) {
+            best[0] = t;
+        }
+        (void)setenv("ADVENTURE_PHOTO_CACHE", dir, 1);
+        clear_cache_dir(dir);
+        if (best[1] > (t = bench_read_all())) {
+            best[1] = t;
+        }
+        if (best[2] > (t = bench_read_all())) {
+            best[2] = t;
+        }
+    }
+    clear_cache_dir(dir);
+    (void)rmdir(dir);
+    for (n_rooms = 0; NULL != room_by_index(n_rooms); n_rooms++);
+    printf("startup: ms to read all %d room photos\n", n_rooms);
+    printf("  no cache %8.2f   cold cache %8.2f   warm cache %8.2f\n", best[0], best[1], best[2]);
+}
+
+
+/*
+ * bench_quantize
+ *   DESCRIPTION: Measure reading and quantizing each room photo(with the
+ *                photo cache disabled), mapping pixels to palette colors
+ *                by octree node and by lookup table.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets ADVENTURE_PHOTO_CACHE and ADVENTURE_PHOTO_LUT;
+ *                 prints the times
+ */
+static void bench_quantize() {
+    photo_header_t hdr;     /* size of photo                */
+    photo_t*       p;       /* photo read                   */
+    double         best[2]; /* fastest run with each mapping */
+    double         total[2] = { 0, 0 }; /* sum over photos  */
+    uint64_t       start;   /* clock at start of run        */
+    double         t;       /* time of run                  */
+    int32_t        lut;     /* mapping by lookup table      */
+    int32_t        trial;   /* index over runs              */
+    room_t*        r;       /* room of photo                */
+    int32_t        i;       /* index over rooms             */
+
+    (void)setenv("ADVENTURE_PHOTO_CACHE", "", 1);
+    printf("quantize: ms to read each room photo(octree mapping, table mapping)\n");
+    for (i = 0; NULL != (r = room_by_index(i)); i++) {
+        if (0 != read_photo_header(room_photo_file(r), &hdr)) {
+            continue;
+        }
+        for (lut = 0; 2 > lut; lut++) {
+            (void)setenv("ADVENTURE_PHOTO_LUT", (lut ? "1" : "0"), 1);
+            best[lut] = 1e30;
+            for (trial = 0; BENCH_TRIALS > trial; trial++) {
+                start = bench_nsec();
+                if (NULL != (p = read_photo(room_photo_file(r)))) {
+                    free_photo(p);
+                }
+                if (best[lut] > (t = (bench_nsec() - start) / 1e6)) {
+                    best[lut] = t;
+                }
+            }
+            total[lut] += best[lut];
+        }
+        printf("  %-28s %4u x %-4u %7.2f %7.2f\n", room_photo_file(r),
+               hdr.width, hdr.height, best[0], best[1]);
+    }
+    (void)unsetenv("ADVENTURE_PHOTO_LUT");
+    printf("  %-40s %7.2f %7.2f\n", "total", total[0], total[1]);
+}
+
+
+/*
+ * bench_kernels
+ *   DESCRIPTION: Measure the histogram and remap kernels of each kernel
+ *                version on the pixels of the largest room photo.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints the rates
+ */
+static void bench_kernels() {
+    static struct octree_node level_4[LEVEL_4_SIZE];          /* histogram   */
+    static uint8_t            palette_of[LEVEL_4_SIZE];       /* octree map  */
+    static uint8_t            lut[PHOTO_LUT_SIZE + SIMD_LUT_PAD]; /* table map */
+    photo_header_t hdr;      /* size of a photo             */
+    const char*    fname = NULL; /* largest room photo      */
+    uint32_t       pixels = 0;   /* pixels in that photo    */
+    uint16_t*      src;      /* its 5:6:5 pixels            */
+    uint8_t*       dst;      /* palette colors              */
+    FILE*          in;       /* photo file                  */
+    uint64_t       start;    /* clock at start of run       */
+    uint64_t       best[3];  /* fastest run of each kernel  */
+    uint64_t       t;        /* time of run                 */
+    uint32_t       v;        /* index over kernel versions  */
+    int32_t        trial;    /* index over runs             */
+    room_t*        r;        /* room of a photo             */
+    int32_t        i;        /* index over rooms and tables */
+    const char*    chosen = simd_kernel_name(); /* version in use */
+
+    for (i = 0; NULL != (r = room_by_index(i)); i++) {
+        if (0 == read_photo_header(room_photo_file(r), &hdr) &&
+            pixels < (uint32_t)hdr.width * hdr.height) {
+            pixels = hdr.width * hdr.height;
+            fname = room_photo_file(r);
+        }
+    }
+    if (NULL == fname || NULL == (src = malloc(pixels * sizeof (src[0]))) ||
+        NULL == (dst = malloc(pixels))) {
+        fputs("mp2bench: no room photo to measure\n", stderr);
+        return;
+    }
+    if (NULL == (in = fopen(fname, "rb")) ||
+        1 != fread(&hdr, sizeof (hdr), 1, in) ||
+        pixels != fread(src, sizeof (src[0]), pixels, in)) {
+        fprintf(stderr, "mp2bench: can't read %s\n", fname);
+        if (NULL != in) {
+            (void)fclose(in);
+        }
+        free(src);
+        free(dst);
+        return;
+    }
+    (void)fclose(in);
+    for (i = 0; LEVEL_4_SIZE > i; i++) {
+        palette_of[i] = rand();
+    }
+    for (i = 0; PHOTO_LUT_SIZE + SIMD_LUT_PAD > i; i++) {
+        lut[i] = rand();
+    }
+
+    printf("kernels: million pixels per second(%s, %u pixels)\n", fname, pixels);
+    for (v = 0; sizeof (versions) / sizeof (versions[0]) > v; v++) {
+        if (0 != simd_use_kernels(versions[v])) {
+            continue;
+        }
+        best[0] = best[1] = best[2] = UINT64_MAX;
+        for (trial = 0; BENCH_TRIALS > trial; trial++) {
+            (void)memset(level_4, 0, sizeof (level_4));
+            start = bench_nsec();
+            simd_histogram(src, pixels, level_4);
+            if (best[0] > (t = bench_nsec() - start)) {
+                best[0] = t;
+            }
+            start = bench_nsec();
+            simd_remap(src, dst, hdr.width, hdr.height, palette_of);
+            if (best[1] > (t = bench_nsec() - start)) {
+                best[1] = t;
+            }
+            start = bench_nsec();
+            simd_remap_lut(src, dst, hdr.width, hdr.height, lut);
+            if (best[2] > (t = bench_nsec() - start)) {
+                best[2] = t;
+            }
+        }
+        printf("  %-6s  histogram %7.1f   remap %7.1f   remap by table %7.1f\n", versions[v],
+               pixels * 1e3 / best[0], pixels * 1e3 / best[1], pixels * 1e3 / best[2]);
+    }
+    (void)simd_use_kernels(chosen);
+    free(src);
+    free(dst);
+}
+
+
+/*
+ * bench_lines
+ *   DESCRIPTION: Measure the line kernels of each kernel version.  Lines
+ *                for horizontal scrolling are split among the planes one
+ *                at a time(SCROLL_X_DIM pixels each), as in
+ *                draw_horiz_lines.  Lines for vertical scrolling are
+ *                written as rows of the planes in four calls per batch,
+ *                as in draw_vert_lines, for batches of 4 and LINE_BATCH
+ *                lines; the cost is given per line(SCROLL_Y_DIM pixels).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints a line for each kernel version
+ */
+static void bench_lines() {
+    static uint8_t lines[LINE_BATCH * SCROLL_Y_DIM];                 /* line images  */
+    static uint8_t build[4][SCROLL_X_WIDTH * (SCROLL_Y_DIM + 1)];    /* plane images */
+    uint8_t* const planes[4] = { build[0], build[1], build[2], build[3] };
+    uint32_t       batches[2] = { 4, LINE_BATCH }; /* lines in a vertical batch  */
+    uint64_t       best[3];    /* fastest run for each measurement */
+    uint64_t       start;      /* clock at start of run            */
+    uint64_t       t;          /* time of run                      */
+    uint32_t       v;          /* index over kernel versions       */
+    uint32_t       b;          /* index over measurements          */
+    int32_t        trial;      /* index over runs                  */
+    int32_t        i;          /* index over calls                 */
+    int32_t        k;          /* index over calls in a batch      */
+    const char*    chosen = simd_kernel_name(); /* version in use   */
+
+    for (i = 0; (int32_t)sizeof (lines) > i; i++) {
+        lines[i] = rand();
+    }
+    printf("lines: " BENCH_UNIT " per line(horizontal %u pixels; vertical %u pixels "
+           "in batches of %u and %u)\n", SCROLL_X_DIM, SCROLL_Y_DIM, batches[0], batches[1]);
+    for (v = 0; sizeof (versions) / sizeof (versions[0]) > v; v++) {
+        if (0 != simd_use_kernels(versions[v])) {
+            continue;
+        }
+        for (b = 0; 3 > b; b++) {
+            best[b] = UINT64_MAX;
+        }
+        for (trial = 0; BENCH_TRIALS > trial; trial++) {
+            start = bench_now();
+            for (i = 0; LINE_REPEAT > i; i++) {
+                simd_deinterleave(planes, &lines[SCROLL_X_DIM * (i % 32)], SCROLL_X_DIM);
+            }
+            if (best[0] > (t = bench_now() - start)) {
+                best[0] = t;
+            }
+            for (b = 0; 2 > b; b++) {
+                start = bench_now();
+                for (i = 0; LINE_REPEAT > i; i += batches[b]) {
+                    for (k = 0; 4 > k; k++) {
+                        simd_transpose(build[3 - k], SCROLL_X_WIDTH, &lines[k * SCROLL_Y_DIM],
+                                       4 * SCROLL_Y_DIM, batches[b] / 4, SCROLL_Y_DIM);
+                    }
+                }
+                if (best[b + 1] > (t = bench_now() - start)) {
+                    best[b + 1] = t;
+                }
+            }
+        }
+        printf("  %-6s  horizontal %6.1f   vertical %6.1f and %6.1f\n", versions[v],
+               (double)best[0] / LINE_REPEAT, (double)best[1] / LINE_REPEAT,
+               (double)best[2] / LINE_REPEAT);
+    }
+    (void)simd_use_kernels(chosen);
+}
+
+
+/*
+ * bench_fills
+ *   DESCRIPTION: Measure the line fill functions in a room at random
+ *                view window positions.
+ *   INPUTS: r -- the room
+ *           calls -- calls of each function in a run
+ *   OUTPUTS: vert -- nanoseconds per call of fill_vert_buffer
+ *            planes -- nanoseconds per call of fill_horiz_planes(one
+ *                      line), or 0 if the photo has no plane copy
+ *   RETURN VALUE: nanoseconds per call of fill_horiz_buffer
+ *   SIDE EFFECTS: pins the room's photo
+ */
+static double bench_fills(const room_t* r, int32_t calls, double* vert, double* planes) {
+    static unsigned char hbuf[SCROLL_X_DIM];           /* horizontal line */
+    static unsigned char vbuf[SCROLL_Y_DIM];           /* vertical line   */
+    static unsigned char pbuf[4][SCROLL_X_WIDTH];      /* line in planes  */
+    unsigned char*       pl[4] = { pbuf[0], pbuf[1], pbuf[2], pbuf[3] };
+    int32_t              xs[DRAW_CALLS];  /* positions of calls      */
+    int32_t              ys[DRAW_CALLS];
+    uint64_t             best[3];  /* fastest run of each function */
+    uint64_t             start;    /* clock at start of run        */
+    uint64_t             t;        /* time of run                  */
+    int32_t              w;        /* photo width                  */
+    int32_t              h;        /* photo height                 */
+    int32_t              trial;    /* index over runs              */
+    int32_t              i;        /* index over calls             */
+
+    prep_room(r);
+    w = room_photo_width(r);
+    h = room_photo_height(r);
+    calls = (DRAW_CALLS < calls ? DRAW_CALLS : calls);
+    for (i = 0; calls > i; i++) {
+        xs[i] = rand() % (w > SCROLL_X_DIM ? w - SCROLL_X_DIM + 1 : 1);
+        ys[i] = rand() % (h > SCROLL_Y_DIM ? h - SCROLL_Y_DIM + 1 : 1);
+    }
+    best[0] = best[1] = best[2] = UINT64_MAX;
+    for (trial = 0; BENCH_TRIALS > trial; trial++) {
+        start = bench_nsec();
+        for (i = 0; calls > i; i++) {
+            fill_horiz_buffer(xs[i], ys[i] + i % SCROLL_Y_DIM, hbuf);
+        }
+        if (best[0] > (t = bench_nsec() - start)) {
+            best[0] = t;
+        }
+        start = bench_nsec();
+        for (i = 0; calls > i; i++) {
+            fill_vert_buffer(xs[i] + i % SCROLL_X_DIM, ys[i], vbuf);
+        }
+        if (best[1] > (t = bench_nsec() - start)) {
+            best[1] = t;
+        }
+        start = bench_nsec();
+        for (i = 0; calls > i; i++) {
+            if (0 != fill_horiz_planes(xs[i], ys[i] + i % SCROLL_Y_DIM, 1, pl)) {
+                break;
+            }
+        }
+        if (calls == i && best[2] > (t = bench_nsec() - start)) {
+            best[2] = t;
+        }
+    }
+    *vert = (double)best[1] / calls;
+    *planes = (UINT64_MAX == best[2] ? 0 : (double)best[2] / calls);
+    return (double)best[0] / calls;
+}
+
+
+/*
+ * bench_draw
+ *   DESCRIPTION: Measure the line fill functions in every room.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints the times
+ */
+static void bench_draw() {
+    double  horiz = 0;  /* sum of horizontal times         */
+    double  vert = 0;   /* sum of vertical times           */
+    double  planes = 0; /* sum of plane times              */
+    double  v;          /* vertical time in one room       */
+    double  p;          /* plane time in one room          */
+    int32_t n_planes = 0; /* rooms with plane times        */
+    room_t* r;          /* room measured                   */
+    int32_t i;          /* index over rooms                */
+
+    for (i = 0; NULL != (r = room_by_index(i)); i++) {
+        horiz += bench_fills(r, DRAW_CALLS, &v, &p);
+        vert += v;
+        if (0 != p) {
+            planes += p;
+            n_planes++;
+        }
+    }
+    printf("draw: ns per line, averaged over %d rooms\n", i);
+    printf("  fill_horiz_buffer %8.1f   fill_vert_buffer %8.1f   fill_horiz_planes %8.1f\n",
+           horiz / i, vert / i, (0 == n_planes ? 0 : planes / n_planes));
+}
+
+
+/*
+ * bench_objects
+ *   DESCRIPTION: Fill the starting room with more and more objects(using
+ *                the game's object images) at random positions, and
+ *                measure the line fill functions and the cost of finding
+ *                the objects on each row of the photo through the room's
+ *                index(room_objects_on_row) and by walking the room's
+ *                contents as the fill functions did before the index.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: adds objects to the starting room; prints the times
+ */
+static void bench_objects() {
+    static const int32_t counts[] = { 0, 100, 300, MAX_EXTRA }; /* objects added */
+    room_t*         r;         /* the synthetic room          */
+    object_t*       o;         /* object in room contents     */
+    const image_t*  img;       /* object image                */
+    int32_t         added = 0; /* objects added so far        */
+    int32_t         w;         /* photo width                 */
+    int32_t         h;         /* photo height                */
+    double          horiz;     /* time of horizontal fills    */
+    double          vert;      /* time of vertical fills      */
+    double          planes;    /* time of plane fills         */
+    uint64_t        best[2];   /* fastest run of each lookup  */
+    uint64_t        start;     /* clock at start of run       */
+    uint64_t        t;         /* time of run                 */
+    uint64_t        found = 0; /* objects found(kept live)    */
+    int32_t         n;         /* objects listed for a row    */
+    int32_t         end;       /* row after those listed      */
+    uint32_t        c;         /* index over counts           */
+    int32_t         trial;     /* index over runs             */
+    int32_t         y;         /* index over rows             */
+
+    r = start_in_room();
+    w = room_photo_width(r);
+    h = room_photo_height(r);
+    printf("objects: synthetic room(%s, %d x %d); ns per line or per row\n", room_name(r), w, h);
+    for (c = 0; sizeof (counts) / sizeof (counts[0]) > c; c++) {
+        added += room_add_objects(r, counts[c] - added);
+        horiz = bench_fills(r, DRAW_CALLS, &vert, &planes);
+
+        best[0] = best[1] = UINT64_MAX;
+        for (trial = 0; BENCH_TRIALS > trial; trial++) {
+            start = bench_nsec();
+            for (y = 0; h > y; y++) {
+                if (NULL != room_objects_on_row(r, y, &n, &end)) {
+                    found += n;
+                }
+            }
+            if (best[0] > (t = bench_nsec() - start)) {
+                best[0] = t;
+            }
+            start = bench_nsec();
+            for (y = 0; h > y; y++) {
+                for (o = room_contents_iterate(r); NULL != o; o = obj_next(o)) {
+                    img = obj_image(o);
+                    if (obj_get_y(o) <= y && y < obj_get_y(o) + (int32_t)image_height(img)) {
+                        found++;
+                    }
+                }
+            }
+            if (best[1] > (t = bench_nsec() - start)) {
+                best[1] = t;
+            }
+        }
+        printf("  +%-4d objects  fill_horiz_buffer %8.1f  fill_vert_buffer %8.1f  "
+               "row index %7.1f  row walk %8.1f\n", added, horiz, vert,
+               (double)best[0] / h, (double)best[1] / h);
+    }
+    if (0 == found) {
+        printf("  (no objects found)\n");
+    }
+}
+
+
+/*
+ * main
+ *   DESCRIPTION: Run the benchmarks named on the command line, or all of
+ *                them.
+ *   INPUTS: argc, argv -- benchmark names
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or 1 if a name is unknown or the world
+ *                 cannot be built
+ *   SIDE EFFECTS: builds the world; prints the measurements
+ */
+int main(int argc, char** argv) {
+    uint32_t i;  /* index over benchmarks */
+    int32_t  a;  /* index over arguments  */
+
+    for (a = 1; argc > a; a++) {
+        for (i = 0; sizeof (benches) / sizeof (benches[0]) > i; i++) {
+            if (0 == strcmp(argv[a], benches[i].name)) {
+                break;
+            }
+        }
+        if (sizeof (benches) / sizeof (benches[0]) == i) {
+            fprintf(stderr, "mp2bench: unknown benchmark %s\n", argv[a]);
+            return 1;
+        }
+    }
+    if (!build_world()) {
+        fputs("mp2bench: can't build the world(run from the game's directory)\n", stderr);
+        return 1;
+    }
+    for (i = 0; sizeof (benches) / sizeof (benches[0]) > i; i++) {
+        for (a = 1; argc > a && 0 != strcmp(argv[a], benches[i].name); a++) { }
+        if (1 == argc || argc > a) {
+            (*benches[i].run)();
+        }
+    }
+    return 0;
+}
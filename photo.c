@@ -36,12 +36,22 @@
  */
 
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "assert.h"
 #include "modex.h"
 #include "photo.h"
 #include "photo_headers.h"
+#include "pool.h"
+#include "simd.h"
+#include "trace.h"
 #include "world.h"
 
 
@@ -59,6 +69,28 @@ struct photo_t {
     photo_header_t hdr;            /* defines height and width */
     uint8_t        palette[192][3];     /* optimized palette colors */
     uint8_t*       img;                 /* pixel data               */
+    void*          map_base;            /* mapped cache file holding img(or NULL) */
+    size_t         map_len;             /* size of mapped cache file   */
+    uint8_t*       lut;                 /* nearest color for each 5:6:5 color(only while quantizing) */
+    int32_t        preview;             /* uses only the 64 fixed colors(see read_photo_preview) */
+    uint8_t*       columns;             /* pixel data column by column(or NULL) */
+    uint8_t*       planes;              /* pixel data in plane order(or NULL) */
+};
+
+/*
+ * The opaque pixels of an object image are drawn as runs of pixels
+ * between transparent ones, so that each run is copied as one block.
+ * The runs of row y are runs[row_run[y]] up to runs[row_run[y + 1]],
+ * with start giving the first column of each run; the runs of column x
+ * follow, from runs[col_run[x]] up to runs[col_run[x + 1]], with start
+ * giving the first row of each run.  Object images are no more than
+ * MAX_OBJECT_WIDTH pixels wide and MAX_OBJECT_HEIGHT pixels high, so
+ * one byte suffices for each field.
+ */
+typedef struct obj_run_t obj_run_t;
+struct obj_run_t {
+    uint8_t start;  /* first pixel of run      */
+    uint8_t len;    /* number of pixels in run */
 };
 
 /*
@@ -71,8 +103,95 @@ struct photo_t {
  * second row, and so forth.  No padding is used.
  */
 struct image_t {
-    photo_header_t hdr;  /* defines height and width */
-    uint8_t*       img;  /* pixel data               */
+    photo_header_t   hdr;      /* defines height and width           */
+    uint8_t*         img;      /* pixel data                         */
+    uint8_t*         columns;  /* pixel data column by column(or NULL) */
+    const obj_run_t* runs;     /* opaque runs(see above)             */
+    const uint16_t*  row_run;  /* first run of each row              */
+    const uint16_t*  col_run;  /* first run of each column           */
+    uint64_t         hash;     /* hash of image file                 */
+    image_t*         next;     /* next image read(see obj_images)    */
+};
+
+/*
+ * Object images are never released, so each image(structure, pixels,
+ * column copy, and runs) is carved as one block from an atlas that is
+ * allocated OBJ_ATLAS_CHUNK bytes at a time, which keeps the images of
+ * all objects together in memory.  Blocks are aligned to OBJ_ATLAS_ALIGN
+ * bytes.
+ */
+#define OBJ_ATLAS_CHUNK 0x20000
+#define OBJ_ATLAS_ALIGN 16
+
+/*
+ * Vertical lines are drawn from copies of photos and object images that
+ * store the pixels column by column(see set_photo_columns), so that the
+ * pixels of a line are read in sequence rather than one row apart.
+ * Tiles of COLUMN_TILE x COLUMN_TILE pixels are transposed at a time.
+ */
+#define COLUMN_TILE 16
+
+/*
+ * Horizontal lines are drawn from copies of photos stored in mode X
+ * plane order(see set_photo_planes): four images of a quarter of the
+ * photo's width, the first holding columns 0, 4, 8, and so forth, the
+ * second columns 1, 5, 9, and so forth.  Each row of a plane image is
+ * PLANE_WIDTH(width) bytes long, and the rows of one plane image are
+ * contiguous, so a line is drawn into the build buffer's planes with
+ * four block copies(see fill_horiz_planes).
+ */
+#define PLANE_WIDTH(width) (((width) + 3) >> 2)
+
+
+/*
+ * An entry in the on-disk cache of quantized room photos.  Everything up
+ * to the palette is the cache key: a photo is taken from the cache only
+ * when all of these fields match the source file(see read_photo).  The
+ * photo's index image(hdr.width * hdr.height bytes) follows the header.
+ * Change PHOTO_CACHE_VARIANT whenever the quantizer's output changes.
+ * Photos mapped through a lookup table(see build_photo_lut) are cached
+ * separately, with PHOTO_CACHE_LUT added to the variant.
+ */
+#define PHOTO_CACHE_MAGIC    0x31435051  /* "QPC1"                     */
+#define PHOTO_CACHE_VARIANT  1           /* version of quantizer output */
+#define PHOTO_CACHE_LUT      0x100       /* variant flag: LUT mapping   */
+#define PHOTO_CACHE_DIR      ".photo_cache"
+#define PHOTO_CACHE_NAME_LEN 128         /* limit on source name length */
+#define PHOTO_CACHE_PATH_LEN 512         /* limit on cache file name    */
+
+typedef struct photo_cache_t photo_cache_t;
+struct photo_cache_t {
+    uint32_t       magic;                       /* PHOTO_CACHE_MAGIC            */
+    uint32_t       variant;                     /* PHOTO_CACHE_VARIANT          */
+    uint64_t       src_size;                    /* source file size             */
+    int64_t        src_mtime;                   /* source modification time(s)  */
+    int64_t        src_mtime_ns;                /* and nanoseconds              */
+    uint64_t       src_hash;                    /* hash of source file contents */
+    char           src_name[PHOTO_CACHE_NAME_LEN]; /* source file name          */
+    photo_header_t hdr;                         /* photo height and width       */
+    uint8_t        palette[192][3];             /* optimized palette colors     */
+};
+
+
+/*
+ * A horizontal slab of a large photo, quantized in parallel with the
+ * other slabs by the worker pool(see quantize_photo).  Each slab counts
+ * its own pixels into a private histogram; the histograms are summed
+ * before the palette is chosen, which gives exactly the same counts and
+ * sums as counting the whole photo at once.
+ */
+#define SLAB_MIN_PIXELS 0x40000  /* photos smaller than this are not split */
+#define MAX_SLABS       16       /* limit on slabs per photo              */
+
+typedef struct photo_slab_t photo_slab_t;
+struct photo_slab_t {
+    const uint16_t*    src;          /* first file row of slab             */
+    uint8_t*           dst;          /* first image row of slab            */
+    uint32_t           width;        /* photo width in pixels              */
+    uint32_t           rows;         /* number of rows in slab             */
+    const uint8_t*     palette_of;   /* palette color for each 4:4:4 index */
+    const uint8_t*     lut;          /* palette color for each pixel value(or NULL) */
+    struct octree_node hist[LEVEL_4_SIZE]; /* histogram of slab's pixels   */
 };
 
 
@@ -81,80 +200,380 @@ struct image_t {
 /*
  * The room currently shown on the screen.  This value is not known to
  * the mode X code, but is needed when filling buffers in callbacks from
- * that code(fill_horiz_buffer/fill_vert_buffer).  The value is set
+ * that code(fill_horiz_block/fill_vert_block).  The value is set
  * by calling prep_room.
  */
 static const room_t* cur_room = NULL;
 
+/*
+ * Object images read so far(linked through next).  Objects whose image
+ * files are identical share one image(see read_obj_image).  Object
+ * images may be read by several threads at once; the list and the atlas
+ * are protected by obj_lock.
+ */
+static image_t* obj_images = NULL;
+static pthread_mutex_t obj_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The free part of the object image atlas(see atlas_alloc). */
+static uint8_t* atlas_next = NULL;
+static size_t   atlas_left = 0;
+
+
+/* local functions--see function headers for details */
+static void blend_column_object(int x, int y, int count, unsigned char* buf,
+                                const image_t* img, int32_t obj_x, int32_t obj_y);
+static void blend_row_object(int x, int y, int count, unsigned char* buf,
+                             const image_t* img, int32_t obj_x, int32_t obj_y);
+static void blend_row_planes(int x, int y, int count, unsigned char* planes[4],
+                             const image_t* img, int32_t obj_x, int32_t obj_y);
+static void* atlas_alloc(size_t bytes);
+static int32_t build_photo_lut(photo_t* p);
+static int32_t find_runs(const uint8_t* px, int32_t n, int32_t stride, obj_run_t* runs);
+static uint64_t hash_image_file(const uint8_t* data, size_t len);
+static const uint8_t* map_image_file(const char* fname, size_t* len, struct stat* st);
+static void octree_heap_sift(const struct octree_node* nodes, uint16_t* heap,
+                             int32_t n, int32_t pos);
+static int32_t octree_node_before(const struct octree_node* nodes, uint16_t a, uint16_t b);
+static int32_t columns_enabled(void);
+static void copy_run(uint8_t* dst, const uint8_t* src, int32_t n);
+static int32_t photo_cache_name(const char* fname, char* cname);
+static int32_t photo_lut_enabled(void);
+static int32_t planes_enabled(void);
+static void quantize_photo(photo_t* p, const uint16_t* src);
+static void run_slab_jobs(pool_t* pool, photo_slab_t* slabs, int32_t n_slabs,
+                          pool_fn_t fn);
+static void slab_histogram_job(void* arg);
+static void slab_remap_job(void* arg);
+static void transpose_pixels(uint8_t* dst, const uint8_t* src, uint32_t width, uint32_t height);
+static photo_t* read_photo_cache(const char* fname, const photo_cache_t* key);
+static void write_photo_cache(const char* fname, const photo_cache_t* key, const photo_t* p);
+
 
 /*
- * fill_horiz_buffer
+ * fill_horiz_block
  *   DESCRIPTION: Given the(x,y) map pixel coordinate of the leftmost
- *                pixel of a line to be drawn on the screen, this routine
- *                produces an image of the line.  Each pixel on the line
- *                is represented as a single byte in the image.
+ *                pixel of the first of a block of consecutive lines to
+ *                be drawn on the screen, this routine produces an image
+ *                of the lines.  Each pixel on a line is represented as a
+ *                single byte in the image, and line k of the block
+ *                occupies buf[k * SCROLL_X_DIM] to
+ *                buf[k * SCROLL_X_DIM + SCROLL_X_DIM - 1].
  *
  *                Note that this routine draws both the room photo and
- *                the objects in the room.
+ *                the objects in the room.  The photo and each object
+ *                are clipped to the block once and drawn as spans rather
+ *                than checked pixel by pixel, and the room's objects are
+ *                looked up once for each band of rows in the block
+ *                rather than once per line.
  *
+ *   INPUTS:(x,y) -- leftmost pixel of first line to be drawn
+ *           count -- number of lines to be drawn
+ *   OUTPUTS: buf -- buffer holding image data for the lines
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void fill_horiz_block(int x, int y, int count, unsigned char* buf) {
+    object_t*          obj;    /* loop index over objects in the current room */
+    const obj_place_t* objs;   /* objects that may cross a band of lines      */
+    int32_t            n_objs; /* number of objects in objs                   */
+    int32_t            i;      /* loop index over objs                        */
+    int32_t            row;    /* first line of band of lines                 */
+    int32_t            end;    /* line after band of lines                    */
+    const photo_t*     view;   /* room photo                                  */
+    int32_t            first;  /* first pixel of span                         */
+    int32_t            last;   /* pixel after span                            */
+
+    TRACE_BEGIN("fill_horiz_block");
+
+    /*
+     * Get pointer to current photo of current room.  If the photo could
+     * not be read, draw black behind the objects.
+     */
+    view = room_photo(cur_room);
+
+    /*
+     * Find the span of the lines that lies within the photo, copy it as
+     * one block for each line, and fill the margins on either side(if
+     * any) with black.
+     */
+    first = last = 0;
+    if (NULL != view) {
+        first = (0 > x ? -x : 0);
+        last = view->hdr.width - x;
+    }
+    first = (SCROLL_X_DIM < first ? SCROLL_X_DIM : first);
+    last = (first > last ? first : (SCROLL_X_DIM < last ? SCROLL_X_DIM : last));
+    for (row = 0; count > row; row++) {
+        (void)memset(&buf[SCROLL_X_DIM * row], 0, first);
+        if (first < last) {
+            (void)memcpy(&buf[SCROLL_X_DIM * row + first],
+                         &view->img[view->hdr.width * (y + row) + x + first], last - first);
+        }
+        (void)memset(&buf[SCROLL_X_DIM * row + last], 0, SCROLL_X_DIM - last);
+    }
+
+    /*
+     * Draw the objects in the current room that may cross the lines, as
+     * found by the room's object index for each band of lines(or, if the
+     * room has none, all of the room's objects).
+     */
+    for (row = y; y + count > row; row = end) {
+        if (NULL == (objs = room_objects_on_row(cur_room, row, &n_objs, &end))) {
+            for (obj = room_contents_iterate(cur_room); NULL != obj; obj = obj_next(obj)) {
+                blend_row_object(x, y, count, buf, obj_image(obj), obj_get_x(obj), obj_get_y(obj));
+            }
+            break;
+        }
+        end = (y + count < end ? y + count : end);
+        for (i = 0; n_objs > i; i++) {
+            blend_row_object(x, row, end - row, &buf[SCROLL_X_DIM * (row - y)],
+                             objs[i].img, objs[i].x, objs[i].y);
+        }
+    }
+    TRACE_END("fill_horiz_block");
+}
+
+
+/*
+ * fill_horiz_buffer
+ *   DESCRIPTION: Given the(x,y) map pixel coordinate of the leftmost
+ *                pixel of a line to be drawn on the screen, this routine
+ *                produces an image of the line(see fill_horiz_block).
  *   INPUTS:(x,y) -- leftmost pixel of line to be drawn
  *   OUTPUTS: buf -- buffer holding image data for the line
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
 void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]) {
-    int            idx;   /* loop index over pixels in the line          */
-    object_t*      obj;   /* loop index over objects in the current room */
-    int            imgx;  /* loop index over pixels in object image      */
-    int            yoff;  /* y offset into object image                  */
-    uint8_t        pixel; /* pixel from object image                     */
-    const photo_t* view;  /* room photo                                  */
-    int32_t        obj_x; /* object x position                           */
-    int32_t        obj_y; /* object y position                           */
-    const image_t* img;   /* object image                                */
-
-    /* Get pointer to current photo of current room. */
-    view = room_photo(cur_room);
+    fill_horiz_block(x, y, 1, buf);
+}
+
 
-    /* Loop over pixels in line. */
-    for (idx = 0; idx < SCROLL_X_DIM; idx++) {
-        buf[idx] = (0 <= x + idx && view->hdr.width > x + idx ? view->img[view->hdr.width * y + x + idx] : 0);
+/*
+ * copy_run
+ *   DESCRIPTION: Copy a run of opaque object pixels into a line.  Runs
+ *                are short, so rather than calling memcpy, the run is
+ *                copied as eight-byte words, the last of which may
+ *                overlap the one before it.
+ *   INPUTS: src -- first pixel of run
+ *           n -- number of pixels in run(at least 1)
+ *   OUTPUTS: dst -- where the run is drawn
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void copy_run(uint8_t* dst, const uint8_t* src, int32_t n) {
+    uint64_t word;  /* eight pixels being copied */
+    uint32_t half;  /* four pixels being copied  */
+    int32_t  i;     /* index over words in run   */
+
+    if (8 <= n) {
+        for (i = 0; n - 8 > i; i += 8) {
+            (void)memcpy(&word, &src[i], 8);
+            (void)memcpy(&dst[i], &word, 8);
+        }
+        (void)memcpy(&word, &src[n - 8], 8);
+        (void)memcpy(&dst[n - 8], &word, 8);
+    }
+    else if (4 <= n) {
+        (void)memcpy(&half, &src[n - 4], 4);
+        (void)memcpy(&dst[n - 4], &half, 4);
+        (void)memcpy(&half, src, 4);
+        (void)memcpy(dst, &half, 4);
+    }
+    else {
+        dst[0] = src[0];
+        dst[n >> 1] = src[n >> 1];
+        dst[n - 1] = src[n - 1];
     }
+}
 
-    /* Loop over objects in the current room. */
-    for (obj = room_contents_iterate(cur_room); NULL != obj; obj = obj_next(obj)) {
-        obj_x = obj_get_x(obj);
-        obj_y = obj_get_y(obj);
-        img = obj_image(obj);
 
-        /* Is object outside of the line we're drawing? */
-        if (y < obj_y || y >= obj_y + img->hdr.height || x + SCROLL_X_DIM <= obj_x || x >= obj_x + img->hdr.width) {
-            continue;
+/*
+ * blend_row_object
+ *   DESCRIPTION: Draw the part of an object that crosses a block of
+ *                horizontal lines(if any) into an image of the lines
+ *                (see fill_horiz_block).
+ *   INPUTS:(x,y) -- leftmost pixel of first line being drawn
+ *           count -- number of lines being drawn
+ *           img -- object image
+ *           (obj_x,obj_y) -- object position within the room photo
+ *   OUTPUTS: buf -- buffer holding image data for the lines
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void blend_row_object(int x, int y, int count, unsigned char* buf,
+                             const image_t* img, int32_t obj_x, int32_t obj_y) {
+    int32_t        first; /* first column of object image drawn */
+    int32_t        last;  /* column after last one drawn        */
+    int32_t        top;   /* first row of object image drawn    */
+    int32_t        bot;   /* row after last one drawn           */
+    const uint8_t* row;   /* row of object image drawn          */
+    uint8_t*       line;  /* line on which row is drawn         */
+    int32_t        r;     /* loop index over runs in row        */
+    int32_t        start; /* first column of run drawn          */
+    int32_t        end;   /* column after run drawn             */
+
+    /* Is object outside of the lines we're drawing? */
+    if (y + count <= obj_y || y >= obj_y + img->hdr.height ||
+        x + SCROLL_X_DIM <= obj_x || x >= obj_x + img->hdr.width) {
+        return;
+    }
+
+    /*
+     * Clip the object to the block(first and last are columns, and top
+     * and bot rows, of the object image), then copy each run of
+     * non-transparent pixels in each row, clipped in the same way.
+     */
+    first = (x > obj_x ? x - obj_x : 0);
+    last = (obj_x + img->hdr.width > x + SCROLL_X_DIM ? x + SCROLL_X_DIM - obj_x : img->hdr.width);
+    top = (y > obj_y ? y - obj_y : 0);
+    bot = (obj_y + img->hdr.height > y + count ? y + count - obj_y : img->hdr.height);
+    for (; bot > top; top++) {
+        row = &img->img[top * img->hdr.width];
+        line = &buf[SCROLL_X_DIM * (obj_y + top - y) + obj_x - x];
+        for (r = img->row_run[top]; img->row_run[top + 1] > r; r++) {
+            start = (first > img->runs[r].start ? first : img->runs[r].start);
+            end = img->runs[r].start + img->runs[r].len;
+            end = (last < end ? last : end);
+            if (start < end) {
+                copy_run(&line[start], &row[start], end - start);
+            }
         }
+    }
+}
 
-        /* The y offset of drawing is fixed. */
-        yoff = (y - obj_y) * img->hdr.width;
 
-        /*
-         * The x offsets depend on whether the object starts to the left
-         * or to the right of the starting point for the line being drawn.
-         */
-        if (x <= obj_x) {
-            idx = obj_x - x;
-            imgx = 0;
+/*
+ * fill_horiz_planes
+ *   DESCRIPTION: Given the(x,y) map pixel coordinate of the leftmost
+ *                pixel of the first of a block of consecutive lines to
+ *                be drawn on the screen, this routine draws the lines
+ *                directly in mode X plane order: pixel x + 4i + p of
+ *                line k of the block is written to
+ *                planes[p][k * SCROLL_X_WIDTH + i].  The room photo is
+ *                copied from its plane order copy(see set_photo_planes)
+ *                as four blocks per line, and the objects in the room are
+ *                drawn on top.
+ *   INPUTS:(x,y) -- leftmost pixel of first line to be drawn
+ *           count -- number of lines to be drawn
+ *   OUTPUTS: planes -- SCROLL_X_WIDTH bytes for each plane of each line
+ *   RETURN VALUE: 0 on success, or -1(having drawn nothing) if the photo
+ *                 has no plane order copy, in which case the lines must
+ *                 be drawn with fill_horiz_block
+ *   SIDE EFFECTS: none
+ */
+int fill_horiz_planes(int x, int y, int count, unsigned char* planes[4]) {
+    object_t*          obj;    /* loop index over objects in the current room */
+    const obj_place_t* objs;   /* objects that may cross a band of lines      */
+    int32_t            n_objs; /* number of objects in objs                   */
+    int32_t            i;      /* loop index over objs                        */
+    int32_t            row;    /* index over lines                            */
+    int32_t            end;    /* line after band of lines                    */
+    unsigned char*     band[4]; /* planes of first line of band            */
+    const photo_t*     view;   /* room photo                                  */
+    uint32_t           pw;     /* bytes in each row of a plane image          */
+    int32_t            p;      /* index over planes of the line               */
+    int32_t            q;      /* plane of photo copied to plane p            */
+    int32_t            first;  /* first byte of plane q's row copied          */
+    int32_t            n;      /* number of bytes copied                      */
+
+    view = room_photo(cur_room);
+    if (NULL == view || NULL == view->planes || 0 > x) {
+        return -1;
+    }
+    TRACE_BEGIN("fill_horiz_planes");
+
+    /*
+     * Copy the part of each plane's rows that lies within the photo, and
+     * fill the rest(if any) with black.
+     */
+    pw = PLANE_WIDTH(view->hdr.width);
+    for (p = 0; 4 > p; p++) {
+        q = (x + p) & 3;
+        first = (x + p) >> 2;
+        n = ((int32_t)view->hdr.width - q + 3) >> 2;
+        n = (first < n ? n - first : 0);
+        n = (SCROLL_X_WIDTH < n ? SCROLL_X_WIDTH : n);
+        for (row = 0; count > row; row++) {
+            (void)memcpy(&planes[p][SCROLL_X_WIDTH * row],
+                         &view->planes[pw * (view->hdr.height * q + y + row) + first], n);
+            (void)memset(&planes[p][SCROLL_X_WIDTH * row + n], 0, SCROLL_X_WIDTH - n);
         }
-        else {
-            idx = 0;
-            imgx = x - obj_x;
+    }
+
+    /*
+     * Draw the objects in the current room that may cross the lines(see
+     * fill_horiz_block).
+     */
+    for (row = y; y + count > row; row = end) {
+        if (NULL == (objs = room_objects_on_row(cur_room, row, &n_objs, &end))) {
+            for (obj = room_contents_iterate(cur_room); NULL != obj; obj = obj_next(obj)) {
+                blend_row_planes(x, y, count, planes, obj_image(obj), obj_get_x(obj), obj_get_y(obj));
+            }
+            break;
         }
+        end = (y + count < end ? y + count : end);
+        for (p = 0; 4 > p; p++) {
+            band[p] = &planes[p][SCROLL_X_WIDTH * (row - y)];
+        }
+        for (i = 0; n_objs > i; i++) {
+            blend_row_planes(x, row, end - row, band, objs[i].img, objs[i].x, objs[i].y);
+        }
+    }
+    TRACE_END("fill_horiz_planes");
+    return 0;
+}
+
+
+/*
+ * blend_row_planes
+ *   DESCRIPTION: Draw the part of an object that crosses a block of
+ *                horizontal lines(if any) into an image of the lines in
+ *                mode X plane order(see fill_horiz_planes).
+ *   INPUTS:(x,y) -- leftmost pixel of first line being drawn
+ *           count -- number of lines being drawn
+ *           img -- object image
+ *           (obj_x,obj_y) -- object position within the room photo
+ *   OUTPUTS: planes -- SCROLL_X_WIDTH bytes for each plane of each line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void blend_row_planes(int x, int y, int count, unsigned char* planes[4],
+                             const image_t* img, int32_t obj_x, int32_t obj_y) {
+    int32_t        first; /* first column of object image drawn */
+    int32_t        last;  /* column after last one drawn        */
+    int32_t        top;   /* first row of object image drawn    */
+    int32_t        bot;   /* row after last one drawn           */
+    const uint8_t* row;   /* row of object image drawn          */
+    int32_t        line;  /* offset of line within each plane   */
+    int32_t        r;     /* loop index over runs in row        */
+    int32_t        c;     /* loop index over columns of run     */
+    int32_t        end;   /* column after run drawn             */
+    int32_t        i;     /* pixel of line drawn                */
 
-        /* Copy the object's pixel data. */
-        for (; SCROLL_X_DIM > idx && img->hdr.width > imgx; idx++, imgx++) {
-            pixel = img->img[yoff + imgx];
+    /* Is object outside of the lines we're drawing? */
+    if (y + count <= obj_y || y >= obj_y + img->hdr.height ||
+        x + SCROLL_X_DIM <= obj_x || x >= obj_x + img->hdr.width) {
+        return;
+    }
 
-            /* Don't copy transparent pixels. */
-            if (OBJ_CLR_TRANSP != pixel) {
-                buf[idx] = pixel;
+    /*
+     * Clip the object and each of its runs to the block(see
+     * blend_row_object), then write each pixel of each run to its plane.
+     */
+    first = (x > obj_x ? x - obj_x : 0);
+    last = (obj_x + img->hdr.width > x + SCROLL_X_DIM ? x + SCROLL_X_DIM - obj_x : img->hdr.width);
+    top = (y > obj_y ? y - obj_y : 0);
+    bot = (obj_y + img->hdr.height > y + count ? y + count - obj_y : img->hdr.height);
+    for (; bot > top; top++) {
+        row = &img->img[top * img->hdr.width];
+        line = SCROLL_X_WIDTH * (obj_y + top - y);
+        for (r = img->row_run[top]; img->row_run[top + 1] > r; r++) {
+            c = (first > img->runs[r].start ? first : img->runs[r].start);
+            end = img->runs[r].start + img->runs[r].len;
+            end = (last < end ? last : end);
+            for (i = obj_x + c - x; end > c; c++, i++) {
+                planes[i & 3][line + (i >> 2)] = row[c];
             }
         }
     }
@@ -162,74 +581,168 @@ void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]) {
 
 
 /*
- * fill_vert_buffer
+ * fill_vert_block
  *   DESCRIPTION: Given the(x,y) map pixel coordinate of the top pixel of
- *                a vertical line to be drawn on the screen, this routine
- *                produces an image of the line.  Each pixel on the line
- *                is represented as a single byte in the image.
+ *                the first of a block of consecutive vertical lines to be
+ *                drawn on the screen, this routine produces an image of
+ *                the lines.  Each pixel on a line is represented as a
+ *                single byte in the image, and line k of the block
+ *                occupies buf[k * SCROLL_Y_DIM] to
+ *                buf[k * SCROLL_Y_DIM + SCROLL_Y_DIM - 1].
  *
  *                Note that this routine draws both the room photo and
- *                the objects in the room.
+ *                the objects in the room.  The room's objects are looked
+ *                up once for each band of columns in the block rather
+ *                than once per line.
  *
- *   INPUTS:(x,y) -- top pixel of line to be drawn
- *   OUTPUTS: buf -- buffer holding image data for the line
+ *   INPUTS:(x,y) -- top pixel of first line to be drawn
+ *           count -- number of lines to be drawn
+ *   OUTPUTS: buf -- buffer holding image data for the lines
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-void fill_vert_buffer(int x, int y, unsigned char buf[SCROLL_Y_DIM]) {
-    int            idx;   /* loop index over pixels in the line          */
-    object_t*      obj;   /* loop index over objects in the current room */
-    int            imgy;  /* loop index over pixels in object image      */
-    int            xoff;  /* x offset into object image                  */
-    uint8_t        pixel; /* pixel from object image                     */
-    const photo_t* view;  /* room photo                                  */
-    int32_t        obj_x; /* object x position                           */
-    int32_t        obj_y; /* object y position                           */
-    const image_t* img;   /* object image                                */
-
-    /* Get pointer to current photo of current room. */
-    view = room_photo(cur_room);
+void fill_vert_block(int x, int y, int count, unsigned char* buf) {
+    int                idx;    /* loop index over pixels in a line            */
+    object_t*          obj;    /* loop index over objects in the current room */
+    const obj_place_t* objs;   /* objects that may cross a band of lines      */
+    int32_t            n_objs; /* number of objects in objs                   */
+    int32_t            i;      /* loop index over objs                        */
+    int32_t            col;    /* index over lines                            */
+    int32_t            end;    /* line after band of lines                    */
+    unsigned char*     line;   /* image of one line                           */
+    const photo_t*     view;   /* room photo                                  */
+    int32_t            first;  /* first pixel of span                         */
+    int32_t            last;   /* pixel after span                            */
 
-    /* Loop over pixels in line. */
-    for (idx = 0; idx < SCROLL_Y_DIM; idx++) {
-        buf[idx] = (0 <= y + idx && view->hdr.height > y + idx ? view->img[view->hdr.width *(y + idx) + x] : 0);
-    }
+    TRACE_BEGIN("fill_vert_block");
 
-    /* Loop over objects in the current room. */
-    for (obj = room_contents_iterate(cur_room); NULL != obj; obj = obj_next(obj)) {
-        obj_x = obj_get_x(obj);
-        obj_y = obj_get_y(obj);
-        img = obj_image(obj);
+    /*
+     * Get pointer to current photo of current room.  If the photo could
+     * not be read, draw black behind the objects.
+     */
+    view = room_photo(cur_room);
 
-        /* Is object outside of the line we're drawing? */
-        if (x < obj_x || x >= obj_x + img->hdr.width ||
-            y + SCROLL_Y_DIM <= obj_y || y >= obj_y + img->hdr.height) {
-            continue;
+    /*
+     * Find the span of the lines that lies within the photo, copy it(as
+     * one block for each line if the photo has a column copy), and fill
+     * the margins on either side(if any) with black.
+     */
+    first = last = 0;
+    if (NULL != view) {
+        first = (0 > y ? -y : 0);
+        last = view->hdr.height - y;
+    }
+    first = (SCROLL_Y_DIM < first ? SCROLL_Y_DIM : first);
+    last = (first > last ? first : (SCROLL_Y_DIM < last ? SCROLL_Y_DIM : last));
+    for (col = 0; count > col; col++) {
+        line = &buf[SCROLL_Y_DIM * col];
+        (void)memset(line, 0, first);
+        if (first < last && NULL != view->columns) {
+            (void)memcpy(&line[first], &view->columns[view->hdr.height * (x + col) + y + first],
+                         last - first);
         }
+        else {
+            for (idx = first; last > idx; idx++) {
+                line[idx] = view->img[view->hdr.width * (y + idx) + x + col];
+            }
+        }
+        (void)memset(&line[last], 0, SCROLL_Y_DIM - last);
+    }
 
-        /* The x offset of drawing is fixed. */
-        xoff = x - obj_x;
-
-        /*
-         * The y offsets depend on whether the object starts below or
-         * above the starting point for the line being drawn.
-         */
-        if (y <= obj_y) {
-            idx = obj_y - y;
-            imgy = 0;
+    /*
+     * Draw the objects in the current room that may cross the lines, as
+     * found by the room's object index for each band of lines(or, if the
+     * room has none, all of the room's objects).
+     */
+    for (col = x; x + count > col; col = end) {
+        if (NULL == (objs = room_objects_on_column(cur_room, col, &n_objs, &end))) {
+            for (obj = room_contents_iterate(cur_room); NULL != obj; obj = obj_next(obj)) {
+                blend_column_object(x, y, count, buf, obj_image(obj), obj_get_x(obj), obj_get_y(obj));
+            }
+            break;
         }
-        else {
-            idx = 0;
-            imgy = y - obj_y;
+        end = (x + count < end ? x + count : end);
+        for (i = 0; n_objs > i; i++) {
+            blend_column_object(col, y, end - col, &buf[SCROLL_Y_DIM * (col - x)],
+                                objs[i].img, objs[i].x, objs[i].y);
         }
+    }
+    TRACE_END("fill_vert_block");
+}
+
+
+/*
+ * fill_vert_buffer
+ *   DESCRIPTION: Given the(x,y) map pixel coordinate of the top pixel of
+ *                a vertical line to be drawn on the screen, this routine
+ *                produces an image of the line(see fill_vert_block).
+ *   INPUTS:(x,y) -- top pixel of line to be drawn
+ *   OUTPUTS: buf -- buffer holding image data for the line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void fill_vert_buffer(int x, int y, unsigned char buf[SCROLL_Y_DIM]) {
+    fill_vert_block(x, y, 1, buf);
+}
+
+
+/*
+ * blend_column_object
+ *   DESCRIPTION: Draw the part of an object that crosses a block of
+ *                vertical lines(if any) into an image of the lines(see
+ *                fill_vert_block).
+ *   INPUTS:(x,y) -- top pixel of first line being drawn
+ *           count -- number of lines being drawn
+ *           img -- object image
+ *           (obj_x,obj_y) -- object position within the room photo
+ *   OUTPUTS: buf -- buffer holding image data for the lines
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void blend_column_object(int x, int y, int count, unsigned char* buf,
+                                const image_t* img, int32_t obj_x, int32_t obj_y) {
+    int32_t  idx;   /* loop index over rows of object image */
+    int32_t  xoff;  /* x offset into object image           */
+    int32_t  xend;  /* x offset after last column drawn     */
+    uint8_t* line;  /* line on which column is drawn        */
+    int32_t  first; /* first row of object image drawn      */
+    int32_t  last;  /* row after last one drawn             */
+    int32_t  r;     /* loop index over runs in column       */
+    int32_t  start; /* first row of run drawn               */
+    int32_t  end;   /* row after run drawn                  */
+
+    /* Is object outside of the lines we're drawing? */
+    if (x + count <= obj_x || x >= obj_x + img->hdr.width ||
+        y + SCROLL_Y_DIM <= obj_y || y >= obj_y + img->hdr.height) {
+        return;
+    }
 
-        /* Copy the object's pixel data. */
-        for (; SCROLL_Y_DIM > idx && img->hdr.height > imgy; idx++, imgy++) {
-            pixel = img->img[xoff + img->hdr.width * imgy];
+    /*
+     * Clip the object to the block(xoff and xend are columns, and first
+     * and last rows, of the object image), then draw the
+     * non-transparent pixels of each column.
+     */
+    xoff = (x > obj_x ? x - obj_x : 0);
+    xend = (obj_x + img->hdr.width > x + count ? x + count - obj_x : img->hdr.width);
+    first = (y > obj_y ? y - obj_y : 0);
+    last = (obj_y + img->hdr.height > y + SCROLL_Y_DIM ? y + SCROLL_Y_DIM - obj_y : img->hdr.height);
+    for (; xend > xoff; xoff++) {
+        line = &buf[SCROLL_Y_DIM * (obj_x + xoff - x) + obj_y - y];
+        for (r = img->col_run[xoff]; img->col_run[xoff + 1] > r; r++) {
+            start = (first > img->runs[r].start ? first : img->runs[r].start);
+            end = img->runs[r].start + img->runs[r].len;
+            end = (last < end ? last : end);
+            if (start >= end) {
+                continue;
+            }
 
-            /* Don't copy transparent pixels. */
-            if (OBJ_CLR_TRANSP != pixel) {
-                buf[idx] = pixel;
+            /* Copy the run from the column copy, or else row by row. */
+            if (NULL != img->columns) {
+                copy_run(&line[start], &img->columns[img->hdr.height * xoff + start], end - start);
+                continue;
+            }
+            for (idx = start; end > idx; idx++) {
+                line[idx] = img->img[xoff + img->hdr.width * idx];
             }
         }
     }
@@ -288,327 +801,1409 @@ uint32_t photo_width(const photo_t* p) {
 
 
 /*
- * prep_room
- *   DESCRIPTION: Prepare a new room for display.  You might want to set
- *                up the VGA palette registers according to the color
- *                palette that you chose for this room.
- *   INPUTS: r -- pointer to the new room
+ * photo_bytes
+ *   DESCRIPTION: Get the amount of memory held by a room photo of a
+ *                given size once it has been read.
+ *   INPUTS: hdr -- height and width of the photo
  *   OUTPUTS: none
- *   RETURN VALUE: none
- *   SIDE EFFECTS: changes recorded cur_room for this file
+ *   RETURN VALUE: bytes used by the photo structure and its pixel data
+ *   SIDE EFFECTS: none
  */
-void prep_room(const room_t* r) {
-    /* Record the current room. */
-	photo_t* new_room_photo = room_photo(r);
-	fill_my_palette(new_room_photo->palette);
-    cur_room = r;
+uint32_t photo_bytes(const photo_header_t* hdr) {
+    return (sizeof (photo_t) + hdr->width * hdr->height * sizeof (uint8_t) +
+            photo_column_bytes(hdr) + photo_plane_bytes(hdr));
 }
 
 
 /*
- * read_obj_image
- *   DESCRIPTION: Read size and pixel data in 2:2:2 RGB format from a
- *                photo file and create an image structure from it.
- *   INPUTS: fname -- file name for input
+ * photo_column_bytes
+ *   DESCRIPTION: Get the size of the column copy that read_photo makes
+ *                for a room photo of a given size.  Only photos wider
+ *                than the screen scroll horizontally, which is when
+ *                vertical lines are drawn, so narrower photos get no
+ *                copy.  Setting the ADVENTURE_PHOTO_COLUMNS environment
+ *                variable to 0 disables column copies.
+ *   INPUTS: hdr -- height and width of the photo
  *   OUTPUTS: none
- *   RETURN VALUE: pointer to newly allocated photo on success, or NULL
- *                 on failure
- *   SIDE EFFECTS: dynamically allocates memory for the image
+ *   RETURN VALUE: bytes in the column copy, or 0 if none is made
+ *   SIDE EFFECTS: none
  */
-image_t* read_obj_image(const char* fname) {
-    FILE*    in;        /* input file               */
-    image_t* img = NULL;    /* image structure          */
-    uint16_t x;            /* index over image columns */
-    uint16_t y;            /* index over image rows    */
-    uint8_t  pixel;        /* one pixel from the file  */
+uint32_t photo_column_bytes(const photo_header_t* hdr) {
+    return (columns_enabled() && SCROLL_X_DIM < hdr->width ?
+            hdr->width * hdr->height * sizeof (uint8_t) : 0);
+}
 
-    /*
-     * Open the file, allocate the structure, read the header, do some
-     * sanity checks on it, and allocate space to hold the image pixels.
-     * If anything fails, clean up as necessary and return NULL.
-     */
-    if (NULL == (in = fopen(fname, "r+b")) ||
-        NULL == (img = malloc(sizeof (*img))) ||
-        NULL != (img->img = NULL) || /* false clause for initialization */
-        1 != fread(&img->hdr, sizeof (img->hdr), 1, in) ||
-        MAX_OBJECT_WIDTH < img->hdr.width ||
-        MAX_OBJECT_HEIGHT < img->hdr.height ||
-        NULL == (img->img = malloc
-        (img->hdr.width * img->hdr.height * sizeof (img->img[0])))) {
-        if (NULL != img) {
-            if (NULL != img->img) {
-                free(img->img);
-            }
-            free(img);
-        }
-        if (NULL != in) {
-            (void)fclose(in);
-        }
-        return NULL;
-    }
 
-    /*
-     * Loop over rows from bottom to top.  Note that the file is stored
-     * in this order, whereas in memory we store the data in the reverse
-     * order(top to bottom).
-     */
-    for (y = img->hdr.height; y-- > 0; ) {
-
-        /* Loop over columns from left to right. */
-        for (x = 0; img->hdr.width > x; x++) {
-
-            /*
-             * Try to read one 8-bit pixel.  On failure, clean up and
-             * return NULL.
-             */
-            if (1 != fread(&pixel, sizeof (pixel), 1, in)) {
-                free(img->img);
-                free(img);
-                (void)fclose(in);
-                return NULL;
-            }
+/*
+ * photo_plane_bytes
+ *   DESCRIPTION: Get the size of the plane order copy that read_photo
+ *                makes for a room photo of a given size.  Setting the
+ *                ADVENTURE_PHOTO_PLANES environment variable to 0
+ *                disables plane order copies.
+ *   INPUTS: hdr -- height and width of the photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: bytes in the plane order copy, or 0 if none is made
+ *   SIDE EFFECTS: none
+ */
+uint32_t photo_plane_bytes(const photo_header_t* hdr) {
+    return (planes_enabled() ? 4 * PLANE_WIDTH(hdr->width) * hdr->height * sizeof (uint8_t) : 0);
+}
 
-            /* Store the pixel in the image data. */
-            img->img[img->hdr.width * y + x] = pixel;
-        }
-    }
 
-    /* All done.  Return success. */
-    (void)fclose(in);
-    return img;
+/*
+ * photo_memory
+ *   DESCRIPTION: Get the amount of memory held by a room photo that has
+ *                been read, which differs from photo_bytes if its column
+ *                or plane order copy has been added or removed(see
+ *                set_photo_columns and set_photo_planes).
+ *   INPUTS: p -- room photo pointer
+ *   OUTPUTS: copies -- bytes held by the photo's column and plane order
+ *                      copies
+ *   RETURN VALUE: bytes used by the photo
+ *   SIDE EFFECTS: none
+ */
+uint32_t photo_memory(const photo_t* p, uint32_t* copies) {
+    *copies = (NULL != p->columns ? p->hdr.width * p->hdr.height * sizeof (uint8_t) : 0) +
+              (NULL != p->planes ? 4 * PLANE_WIDTH(p->hdr.width) * p->hdr.height * sizeof (uint8_t) : 0);
+    return (photo_bytes(&p->hdr) - photo_column_bytes(&p->hdr) - photo_plane_bytes(&p->hdr) +
+            *copies);
 }
 
+
 /*
- * read_photo
- *   DESCRIPTION: Read size and pixel data in 5:6:5 RGB format from a
- *                photo file and create a photo structure from it.
- *                Code provided simply maps to 2:2:2 RGB.  You must
- *                replace this code with palette color selection, and
- *                must map the image pixels into the palette colors that
- *                you have defined.
- *   INPUTS: fname -- file name for input
+ * set_photo_columns
+ *   DESCRIPTION: Add or remove the copy of a room photo that stores its
+ *                pixels column by column.  The copy doubles the memory
+ *                used for the photo's pixels, but vertical lines are
+ *                drawn from it with sequential reads.
+ *   INPUTS: p -- room photo pointer
+ *           on -- non-zero to add the copy, or 0 to remove it
  *   OUTPUTS: none
- *   RETURN VALUE: pointer to newly allocated photo on success, or NULL
- *                 on failure
- *   SIDE EFFECTS: dynamically allocates memory for the photo
+ *   RETURN VALUE: 0 on success, or -1 if the copy cannot be made
+ *   SIDE EFFECTS: dynamically allocates or frees memory
  */
-photo_t* read_photo(const char* fname) {
-    FILE*    in;    /* input file               */
-    photo_t* p = NULL;    /* photo structure          */
-    uint16_t x;        /* index over image columns */
-    uint16_t y;        /* index over image rows    */
-    uint16_t pixel;    /* one pixel from the file  */
-	
-	struct octree_node level_2_octree[LEVEL_2_SIZE];
-	struct octree_node level_4_octree[LEVEL_4_SIZE];
-	uint32_t i;
-	uint16_t convert_i;
-
-	uint32_t red_average;
-	uint32_t green_average;
-	uint32_t blue_average;
-	
-	for(i = 0;i < LEVEL_4_SIZE;i++) {
-		if(i < LEVEL_2_SIZE) {
-			level_2_octree[i].red_msb = 0;
-			level_2_octree[i].green_msb = 0;
-			level_2_octree[i].blue_msb = 0;
-			level_2_octree[i].number_of_pixels = 0;
-			level_2_octree[i].level_4_index = i;
-			level_2_octree[i].palette_index = 0;
-		}
-		level_4_octree[i].red_msb = 0;
-		level_4_octree[i].green_msb = 0;
-		level_4_octree[i].blue_msb = 0;
-		level_4_octree[i].number_of_pixels = 0;
-		level_4_octree[i].level_4_index = i;
-		level_4_octree[i].palette_index = 0;
-	}
-	
-
-    /*
-     * Open the file, allocate the structure, read the header, do some
-     * sanity checks on it, and allocate space to hold the photo pixels.
-     * If anything fails, clean up as necessary and return NULL.
-     */
-    if (NULL == (in = fopen(fname, "r+b")) ||
-        NULL == (p = malloc(sizeof (*p))) ||
-        NULL != (p->img = NULL) || /* false clause for initialization */
-        1 != fread(&p->hdr, sizeof (p->hdr), 1, in) ||
-        MAX_PHOTO_WIDTH < p->hdr.width ||
-        MAX_PHOTO_HEIGHT < p->hdr.height ||
-        NULL == (p->img = malloc
-        (p->hdr.width * p->hdr.height * sizeof (p->img[0])))) {
-        if (NULL != p) {
-            if (NULL != p->img) {
-                free(p->img);
-            }
-            free(p);
-        }
-        if (NULL != in) {
-            (void)fclose(in);
+int32_t set_photo_columns(photo_t* p, int32_t on) {
+    if (!on) {
+        free(p->columns);
+        p->columns = NULL;
+        return 0;
+    }
+    if (NULL == p->columns) {
+        if (NULL == (p->columns = malloc(p->hdr.width * p->hdr.height * sizeof (p->columns[0])))) {
+            return -1;
         }
-        return NULL;
+        transpose_pixels(p->columns, p->img, p->hdr.width, p->hdr.height);
     }
-	
-	uint32_t image_size = p->hdr.width * p->hdr.height;
-	uint16_t pixels_array[image_size];
+    return 0;
+}
 
-    /*
-     * Loop over rows from bottom to top.  Note that the file is stored
-     * in this order, whereas in memory we store the data in the reverse
-     * order(top to bottom).
-     */
-    for (y = p->hdr.height; y-- > 0; ) {
 
-        /* Loop over columns from left to right. */
-        for (x = 0; p->hdr.width > x; x++) {
+/*
+ * set_photo_planes
+ *   DESCRIPTION: Add or remove the copy of a room photo that stores its
+ *                pixels in mode X plane order(see PLANE_WIDTH).  The copy
+ *                doubles the memory used for the photo's pixels, but
+ *                horizontal lines of the photo are drawn from it as four
+ *                block copies.
+ *   INPUTS: p -- room photo pointer
+ *           on -- non-zero to add the copy, or 0 to remove it
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or -1 if the copy cannot be made
+ *   SIDE EFFECTS: dynamically allocates or frees memory
+ */
+int32_t set_photo_planes(photo_t* p, int32_t on) {
+    uint32_t       pw;    /* bytes in each row of a plane image */
+    uint32_t       size;  /* bytes in each plane image          */
+    const uint8_t* src;   /* current row of photo               */
+    uint8_t*       dst;   /* current row of first plane image   */
+    uint32_t       x;     /* index over photo columns           */
+    uint32_t       y;     /* index over photo rows              */
 
-            /*
-             * Try to read one 16-bit pixel.  On failure, clean up and
-             * return NULL.
-             */
-            if (1 != fread(&pixel, sizeof (pixel), 1, in)) {
-                free(p->img);
-                free(p);
-                (void)fclose(in);
-                return NULL;
-            }
-			
-			pixels_array[p->hdr.width * y + x] = pixel;
-			/* Convert 5:6:5 RBG values to 4:4:4 index */
-			convert_i = ((pixel >> 12) << 8) | (((pixel >> 7) & 0xF) << 4) | ((pixel >> 1) & 0xF); 
-			level_4_octree[convert_i].red_msb += (pixel >> 11) & 0x1F;
-			level_4_octree[convert_i].green_msb += (pixel >> 5) & 0x3F;
-			level_4_octree[convert_i].blue_msb += pixel & 0x1F;
-			level_4_octree[convert_i].number_of_pixels++;
-            /*
-             * 16-bit pixel is coded as 5:6:5 RGB(5 bits red, 6 bits green,
-             * and 6 bits blue).  We change to 2:2:2, which we've set for the
-             * game objects.  You need to use the other 192 palette colors
-             * to specialize the appearance of each photo.
-             *
-             * In this code, you need to calculate the p->palette values,
-             * which encode 6-bit RGB as arrays of three uint8_t's.  When
-             * the game puts up a photo, you should then change the palette
-             * to match the colors needed for that photo.
-             */
-			 /*
-            p->img[p->hdr.width * y + x] = (((pixel >> 14) << 4) | (((pixel >> 9) & 0x3) << 2) | ((pixel >> 3) & 0x3));
-			*/
-		}
+    if (!on) {
+        free(p->planes);
+        p->planes = NULL;
+        return 0;
     }
-
-    /* All done.  Return success. */
-    (void)fclose(in);
-	
-	/* sort octree based on cluster size of a color */
-	qsort(level_4_octree, LEVEL_4_SIZE, sizeof(struct octree_node), octree_qsort_pixel);
-	
+    if (NULL != p->planes) {
+        return 0;
+    }
+    pw = PLANE_WIDTH(p->hdr.width);
+    size = pw * p->hdr.height;
+    if (NULL == (p->planes = calloc(4 * size, sizeof (p->planes[0])))) {
+        return -1;
+    }
+    for (y = 0; p->hdr.height > y; y++) {
+        src = &p->img[p->hdr.width * y];
+        dst = &p->planes[pw * y];
+        for (x = 0; p->hdr.width > x; x++) {
+            dst[size * (x & 3) + (x >> 2)] = src[x];
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * add_photo_copies
+ *   DESCRIPTION: Add the column and plane order copies that read_photo
+ *                makes for a room photo(see photo_column_bytes and
+ *                photo_plane_bytes), if they are missing.  A photo
+ *                without a copy is drawn from its pixel data instead, so
+ *                failures are ignored.
+ *   INPUTS: p -- room photo pointer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: dynamically allocates memory
+ */
+void add_photo_copies(photo_t* p) {
+    if (0 != photo_column_bytes(&p->hdr)) {
+        (void)set_photo_columns(p, 1);
+    }
+    if (0 != photo_plane_bytes(&p->hdr)) {
+        (void)set_photo_planes(p, 1);
+    }
+}
+
+
+/*
+ * free_photo
+ *   DESCRIPTION: Release a room photo read by read_photo.
+ *   INPUTS: p -- room photo pointer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees memory or unmaps the photo's cache file
+ */
+void free_photo(photo_t* p) {
+    if (NULL != p->map_base) {
+        (void)munmap(p->map_base, p->map_len);
+    }
+    else {
+        free(p->img);
+    }
+    free(p->lut);
+    free(p->columns);
+    free(p->planes);
+    free(p);
+}
+
+
+/*
+ * touch_photo
+ *   DESCRIPTION: Fault in the pages holding a room photo's pixel data
+ *                so that drawing the photo later does not stall on them
+ *                (pixel data taken from the photo cache are mapped from
+ *                the cache file and read on first access).
+ *   INPUTS: p -- room photo pointer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void touch_photo(const photo_t* p) {
+    const volatile uint8_t* img = p->img;  /* pixel data        */
+    uint32_t                len;           /* pixel data length */
+    uint32_t                i;             /* index over pages  */
+
+    len = p->hdr.width * p->hdr.height;
+    for (i = 0; len > i; i += 4096) {
+        (void)img[i];
+    }
+}
+
+
+/*
+ * prep_room
+ *   DESCRIPTION: Prepare a new room for display.  You might want to set
+ *                up the VGA palette registers according to the color
+ *                palette that you chose for this room.
+ *   INPUTS: r -- pointer to the new room
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes recorded cur_room for this file; keeps the
+ *                 room's photo in memory until another room is prepared
+ */
+void prep_room(const room_t* r) {
+    TRACE_BEGIN("prep_room");
+
+    /* Record the current room. */
+	photo_t* new_room_photo = room_pin_photo(r);
+
+	/* A preview uses only the fixed colors, so leave the palette alone. */
+	if (NULL != new_room_photo && !new_room_photo->preview) {
+		fill_my_palette(new_room_photo->palette);
+	}
+    cur_room = r;
+
+    TRACE_END("prep_room");
+}
+
+
+/*
+ * map_image_file
+ *   DESCRIPTION: Map a room photo or object image file read-only into
+ *                our address space so that the loaders can work directly
+ *                from the file data rather than issuing one read per
+ *                pixel.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: len -- size of the file(and of the mapping) in bytes
+ *            st -- status of the file(size, modification time, etc.)
+ *   RETURN VALUE: pointer to the start of the mapped file on success,
+ *                 or NULL on failure(including empty files, for which
+ *                 errno is set to EINVAL)
+ *   SIDE EFFECTS: caller must release the mapping with munmap
+ */
+static const uint8_t* map_image_file(const char* fname, size_t* len, struct stat* st) {
+    int   fd;   /* file descriptor for image file */
+    void* data; /* mapped file data               */
+
+    if (-1 == (fd = open(fname, O_RDONLY))) {
+        return NULL;
+    }
+    if (0 != fstat(fd, st) || 0 >= st->st_size) {
+        (void)close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    data = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    /* The mapping remains valid after the descriptor is closed. */
+    (void)close(fd);
+    if (MAP_FAILED == data) {
+        return NULL;
+    }
+    *len = st->st_size;
+    return data;
+}
+
+
+/*
+ * hash_image_file
+ *   DESCRIPTION: Calculate a 64-bit hash of a file's contents for use as
+ *                part of a photo cache key.  The hash is FNV-1a applied
+ *                to 32-bit words(with the tail of the file mixed in a
+ *                byte at a time), which is several times faster than
+ *                hashing one byte at a time.
+ *   INPUTS: data -- file contents
+ *           len -- size of file in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: the hash
+ *   SIDE EFFECTS: none
+ */
+static uint64_t hash_image_file(const uint8_t* data, size_t len) {
+    uint64_t hash = 0xCBF29CE484222325ULL; /* FNV offset basis       */
+    uint32_t word;                         /* one word from the file */
+    size_t   i;                            /* index over file        */
+
+    for (i = 0; len >= i + sizeof (word); i += sizeof (word)) {
+        (void)memcpy(&word, &data[i], sizeof (word));
+        hash = (hash ^ word) * 0x100000001B3ULL;
+    }
+    for (; len > i; i++) {
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+
+/*
+ * photo_cache_name
+ *   DESCRIPTION: Construct the name of the cache file for a room photo.
+ *                Cache files live in the directory named by the
+ *                ADVENTURE_PHOTO_CACHE environment variable(by default,
+ *                PHOTO_CACHE_DIR); each is named after the photo's path
+ *                with slashes replaced by underscores.  Setting the
+ *                variable to an empty string disables the cache.
+ *   INPUTS: fname -- file name of room photo
+ *   OUTPUTS: cname -- cache file name(PHOTO_CACHE_PATH_LEN bytes)
+ *   RETURN VALUE: 0 on success, -1 if the cache is disabled or the
+ *                 name does not fit
+ *   SIDE EFFECTS: none
+ */
+static int32_t photo_cache_name(const char* fname, char* cname) {
+    const char* dir;  /* cache directory          */
+    int32_t     len;  /* length of directory part */
+    int32_t     i;    /* index over file name     */
+
+    if (NULL == (dir = getenv("ADVENTURE_PHOTO_CACHE"))) {
+        dir = PHOTO_CACHE_DIR;
+    }
+    if ('\0' == *dir || PHOTO_CACHE_NAME_LEN <= strlen(fname)) {
+        return -1;
+    }
+    len = snprintf(cname, PHOTO_CACHE_PATH_LEN, "%s/%s.q", dir, fname);
+    if (0 > len || PHOTO_CACHE_PATH_LEN <= len) {
+        return -1;
+    }
+    for (i = strlen(dir) + 1; '\0' != cname[i]; i++) {
+        if ('/' == cname[i]) {
+            cname[i] = '_';
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * columns_enabled
+ *   DESCRIPTION: Decide whether photos and object images get copies that
+ *                store their pixels column by column(see
+ *                set_photo_columns).  Setting the ADVENTURE_PHOTO_COLUMNS
+ *                environment variable to 0 disables the copies; by
+ *                default, they are made.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: non-zero if column copies are enabled, or 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t columns_enabled() {
+    const char* env;  /* value of ADVENTURE_PHOTO_COLUMNS */
+
+    return (NULL == (env = getenv("ADVENTURE_PHOTO_COLUMNS")) || 0 != strtol(env, NULL, 10));
+}
+
+
+/*
+ * transpose_pixels
+ *   DESCRIPTION: Copy an image's pixels into a buffer column by column,
+ *                so that pixel (x,y) of the image is found at offset
+ *                height * x + y in the buffer.  The image is transposed
+ *                in square tiles so that both the reads and the writes
+ *                for a tile stay within a few cache lines.
+ *   INPUTS: src -- image pixels stored row by row
+ *           width -- image width in pixels
+ *           height -- image height in pixels
+ *   OUTPUTS: dst -- buffer of width * height bytes for the copy
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void transpose_pixels(uint8_t* dst, const uint8_t* src, uint32_t width, uint32_t height) {
+    uint32_t tx;     /* first column of tile       */
+    uint32_t ty;     /* first row of tile          */
+    uint32_t x_end;  /* column after tile          */
+    uint32_t y_end;  /* row after tile             */
+    uint32_t x;      /* index over columns of tile */
+    uint32_t y;      /* index over rows of tile    */
+
+    for (ty = 0; height > ty; ty += COLUMN_TILE) {
+        y_end = (height - ty > COLUMN_TILE ? ty + COLUMN_TILE : height);
+        for (tx = 0; width > tx; tx += COLUMN_TILE) {
+            x_end = (width - tx > COLUMN_TILE ? tx + COLUMN_TILE : width);
+            for (x = tx; x_end > x; x++) {
+                for (y = ty; y_end > y; y++) {
+                    dst[height * x + y] = src[width * y + x];
+                }
+            }
+        }
+    }
+}
+
+
+/*
+ * planes_enabled
+ *   DESCRIPTION: Decide whether room photos get copies that store their
+ *                pixels in mode X plane order(see set_photo_planes).
+ *                Setting the ADVENTURE_PHOTO_PLANES environment variable
+ *                to 0 disables the copies; by default, they are made.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: non-zero if plane order copies are enabled, or 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t planes_enabled() {
+    const char* env;  /* value of ADVENTURE_PHOTO_PLANES */
+
+    return (NULL == (env = getenv("ADVENTURE_PHOTO_PLANES")) || 0 != strtol(env, NULL, 10));
+}
+
+
+/*
+ * photo_lut_enabled
+ *   DESCRIPTION: Decide whether read_photo builds a lookup table for each
+ *                photo and maps the photo's pixels through it(see
+ *                build_photo_lut).  Setting the ADVENTURE_PHOTO_LUT
+ *                environment variable to a non-zero value enables the
+ *                tables; by default, pixels are mapped by octree node.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: non-zero if lookup tables are enabled, or 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t photo_lut_enabled() {
+    const char* env;  /* value of ADVENTURE_PHOTO_LUT */
+
+    return (NULL != (env = getenv("ADVENTURE_PHOTO_LUT")) && 0 != strtol(env, NULL, 10));
+}
+
+
+/*
+ * read_photo_cache
+ *   DESCRIPTION: Look up a room photo in the on-disk cache of quantized
+ *                photos.  An entry is used only if it was produced from
+ *                a source file with the same name, size, modification
+ *                time, and content hash by the current quantizer.  On
+ *                a hit, the photo's pixel data are used directly from
+ *                the mapped cache file.
+ *   INPUTS: fname -- file name of room photo
+ *           key -- cache key describing the source file
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to newly allocated photo on a hit, or NULL
+ *   SIDE EFFECTS: dynamically allocates memory for the photo; maps the
+ *                 cache file
+ */
+static photo_t* read_photo_cache(const char* fname, const photo_cache_t* key) {
+    char                 cname[PHOTO_CACHE_PATH_LEN]; /* cache file name    */
+    struct stat          st;                          /* cache file status  */
+    size_t               len;                         /* cache file size    */
+    const uint8_t*       data;                        /* mapped cache file  */
+    const photo_cache_t* entry;                       /* cache entry header */
+    photo_t*             p;                           /* photo structure    */
+
+    if (0 != photo_cache_name(fname, cname) ||
+        NULL == (data = map_image_file(cname, &len, &st))) {
+        return NULL;
+    }
+    entry = (const photo_cache_t*)data;
+    if (sizeof (*entry) > len ||
+        0 != memcmp(entry, key, offsetof(photo_cache_t, palette)) ||
+        sizeof (*entry) + entry->hdr.width * entry->hdr.height != len ||
+        NULL == (p = malloc(sizeof (*p)))) {
+        (void)munmap((void*)data, len);
+        return NULL;
+    }
+    p->hdr = entry->hdr;
+    (void)memcpy(p->palette, entry->palette, sizeof (p->palette));
+    p->img = (uint8_t*)(data + sizeof (*entry));
+    p->map_base = (void*)data;
+    p->map_len = len;
+    p->lut = NULL;
+    p->preview = 0;
+    p->columns = NULL;
+    p->planes = NULL;
+    return p;
+}
+
+
+/*
+ * write_photo_cache
+ *   DESCRIPTION: Store a quantized room photo in the on-disk cache.  The
+ *                entry is written to a temporary file and renamed over
+ *                any existing(stale) entry, so readers never see a
+ *                partial entry.  Failures are ignored: the cache only
+ *                affects startup time.
+ *   INPUTS: fname -- file name of room photo
+ *           key -- cache key describing the source file
+ *           p -- the quantized photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may create the cache directory and write a file in it
+ */
+static void write_photo_cache(const char* fname, const photo_cache_t* key, const photo_t* p) {
+    char          cname[PHOTO_CACHE_PATH_LEN];    /* cache file name     */
+    char          tname[PHOTO_CACHE_PATH_LEN + 16]; /* temporary file name */
+    photo_cache_t entry;                          /* cache entry header  */
+    FILE*         out;                            /* temporary file      */
+    int32_t       ok;                             /* all writes worked   */
+
+    if (0 != photo_cache_name(fname, cname)) {
+        return;
+    }
+
+    /* Create the cache directory(it is the part before the last slash). */
+    (void)strcpy(tname, cname);
+    *strrchr(tname, '/') = '\0';
+    (void)mkdir(tname, 0777);
+
+    (void)snprintf(tname, sizeof (tname), "%s.%d", cname, (int)getpid());
+    if (NULL == (out = fopen(tname, "wb"))) {
+        return;
+    }
+    (void)memcpy(&entry, key, sizeof (entry));
+    (void)memcpy(entry.palette, p->palette, sizeof (entry.palette));
+    ok = (1 == fwrite(&entry, sizeof (entry), 1, out) &&
+          1 == fwrite(p->img, p->hdr.width * p->hdr.height, 1, out));
+    if (0 != fclose(out) || !ok || 0 != rename(tname, cname)) {
+        (void)unlink(tname);
+    }
+}
+
+
+/*
+ * atlas_alloc
+ *   DESCRIPTION: Allocate a block for an object image from the atlas.
+ *                Blocks are never released.  Caller must hold obj_lock.
+ *   INPUTS: bytes -- size of block
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to block(aligned to OBJ_ATLAS_ALIGN bytes),
+ *                 or NULL on failure
+ *   SIDE EFFECTS: may dynamically allocate memory for the atlas
+ */
+static void* atlas_alloc(size_t bytes) {
+    uint8_t* block; /* the block allocated */
+    size_t   chunk; /* size of new chunk   */
+
+    bytes = (bytes + OBJ_ATLAS_ALIGN - 1) & ~(size_t)(OBJ_ATLAS_ALIGN - 1);
+    if (atlas_left < bytes) {
+        chunk = (OBJ_ATLAS_CHUNK < bytes ? bytes : OBJ_ATLAS_CHUNK);
+        if (0 != posix_memalign((void**)&block, OBJ_ATLAS_ALIGN, chunk)) {
+            return NULL;
+        }
+        atlas_next = block;
+        atlas_left = chunk;
+    }
+    block = atlas_next;
+    atlas_next += bytes;
+    atlas_left -= bytes;
+    return block;
+}
+
+
+/*
+ * find_runs
+ *   DESCRIPTION: Find the runs of opaque pixels in a row or column of an
+ *                object image.
+ *   INPUTS: px -- first pixel of row or column
+ *           n -- number of pixels in row or column
+ *           stride -- distance between successive pixels
+ *   OUTPUTS: runs -- the runs found(NULL to count them only)
+ *   RETURN VALUE: number of runs
+ *   SIDE EFFECTS: none
+ */
+static int32_t find_runs(const uint8_t* px, int32_t n, int32_t stride, obj_run_t* runs) {
+    int32_t count = 0; /* number of runs found  */
+    int32_t start;     /* first pixel of run    */
+    int32_t i;         /* index over pixels     */
+
+    for (i = 0; n > i; ) {
+        if (OBJ_CLR_TRANSP == px[stride * i]) {
+            i++;
+            continue;
+        }
+        for (start = i; n > i && OBJ_CLR_TRANSP != px[stride * i]; i++) { }
+        if (NULL != runs) {
+            runs[count].start = start;
+            runs[count].len = i - start;
+        }
+        count++;
+    }
+    return count;
+}
+
+
+/*
+ * read_obj_image
+ *   DESCRIPTION: Read size and pixel data in 2:2:2 RGB format from a
+ *                photo file and create an image structure from it,
+ *                along with a copy of the pixels stored column by column
+ *                (see set_photo_columns) and the runs of opaque pixels
+ *                in each row and column.  The image is placed in the
+ *                object image atlas.  If an identical file has already
+ *                been read, its image is returned instead.  Safe to call
+ *                from several threads at once.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to image on success, or NULL on failure
+ *   SIDE EFFECTS: allocates memory for the image from the atlas
+ */
+image_t* read_obj_image(const char* fname) {
+    const uint8_t* data;       /* mapped file contents       */
+    size_t         len;        /* size of mapped file        */
+    struct stat    st;         /* file status                */
+    const uint8_t* src;        /* current row in the file    */
+    image_t*       img;        /* image structure            */
+    photo_header_t hdr;        /* height and width of image  */
+    uint64_t       hash;       /* hash of file contents      */
+    uint32_t       pixels;     /* number of pixels in image  */
+    uint32_t       n_cols;     /* bytes in column copy       */
+    int32_t        n_runs;     /* number of opaque runs      */
+    uint8_t*       block;      /* atlas block for image      */
+    obj_run_t*     runs;       /* runs being filled in       */
+    uint16_t*      row_run;    /* first run of each row      */
+    uint16_t*      col_run;    /* first run of each column   */
+    uint16_t       x;          /* index over image columns   */
+    uint16_t       y;          /* index over image rows      */
+
+    /*
+     * Map the file, read the header, and do some sanity checks on it
+     * (including that the file holds all of the pixels).  If anything
+     * fails, clean up as necessary and return NULL.
+     */
+    if (NULL == (data = map_image_file(fname, &len, &st))) {
+        return NULL;
+    }
+    if (sizeof (hdr) > len ||
+        NULL == memcpy(&hdr, data, sizeof (hdr)) ||
+        MAX_OBJECT_WIDTH < hdr.width ||
+        MAX_OBJECT_HEIGHT < hdr.height ||
+        sizeof (hdr) + hdr.width * hdr.height > len) {
+        (void)munmap((void*)data, len);
+        return NULL;
+    }
+    pixels = hdr.width * hdr.height;
+    src = data + sizeof (hdr);
+
+    /*
+     * Count the opaque runs(vertical flipping does not change the
+     * count).  This and the hash read the whole file, so they are done
+     * before taking the lock.
+     */
+    n_runs = 0;
+    for (y = 0; hdr.height > y; y++) {
+        n_runs += find_runs(&src[hdr.width * y], hdr.width, 1, NULL);
+    }
+    for (x = 0; hdr.width > x; x++) {
+        n_runs += find_runs(&src[x], hdr.height, hdr.width, NULL);
+    }
+    hash = hash_image_file(data, sizeof (hdr) + pixels);
+
+    /*
+     * Share the image of an identical file already read.  Rows are
+     * stored in the file from bottom to top(see below).  The lock is
+     * held until the new image is on the list, so that identical files
+     * read at the same time still share one image.
+     */
+    (void)pthread_mutex_lock(&obj_lock);
+    for (img = obj_images; NULL != img; img = img->next) {
+        if (hash != img->hash || hdr.width != img->hdr.width || hdr.height != img->hdr.height) {
+            continue;
+        }
+        for (y = 0; hdr.height > y; y++) {
+            if (0 != memcmp(&img->img[hdr.width * y], &src[hdr.width * (hdr.height - 1 - y)],
+                            hdr.width)) {
+                break;
+            }
+        }
+        if (hdr.height == y) {
+            (void)pthread_mutex_unlock(&obj_lock);
+            (void)munmap((void*)data, len);
+            return img;
+        }
+    }
+
+    /*
+     * Allocate one atlas block for the structure, the pixels, the
+     * column copy(unless disabled), and the runs.
+     */
+    n_cols = (columns_enabled() ? pixels : 0);
+    if (NULL == (block = atlas_alloc(sizeof (*img) +
+                                     (hdr.height + hdr.width + 2) * sizeof (row_run[0]) +
+                                     n_runs * sizeof (runs[0]) + pixels + n_cols))) {
+        (void)pthread_mutex_unlock(&obj_lock);
+        (void)munmap((void*)data, len);
+        return NULL;
+    }
+    img = (image_t*)block;
+    img->hdr = hdr;
+    img->row_run = row_run = (uint16_t*)(block + sizeof (*img));
+    img->col_run = col_run = row_run + hdr.height + 1;
+    img->runs = runs = (obj_run_t*)(col_run + hdr.width + 1);
+    img->img = (uint8_t*)(runs + n_runs);
+    img->columns = (0 != n_cols ? img->img + pixels : NULL);
+    img->hash = hash;
+
+    /*
+     * Copy rows from bottom to top.  Note that the file is stored in
+     * this order, whereas in memory we store the data in the reverse
+     * order(top to bottom).  Object pixels need no conversion, so each
+     * row moves as a single block.
+     */
+    for (y = hdr.height; y-- > 0; src += hdr.width) {
+        (void)memcpy(&img->img[hdr.width * y], src, hdr.width);
+    }
+    (void)munmap((void*)data, len);
+
+    /*
+     * Objects are small, so every object gets a column copy unless they
+     * are disabled.  Without one, vertical lines read the rows instead.
+     */
+    if (NULL != img->columns) {
+        transpose_pixels(img->columns, img->img, hdr.width, hdr.height);
+    }
+
+    /* Record the runs of each row, then of each column. */
+    for (n_runs = y = 0; hdr.height > y; y++) {
+        row_run[y] = n_runs;
+        n_runs += find_runs(&img->img[hdr.width * y], hdr.width, 1, &runs[n_runs]);
+    }
+    row_run[y] = n_runs;
+    for (x = 0; hdr.width > x; x++) {
+        col_run[x] = n_runs;
+        n_runs += find_runs(&img->img[x], hdr.height, hdr.width, &runs[n_runs]);
+    }
+    col_run[x] = n_runs;
+
+    /* All done.  Return success. */
+    img->next = obj_images;
+    obj_images = img;
+    (void)pthread_mutex_unlock(&obj_lock);
+    return img;
+}
+
+/*
+ * read_photo_header
+ *   DESCRIPTION: Read the size of a room photo without reading its
+ *                pixels.  The same sanity checks are applied as in
+ *                read_photo, so a photo that passes them can later be
+ *                read unless the file changes.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: hdr -- height and width of the photo
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: none
+ */
+int32_t read_photo_header(const char* fname, photo_header_t* hdr) {
+    int         fd; /* file descriptor for photo file */
+    struct stat st; /* file status(for size)          */
+
+    if (-1 == (fd = open(fname, O_RDONLY))) {
+        return -1;
+    }
+    if (0 != fstat(fd, &st) ||
+        sizeof (*hdr) != read(fd, hdr, sizeof (*hdr)) ||
+        MAX_PHOTO_WIDTH < hdr->width ||
+        MAX_PHOTO_HEIGHT < hdr->height ||
+        sizeof (*hdr) + hdr->width * hdr->height * sizeof (uint16_t) > st.st_size) {
+        (void)close(fd);
+        return -1;
+    }
+    (void)close(fd);
+    return 0;
+}
+
+
+/*
+ * read_photo
+ *   DESCRIPTION: Read size and pixel data in 5:6:5 RGB format from a
+ *                photo file and create a photo structure from it.
+ *                The quantized photo is taken from the on-disk photo
+ *                cache when a valid entry exists; otherwise, the photo
+ *                is quantized(see quantize_photo) and the result is
+ *                stored in the cache for the next run.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to newly allocated photo on success, or NULL
+ *                 on failure; errno is then ENOMEM only if memory ran
+ *                 out, so that callers can tell a bad file from a
+ *                 shortage that releasing memory might cure
+ *   SIDE EFFECTS: dynamically allocates memory for the photo; may read
+ *                 and write the photo cache
+ */
+photo_t* read_photo(const char* fname) {
+    const uint8_t* data;     /* mapped file contents     */
+    size_t         len;      /* size of mapped file      */
+    struct stat    st;       /* file status              */
+    photo_t*       p = NULL; /* photo structure          */
+    photo_cache_t  key;      /* photo cache key          */
+
+    /*
+     * Map the file, read the header, and do some sanity checks on it
+     * (including that the file holds all of the pixels).
+     */
+    if (NULL == (data = map_image_file(fname, &len, &st))) {
+        return NULL;
+    }
+    (void)memset(&key, 0, sizeof (key));
+    if (sizeof (key.hdr) > len ||
+        NULL == memcpy(&key.hdr, data, sizeof (key.hdr)) ||
+        MAX_PHOTO_WIDTH < key.hdr.width ||
+        MAX_PHOTO_HEIGHT < key.hdr.height ||
+        sizeof (key.hdr) + key.hdr.width * key.hdr.height * sizeof (uint16_t) > len) {
+        (void)munmap((void*)data, len);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* Use the cached photo if it is still valid. */
+    key.magic = PHOTO_CACHE_MAGIC;
+    key.variant = PHOTO_CACHE_VARIANT + (photo_lut_enabled() ? PHOTO_CACHE_LUT : 0);
+    key.src_size = st.st_size;
+    key.src_mtime = st.st_mtim.tv_sec;
+    key.src_mtime_ns = st.st_mtim.tv_nsec;
+    key.src_hash = hash_image_file(data, len);
+    (void)strncpy(key.src_name, fname, sizeof (key.src_name) - 1);
+    TRACE_BEGIN("read_photo_cache");
+    p = read_photo_cache(fname, &key);
+    TRACE_END("read_photo_cache");
+    if (NULL != p) {
+        add_photo_copies(p);
+        (void)munmap((void*)data, len);
+        return p;
+    }
+
+    /*
+     * Allocate the structure and space to hold the photo pixels.  If
+     * anything fails, clean up as necessary and return NULL.
+     */
+    if (NULL == (p = malloc(sizeof (*p))) ||
+        NULL != (p->img = NULL) || /* false clause for initialization */
+        NULL == (p->img = malloc
+        (key.hdr.width * key.hdr.height * sizeof (p->img[0])))) {
+        if (NULL != p) {
+            free(p);
+        }
+        (void)munmap((void*)data, len);
+        errno = ENOMEM;
+        return NULL;
+    }
+    p->hdr = key.hdr;
+    p->map_base = NULL;
+    p->map_len = 0;
+    p->lut = NULL;
+    p->preview = 0;
+    p->columns = NULL;
+    p->planes = NULL;
+
+    /*
+     * The header is four bytes long, so the 16-bit pixels that follow
+     * it in the (page-aligned) mapping are naturally aligned.
+     */
+    quantize_photo(p, (const uint16_t*)(data + sizeof (p->hdr)));
+    TRACE_BEGIN("write_photo_cache");
+    write_photo_cache(fname, &key, p);
+    TRACE_END("write_photo_cache");
+    add_photo_copies(p);
+
+    /* All done.  Return success. */
+    (void)munmap((void*)data, len);
+    return p;
+}
+
+
+/*
+ * read_photo_preview
+ *   DESCRIPTION: Read a room photo quickly for display while the photo
+ *                itself is read.  Rather than choosing a palette, each
+ *                pixel is mapped to the nearest of the 64 fixed colors
+ *                below the photo's colors, which hold 2:2:2 RGB(the top
+ *                two bits of each component, as installed by
+ *                fill_palette_mode_x), so the preview needs no palette
+ *                change.  The photo cache is not used.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to newly allocated photo on success, or NULL
+ *                 on failure
+ *   SIDE EFFECTS: dynamically allocates memory for the photo
+ */
+photo_t* read_photo_preview(const char* fname) {
+    const uint8_t* data;     /* mapped file contents      */
+    size_t         len;      /* size of mapped file       */
+    struct stat    st;       /* file status               */
+    photo_t*       p = NULL; /* photo structure           */
+    uint8_t        color_of[LEVEL_4_SIZE]; /* 2:2:2 color for each node */
+    uint32_t       i;        /* index over level 4 nodes  */
+
+    /*
+     * Map the file, allocate the structure, read the header, do some
+     * sanity checks on it(including that the file holds all of the
+     * pixels), and allocate space to hold the photo pixels.  If anything
+     * fails, clean up as necessary and return NULL.
+     */
+    if (NULL == (data = map_image_file(fname, &len, &st))) {
+        return NULL;
+    }
+    if (sizeof (p->hdr) > len ||
+        NULL == (p = calloc(1, sizeof (*p))) ||
+        NULL == memcpy(&p->hdr, data, sizeof (p->hdr)) ||
+        MAX_PHOTO_WIDTH < p->hdr.width ||
+        MAX_PHOTO_HEIGHT < p->hdr.height ||
+        sizeof (p->hdr) + p->hdr.width * p->hdr.height * sizeof (uint16_t) > len ||
+        NULL == (p->img = malloc
+        (p->hdr.width * p->hdr.height * sizeof (p->img[0])))) {
+        if (NULL != p) {
+            free(p);
+        }
+        (void)munmap((void*)data, len);
+        return NULL;
+    }
+    p->preview = 1;
+
+    /* The 2:2:2 color keeps the top two bits of each 4-bit component. */
+    for (i = 0; LEVEL_4_SIZE > i; i++) {
+        color_of[i] = (((i >> 10) & 3) << 4) | (((i >> 6) & 3) << 2) | ((i >> 2) & 3);
+    }
+    simd_remap((const uint16_t*)(data + sizeof (p->hdr)), p->img,
+               p->hdr.width, p->hdr.height, color_of);
+
+    /* All done.  Return success. */
+    (void)munmap((void*)data, len);
+    return p;
+}
+
+
+/*
+ * octree_node_before
+ *   DESCRIPTION: Decide whether one level 4 octree node ranks before
+ *                another when choosing palette colors: nodes with more
+ *                pixels come first, and ties go to the lower index.
+ *   INPUTS: nodes -- the level 4 octree
+ *           a, b -- indices of the two nodes
+ *   OUTPUTS: none
+ *   RETURN VALUE: non-zero if node a ranks before node b, or 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t octree_node_before(const struct octree_node* nodes, uint16_t a, uint16_t b) {
+    return (nodes[a].number_of_pixels > nodes[b].number_of_pixels ||
+            (nodes[a].number_of_pixels == nodes[b].number_of_pixels && a < b));
+}
+
+
+/*
+ * octree_heap_sift
+ *   DESCRIPTION: Restore the heap property below one entry of a heap of
+ *                level 4 octree node indices.  The lowest-ranked node
+ *                (see octree_node_before) is kept at the root.
+ *   INPUTS: nodes -- the level 4 octree
+ *           heap -- the heap of node indices
+ *           n -- number of entries in heap
+ *           pos -- entry that may be out of place
+ *   OUTPUTS: heap -- the heap, with the property restored
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void octree_heap_sift(const struct octree_node* nodes, uint16_t* heap,
+                             int32_t n, int32_t pos) {
+    int32_t  child; /* child of pos that ranks lower */
+    uint16_t tmp;   /* used to swap entries          */
+
+    while (n > (child = 2 * pos + 1)) {
+        if (n > child + 1 && octree_node_before(nodes, heap[child], heap[child + 1])) {
+            child++;
+        }
+        if (!octree_node_before(nodes, heap[pos], heap[child])) {
+            break;
+        }
+        tmp = heap[pos];
+        heap[pos] = heap[child];
+        heap[child] = tmp;
+        pos = child;
+    }
+}
+
+
+/*
+ * slab_histogram_job
+ *   DESCRIPTION: Pool job that counts the pixels of one slab of a photo
+ *                into the slab's histogram.
+ *   INPUTS: arg -- the photo_slab_t
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void slab_histogram_job(void* arg) {
+    photo_slab_t* slab = arg;
+
+    TRACE_BEGIN("slab histogram");
+    (void)memset(slab->hist, 0, sizeof (slab->hist));
+    simd_histogram(slab->src, slab->width * slab->rows, slab->hist);
+    TRACE_END("slab histogram");
+}
+
+
+/*
+ * slab_remap_job
+ *   DESCRIPTION: Pool job that maps the pixels of one slab of a photo to
+ *                palette colors.
+ *   INPUTS: arg -- the photo_slab_t
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void slab_remap_job(void* arg) {
+    photo_slab_t* slab = arg;
+
+    TRACE_BEGIN("slab remap");
+    if (NULL != slab->lut) {
+        simd_remap_lut(slab->src, slab->dst, slab->width, slab->rows, slab->lut);
+    }
+    else {
+        simd_remap(slab->src, slab->dst, slab->width, slab->rows, slab->palette_of);
+    }
+    TRACE_END("slab remap");
+}
+
+
+/*
+ * run_slab_jobs
+ *   DESCRIPTION: Run a job for each slab of a photo in the worker pool
+ *                and wait for all of them.  A job that cannot be queued
+ *                is run in the calling thread.
+ *   INPUTS: pool -- the pool
+ *           slabs -- the slabs
+ *           n_slabs -- number of slabs
+ *           fn -- job to run for each slab
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void run_slab_jobs(pool_t* pool, photo_slab_t* slabs, int32_t n_slabs,
+                          pool_fn_t fn) {
+    pool_group_t grp = {0}; /* the slab jobs      */
+    int32_t      i;         /* index over slabs   */
+
+    for (i = 0; n_slabs > i; i++) {
+        if (0 != pool_submit(pool, &grp, fn, &slabs[i])) {
+            (*fn)(&slabs[i]);
+        }
+    }
+    pool_wait(pool, &grp);
+}
+
+
+/*
+ * quantize_photo
+ *   DESCRIPTION: Select an optimized palette for a photo using a
+ *                two-level octree(128 colors from level 4 and 64 from
+ *                level 2) and map the photo's pixels into those colors.
+ *                The 128 most populous level 4 nodes are found with a
+ *                bounded heap rather than by sorting all 4096 nodes, and
+ *                the palette color for every level 4 node is recorded in
+ *                a lookup table used to map the pixels.  Large photos are
+ *                split into slabs of rows so that the worker pool can
+ *                count and map the pixels of the slabs in parallel; the
+ *                result is the same for any number of slabs.  If lookup
+ *                tables are enabled, pixels are instead mapped to the
+ *                nearest palette color through the photo's table.
+ *   INPUTS: src -- 5:6:5 RGB pixels in file order(rows from bottom to top)
+ *   OUTPUTS: p -- photo with hdr filled in and img allocated; palette and
+ *                 img are filled in
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void quantize_photo(photo_t* p, const uint16_t* src) {
+	struct octree_node level_2_octree[LEVEL_2_SIZE];
+	struct octree_node level_4_octree[LEVEL_4_SIZE];
+	uint32_t i;
+	uint16_t convert_i;
+
+	uint32_t red_average;
+	uint32_t green_average;
+	uint32_t blue_average;
+
+    uint16_t top[LEVEL_4_USED_SIZE];   /* heap, then list, of chosen nodes */
+    int32_t  n_top;                    /* number of nodes in top           */
+    uint8_t  palette_of[LEVEL_4_SIZE]; /* palette index for each node      */
+
+    pool_t*       pool;        /* pool for quantizing slabs         */
+    photo_slab_t* slabs;       /* slabs of photo(NULL if not split) */
+    int32_t       n_slabs = 0; /* number of slabs                   */
+    int32_t       s;           /* index over slabs                  */
+    uint32_t      first;       /* first file row in slab            */
+    uint32_t      last;        /* file row after slab               */
+
+    TRACE_BEGIN("quantize_photo");
+    (void)memset(level_2_octree, 0, sizeof (level_2_octree));
+    (void)memset(level_4_octree, 0, sizeof (level_4_octree));
+
+    /*
+     * Split a large photo into one slab per worker thread plus one for
+     * this thread(which helps while waiting).  Slab s holds file rows
+     * first through last - 1; since file rows are stored from bottom to
+     * top, those rows end up in image rows height - last through
+     * height - first - 1.
+     */
+    slabs = NULL;
+    if (SLAB_MIN_PIXELS <= p->hdr.width * p->hdr.height &&
+        NULL != (pool = pool_default()) && 0 < pool_size(pool)) {
+        n_slabs = pool_size(pool) + 1;
+        if (MAX_SLABS < n_slabs) {
+            n_slabs = MAX_SLABS;
+        }
+        slabs = malloc(n_slabs * sizeof (*slabs));
+    }
+    for (s = 0; NULL != slabs && n_slabs > s; s++) {
+        first = p->hdr.height * s / n_slabs;
+        last = p->hdr.height * (s + 1) / n_slabs;
+        slabs[s].src = &src[p->hdr.width * first];
+        slabs[s].dst = &p->img[p->hdr.width * (p->hdr.height - last)];
+        slabs[s].width = p->hdr.width;
+        slabs[s].rows = last - first;
+        slabs[s].palette_of = palette_of;
+        slabs[s].lut = NULL;
+    }
+
+    /*
+     * Add all pixels to the level 4 histogram, in file order.  Row order
+     * does not matter for the color histogram.  Each 16-bit pixel is
+     * coded as 5:6:5 RGB(5 bits red, 6 bits green, and 5 bits blue) and
+     * counted in the node given by its 4:4:4 index(see simd.c).
+     */
+    if (NULL == slabs) {
+        simd_histogram(src, p->hdr.width * p->hdr.height, level_4_octree);
+    }
+    else {
+        run_slab_jobs(pool, slabs, n_slabs, slab_histogram_job);
+        for (s = 0; n_slabs > s; s++) {
+            for (i = 0; LEVEL_4_SIZE > i; i++) {
+                level_4_octree[i].red_msb += slabs[s].hist[i].red_msb;
+                level_4_octree[i].green_msb += slabs[s].hist[i].green_msb;
+                level_4_octree[i].blue_msb += slabs[s].hist[i].blue_msb;
+                level_4_octree[i].number_of_pixels += slabs[s].hist[i].number_of_pixels;
+            }
+        }
+    }
+
+    /*
+     * Choose the LEVEL_4_USED_SIZE highest-ranked level 4 nodes.  The
+     * heap keeps the lowest-ranked node chosen so far at its root, so
+     * each remaining node need only be compared with the root.  Nodes
+     * are visited in index order, so a node that ties the root never
+     * replaces it.
+     */
+    for (n_top = 0; LEVEL_4_USED_SIZE > n_top; n_top++) {
+        top[n_top] = n_top;
+    }
+    for (n_top = LEVEL_4_USED_SIZE / 2; 0 < n_top--; ) {
+        octree_heap_sift(level_4_octree, top, LEVEL_4_USED_SIZE, n_top);
+    }
+    for (i = LEVEL_4_USED_SIZE; LEVEL_4_SIZE > i; i++) {
+        if (level_4_octree[i].number_of_pixels > level_4_octree[top[0]].number_of_pixels) {
+            top[0] = i;
+            octree_heap_sift(level_4_octree, top, LEVEL_4_USED_SIZE, 0);
+        }
+    }
+
+    /*
+     * Put the chosen nodes in rank order by repeatedly moving the root
+     * (lowest-ranked remaining node) to the end of the heap.
+     */
+    for (n_top = LEVEL_4_USED_SIZE; 1 < n_top; ) {
+        convert_i = top[0];
+        top[0] = top[--n_top];
+        top[n_top] = convert_i;
+        octree_heap_sift(level_4_octree, top, n_top, 0);
+    }
+
+    /*
+     * Nodes not chosen are represented by the palette color of their
+     * level 2 parent(after the 64 colors set by fill_palette_mode_x and
+     * the 128 level 4 colors).  The chosen nodes then take their own
+     * palette colors, in rank order.
+     */
+    for (i = 0; LEVEL_4_SIZE > i; i++) {
+        palette_of[i] = level_4_to_2(i) + EXISTED_COLORS_MODEX + LEVEL_4_USED_SIZE;
+    }
+
 	/* level 4 octree processing, corresponding to the first 192 - 64 palette entries */
 	for(i = 0; i < LEVEL_4_USED_SIZE; i++) {
+		convert_i = top[i];
 
 		/* calculate the average of red, green, and blue magnitudes */
-		if(level_4_octree[i].number_of_pixels != 0) {
-			red_average = level_4_octree[i].red_msb / level_4_octree[i].number_of_pixels;
-			green_average = level_4_octree[i].green_msb / level_4_octree[i].number_of_pixels;		
-			blue_average = level_4_octree[i].blue_msb / level_4_octree[i].number_of_pixels;
+		if(level_4_octree[convert_i].number_of_pixels != 0) {
+			red_average = level_4_octree[convert_i].red_msb / level_4_octree[convert_i].number_of_pixels;
+			green_average = level_4_octree[convert_i].green_msb / level_4_octree[convert_i].number_of_pixels;
+			blue_average = level_4_octree[convert_i].blue_msb / level_4_octree[convert_i].number_of_pixels;
 		}
-		
+
 		else {
 			red_average = 0;
 			green_average = 0;
 			blue_average = 0;
 		}
-		
+
 		/* store the current node's index in the actual palette (64 existed colors from fill_palette_modex) */
-		level_4_octree[i].palette_index = i + EXISTED_COLORS_MODEX;
+		palette_of[convert_i] = i + EXISTED_COLORS_MODEX;
 		/* convert back to 5:6:5 RGB format used in palette */
 		p->palette[i][0] = (uint8_t) (red_average & BIT_MASK_5) << 1;
 		p->palette[i][1] = (uint8_t) (green_average & BIT_MASK_6);
 		p->palette[i][2] = (uint8_t) (blue_average & BIT_MASK_5) << 1;
-		
+
 	}
-	
+
 	/* process the remaining level 4 nodes in level 2 */
-	for(i = LEVEL_4_USED_SIZE; i < LEVEL_4_SIZE; i++) {
+	for(i = 0; i < LEVEL_4_SIZE; i++) {
+		if (EXISTED_COLORS_MODEX + LEVEL_4_USED_SIZE > palette_of[i]) {
+			continue;
+		}
 		/* calculate the index of the current level_4_node in level 2 tree */
-		convert_i = level_4_to_2(level_4_octree[i].level_4_index);
-		/* store the node's index in the actual palette (64 existed colors from fill_palette_modex + 128 from level 4) */		
-		level_4_octree[i].palette_index = convert_i + EXISTED_COLORS_MODEX + LEVEL_4_USED_SIZE;	
-		
+		convert_i = palette_of[i] - EXISTED_COLORS_MODEX - LEVEL_4_USED_SIZE;
+
 		/* store the remaining level 4 nodes data into their corresponding level 2 index */
 		level_2_octree[convert_i].red_msb += level_4_octree[i].red_msb;
 		level_2_octree[convert_i].green_msb += level_4_octree[i].green_msb;
 		level_2_octree[convert_i].blue_msb += level_4_octree[i].blue_msb;
 		level_2_octree[convert_i].number_of_pixels += level_4_octree[i].number_of_pixels;
 	}
-	
+
 	/* level 2 octree processing, corresponding to the remaining 64 entries */
 	for(i = 0; i < LEVEL_2_SIZE; i++) {
-		/* calculate the average of red, green, and blue magnitudes of nodes in level 2 octree */		
+		/* calculate the average of red, green, and blue magnitudes of nodes in level 2 octree */
 		if(level_2_octree[i].number_of_pixels != 0) {
-			red_average = level_2_octree[i].red_msb /= level_2_octree[i].number_of_pixels;
+			red_average = level_2_octree[i].red_msb / level_2_octree[i].number_of_pixels;
 			green_average = level_2_octree[i].green_msb / level_2_octree[i].number_of_pixels;
 			blue_average = level_2_octree[i].blue_msb / level_2_octree[i].number_of_pixels;
-		}	
-		
+		}
+
 		else {
 			red_average = 0;
 			green_average = 0;
 			blue_average = 0;
 		}
-		
+
 		/* convert back to 5:6:5 RGB format used in palette */
 		p->palette[LEVEL_4_USED_SIZE + i][0] = (uint8_t) (red_average & BIT_MASK_5) << 1;
 		p->palette[LEVEL_4_USED_SIZE + i][1] = (uint8_t) (green_average & BIT_MASK_6);
 		p->palette[LEVEL_4_USED_SIZE + i][2] = (uint8_t) (blue_average & BIT_MASK_5) << 1;
-		
-	}
-	
-	/* restore the octree order */
-	qsort(level_4_octree, LEVEL_4_SIZE, sizeof(struct octree_node), octree_qsort_index);
-	
-	for(i = 0; i < image_size; i++) {
-		pixel = pixels_array[i];
-		/* Convert 5:6:5 RBG values to 4:4:4 index and write back the color for each pixel */
-		convert_i = ((pixel >> 12) << 8) | (((pixel >> 7) & 0xF) << 4) | ((pixel >> 1) & 0xF);
-		p->img[i] = level_4_octree[convert_i].palette_index;
+
 	}
-	
-    return p;
 
-}
+    /*
+     * Map each pixel to its palette color.  Rows are stored from bottom
+     * to top in the file, whereas in memory we store the data in the
+     * reverse order(top to bottom), so each file row is written to its
+     * flipped position.
+     */
+    if (photo_lut_enabled()) {
+        (void)build_photo_lut(p);
+    }
+    if (NULL == slabs) {
+        if (NULL != p->lut) {
+            simd_remap_lut(src, p->img, p->hdr.width, p->hdr.height, p->lut);
+        }
+        else {
+            simd_remap(src, p->img, p->hdr.width, p->hdr.height, palette_of);
+        }
+    }
+    else {
+        for (s = 0; n_slabs > s; s++) {
+            slabs[s].lut = p->lut;
+        }
+        run_slab_jobs(pool, slabs, n_slabs, slab_remap_job);
+        free(slabs);
+    }
 
-/*
- * octree_qsort_pixel
- *   DESCRIPTION: This function provides the sorting rule for qsort based on number of pixels a specific
- *                palette color has.
- *   INPUTS: two octree nodes on the same level
- *   OUTPUTS: none
- *   RETURN VALUE: rule for sorting based on number of pixels of a palette color
- *   SIDE EFFECTS: none
- */
-int octree_qsort_pixel(const void* x, const void* y){
-	const struct octree_node* octree_node_a = x;
-	const struct octree_node* octree_node_b = y;
-	return (octree_node_b->number_of_pixels - octree_node_a->number_of_pixels);
+    /* Nothing uses the table after the pixels are mapped. */
+    free(p->lut);
+    p->lut = NULL;
+    TRACE_END("quantize_photo");
 }
 
+
 /*
- * octree_qsort_index
- *   DESCRIPTION: This function provides the sorting rule for qsort based on level_4_index
- *   INPUTS: two octree nodes on the same level
- *   OUTPUTS: none
- *   RETURN VALUE: rule for sorting based on index
- *   SIDE EFFECTS: none
+ * build_photo_lut
+ *   DESCRIPTION: Build a table mapping every 5:6:5 RGB color to the
+ *                nearest of a photo's 192 palette colors(by squared
+ *                distance in the palette's 6-bit components, with ties
+ *                going to the lower palette index).  Rather than
+ *                comparing each of the 65536 colors with every palette
+ *                color, the colors are handled in cells of 16 that share
+ *                a 4:4:4 index.  No color in a cell can be farther from
+ *                its nearest palette color than the farthest corner of
+ *                the cell is from the palette color whose farthest
+ *                corner is closest, so only palette colors whose nearest
+ *                point in the cell lies within that bound need to be
+ *                compared with the cell's colors.  Both distances are
+ *                sums of one term per component, and each term depends
+ *                only on the cell's 4-bit value for that component, so
+ *                the terms are computed once for all cells.  The result
+ *                is the same as an exhaustive search.  The table is
+ *                used only to map the photo's pixels and is freed by
+ *                quantize_photo once they are mapped.
+ *   INPUTS: p -- room photo with palette filled in
+ *   OUTPUTS: p -- lut filled in
+ *   RETURN VALUE: 0 on success, or -1 if memory cannot be allocated
+ *   SIDE EFFECTS: dynamically allocates memory for the table
  */
-int octree_qsort_index(const void* x, const void* y){
-	const struct octree_node* octree_node_a = x;
-	const struct octree_node* octree_node_b = y;
-	return (octree_node_a->level_4_index - octree_node_b->level_4_index);
+static int32_t build_photo_lut(photo_t* p) {
+    uint16_t near_of[3][16][192]; /* per-component distance to cell      */
+    uint16_t far_of[3][16][192];  /* and to the cell's farthest corner   */
+    uint16_t near_rg[192];   /* red and green terms of near_of       */
+    uint16_t far_rg[192];    /* red and green terms of far_of        */
+    uint8_t* lut;            /* the new table                        */
+    uint8_t  cand[192];      /* palette colors that may be nearest   */
+    int32_t  n_cand;         /* number of candidates                 */
+    uint32_t limit;          /* bound on distance to nearest color   */
+    uint32_t dist;           /* distance from color to palette color */
+    uint32_t best[16];       /* distance to nearest color so far     */
+    uint8_t  nearest[16];    /* nearest color so far                 */
+    uint32_t term[3][4];     /* per-component distances to candidate */
+    uint32_t cell;           /* index over 4:4:4 cells               */
+    uint32_t low;            /* index over colors in a cell          */
+    int32_t  idx[3];         /* 4-bit components of cell             */
+    int32_t  d_lo;           /* distance from lower corner           */
+    int32_t  d_hi;           /* distance from upper corner           */
+    int32_t  c;              /* index over palette colors            */
+    int32_t  k;              /* index over red, green, blue          */
+    uint16_t pixel;          /* 5:6:5 value of one color             */
+
+    if (NULL != p->lut) {
+        return 0;
+    }
+    if (NULL == (lut = malloc(PHOTO_LUT_SIZE + SIMD_LUT_PAD))) {
+        return -1;
+    }
+
+    /*
+     * A cell with 4-bit component value v holds 6-bit values 4v to
+     * 4v + 3 for green, but only 4v and 4v + 2 for red and blue(which
+     * have 5 bits in a pixel and 6 in the palette).
+     */
+    for (k = 0; 3 > k; k++) {
+        for (cell = 0; 16 > cell; cell++) {
+            for (c = 0; 192 > c; c++) {
+                d_lo = p->palette[c][k] - (int32_t)(cell << 2);
+                d_hi = d_lo - (1 == k ? 3 : 2);
+                far_of[k][cell][c] = (d_lo * d_lo > d_hi * d_hi ? d_lo * d_lo : d_hi * d_hi);
+                near_of[k][cell][c] = (0 > d_lo ? d_lo * d_lo : (0 < d_hi ? d_hi * d_hi : 0));
+            }
+        }
+    }
+
+    for (cell = 0; LEVEL_4_SIZE > cell; cell++) {
+        idx[0] = cell >> 8;
+        idx[1] = (cell >> 4) & 0xF;
+        idx[2] = cell & 0xF;
+
+        /* Red and green are the same for 16 cells in a row. */
+        if (0 == idx[2]) {
+            for (c = 0; 192 > c; c++) {
+                far_rg[c] = far_of[0][idx[0]][c] + far_of[1][idx[1]][c];
+                near_rg[c] = near_of[0][idx[0]][c] + near_of[1][idx[1]][c];
+            }
+        }
+        limit = UINT16_MAX;
+        for (c = 0; 192 > c; c++) {
+            dist = far_rg[c] + far_of[2][idx[2]][c];
+            limit = (limit > dist ? dist : limit);
+        }
+        for (n_cand = 0, c = 0; 192 > c; c++) {
+            cand[n_cand] = c;
+            n_cand += (limit >= (uint32_t)near_rg[c] + near_of[2][idx[2]][c]);
+        }
+
+        /*
+         * Compare each color in the cell with the candidates.  The cell's
+         * colors combine two red values, four green values, and two blue
+         * values, so only eight terms are computed for each candidate.
+         */
+        for (low = 0; 16 > low; low++) {
+            best[low] = UINT32_MAX;
+        }
+        for (c = 0; n_cand > c; c++) {
+            for (k = 0; 4 > k; k++) {
+                d_lo = p->palette[cand[c]][1] - ((idx[1] << 2) + k);
+                term[1][k] = d_lo * d_lo;
+            }
+            for (k = 0; 2 > k; k++) {
+                d_lo = p->palette[cand[c]][0] - ((idx[0] << 2) + (k << 1));
+                term[0][k] = d_lo * d_lo;
+                d_lo = p->palette[cand[c]][2] - ((idx[2] << 2) + (k << 1));
+                term[2][k] = d_lo * d_lo;
+            }
+            for (low = 0; 16 > low; low++) {
+                dist = term[0][low & 1] + term[1][(low >> 1) & 3] + term[2][low >> 3];
+                nearest[low] = (best[low] > dist ? cand[c] : nearest[low]);
+                best[low] = (best[low] > dist ? dist : best[low]);
+            }
+        }
+        for (low = 0; 16 > low; low++) {
+            pixel = (((idx[0] << 1) | (low & 1)) << 11) | (((idx[1] << 2) | ((low >> 1) & 3)) << 5) |
+                    ((idx[2] << 1) | (low >> 3));
+            lut[pixel] = nearest[low] + EXISTED_COLORS_MODEX;
+        }
+    }
+    (void)memset(&lut[PHOTO_LUT_SIZE], 0, SIMD_LUT_PAD);
+    p->lut = lut;
+    return 0;
 }
 
+
 /*
  * level_4_to_2
  *   DESCRIPTION: This function finds the index of a level 4 octree node in a level 2 octree,
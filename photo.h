@@ -59,6 +59,8 @@
 #define EXISTED_COLORS_MODEX 64
 #define BIT_MASK_5 0x1F
 #define BIT_MASK_6 0x3F
+/* one lookup table entry for each 5:6:5 RGB color */
+#define PHOTO_LUT_SIZE 0x10000
 
 /* octree structure */
 struct octree_node {
@@ -66,16 +68,34 @@ struct octree_node {
 	unsigned int green_msb;
 	unsigned int blue_msb;
 	unsigned int number_of_pixels;
-	uint16_t level_4_index; /* node's index in level 4 tree (RRRR | GGGG | BBBB) */
-	uint8_t palette_index; /* node's actual index in real palette */
 };
 
+/*
+ * Fill a buffer with the pixels for a block of count horizontal lines of
+ * current room(line k of the block starts at buf[k * SCROLL_X_DIM]).
+ */
+extern void fill_horiz_block(int x, int y, int count, unsigned char* buf);
+
 /* Fill a buffer with the pixels for a horizontal line of current room. */
 extern void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]);
 
+/*
+ * Fill a buffer with the pixels for a block of count vertical lines of
+ * current room(line k of the block starts at buf[k * SCROLL_Y_DIM]).
+ */
+extern void fill_vert_block(int x, int y, int count, unsigned char* buf);
+
 /* Fill a buffer with the pixels for a vertical line of current room. */
 extern void fill_vert_buffer(int x, int y, unsigned char buf[SCROLL_Y_DIM]);
 
+/*
+ * Fill four buffers with the pixels of a block of count horizontal lines
+ * in mode X plane order(planes[p][k * SCROLL_X_WIDTH + i] is pixel
+ * x + 4i + p of line k).  Returns 0, or -1 if the lines must be drawn
+ * with fill_horiz_block instead.
+ */
+extern int fill_horiz_planes(int x, int y, int count, unsigned char* planes[4]);
+
 /* Get height of object image in pixels. */
 extern uint32_t image_height(const image_t* im);
 
@@ -88,23 +108,80 @@ extern uint32_t photo_height(const photo_t* p);
 /* Get width of room photo in pixels. */
 extern uint32_t photo_width(const photo_t* p);
 
+/* Get memory held by a room photo of the given size in bytes. */
+extern uint32_t photo_bytes(const photo_header_t* hdr);
+
+/*
+ * Get the size in bytes of the copy of a room photo's pixels stored
+ * column by column that read_photo makes for a photo of the given size,
+ * or 0 if none is made.
+ */
+extern uint32_t photo_column_bytes(const photo_header_t* hdr);
+
+/*
+ * Get memory held by a room photo in bytes, including the size of its
+ * column and plane order copies(also returned through copies).
+ */
+extern uint32_t photo_memory(const photo_t* p, uint32_t* copies);
+
+/*
+ * Add(on non-zero) or remove(on 0) a room photo's copy of its pixels
+ * stored column by column, which speeds up drawing vertical lines.
+ * Returns 0 or -1.
+ */
+extern int32_t set_photo_columns(photo_t* p, int32_t on);
+
+/*
+ * Get the size in bytes of the copy of a room photo's pixels in mode X
+ * plane order that read_photo makes for a photo of the given size, or 0
+ * if none is made.
+ */
+extern uint32_t photo_plane_bytes(const photo_header_t* hdr);
+
+/*
+ * Add(on non-zero) or remove(on 0) a room photo's copy of its pixels in
+ * mode X plane order, which speeds up drawing horizontal lines.  Returns
+ * 0 or -1.
+ */
+extern int32_t set_photo_planes(photo_t* p, int32_t on);
+
+/*
+ * Add the column and plane order copies that read_photo makes for a room
+ * photo, if they are missing(they are removed with set_photo_columns and
+ * set_photo_planes).
+ */
+extern void add_photo_copies(photo_t* p);
+
+/* Release a room photo read by read_photo. */
+extern void free_photo(photo_t* p);
+
+/* Fault in the memory holding a room photo's pixels. */
+extern void touch_photo(const photo_t* p);
+
 /*
  * Prepare room for display(record pointer for use by callbacks, set up
  * VGA palette, etc.).
  */
 extern void prep_room(const room_t* r);
 
-/* Read object image from a file into a dynamically allocated structure. */
+/*
+ * Read object image from a file into the object image atlas.  Identical
+ * files share one image, and object images are never released.  Safe to
+ * call from several threads at once.
+ */
 extern image_t* read_obj_image(const char* fname);
 
 /* Read room photo from a file into a dynamically allocated structure. */
 extern photo_t* read_photo(const char* fname);
 
-/* qsort rule based on index */
-extern int octree_qsort_index(const void* x, const void* y);
+/*
+ * Read a room photo quickly as a preview drawn in the 64 fixed colors
+ * rather than with an optimized palette.
+ */
+extern photo_t* read_photo_preview(const char* fname);
 
-/* qsort rule based on intensity of a color */
-extern int octree_qsort_pixel(const void* x, const void* y);
+/* Read the height and width of a room photo file.  Returns 0 or -1. */
+extern int32_t read_photo_header(const char* fname, photo_header_t* hdr);
 
 /* convert 5:6:5 index to 4:4:4 format */
 uint16_t level_4_to_2(uint16_t level_4_node_color_code);
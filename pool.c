@@ -0,0 +1,335 @@
+/* tab:4
+ *
+ * pool.c - worker thread pool
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      pool.c
+ */
+
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "trace.h"
+
+
+/* limit on the number of worker threads in one pool */
+#define MAX_POOL_THREADS 64
+
+
+/* types local to this file(declared in pool.h) */
+
+/* A queued job. */
+typedef struct pool_job_t pool_job_t;
+struct pool_job_t {
+    pool_fn_t     fn;    /* function to call                  */
+    void*         arg;   /* argument passed to fn             */
+    pool_group_t* grp;   /* group to which the job belongs    */
+    pool_job_t*   next;  /* next job in the queue(FIFO order) */
+};
+
+/*
+ * The pool.  All fields other than threads and n_threads are protected
+ * by the lock.  Workers sleep on work_cv until a job is queued; threads
+ * in pool_wait sleep on done_cv until some job finishes.
+ */
+struct pool_t {
+    pthread_mutex_t lock;       /* protects queue and stopping flag  */
+    pthread_cond_t  work_cv;    /* signaled when a job is queued     */
+    pthread_cond_t  done_cv;    /* broadcast when a job finishes     */
+    pool_job_t*     head;       /* first queued job                  */
+    pool_job_t*     tail;       /* last queued job                   */
+    int32_t         stopping;   /* set by pool_destroy               */
+    int32_t         n_threads;  /* number of worker threads          */
+    pthread_t       threads[MAX_POOL_THREADS]; /* worker thread ids  */
+};
+
+
+/* local functions--see function headers for details */
+static void create_default_pool(void);
+static void run_job(pool_t* pool, pool_job_t* job);
+static pool_job_t* take_job(pool_t* pool, const pool_group_t* grp);
+static void* worker_thread(void* arg);
+
+
+/* file-scope variables */
+static pool_t*        default_pool = NULL;              /* shared pool     */
+static pthread_once_t default_once = PTHREAD_ONCE_INIT; /* creates it once */
+
+
+/*
+ * take_job
+ *   DESCRIPTION: Remove the oldest queued job(optionally restricted to
+ *                one group) from a pool's queue.  Caller must hold the
+ *                pool lock.
+ *   INPUTS: pool -- the pool
+ *           grp -- group of job to take, or NULL for any job
+ *   OUTPUTS: none
+ *   RETURN VALUE: the job removed, or NULL if no such job is queued
+ *   SIDE EFFECTS: none
+ */
+static pool_job_t* take_job(pool_t* pool, const pool_group_t* grp) {
+    pool_job_t** find;  /* loop index over pointers to queued jobs */
+    pool_job_t*  job;   /* job found                               */
+    pool_job_t*  prev;  /* job before the one found                */
+
+    for (prev = NULL, find = &pool->head; NULL != *find; prev = *find, find = &(*find)->next) {
+        if (NULL == grp || grp == (*find)->grp) {
+            job = *find;
+            *find = job->next;
+            if (pool->tail == job) {
+                pool->tail = prev;
+            }
+            return job;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * run_job
+ *   DESCRIPTION: Execute a job taken from the queue, then account for
+ *                its completion.  Caller must hold the pool lock, which
+ *                is released while the job runs.
+ *   INPUTS: pool -- the pool
+ *           job -- the job
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees the job; wakes any waiting threads
+ */
+static void run_job(pool_t* pool, pool_job_t* job) {
+    (void)pthread_mutex_unlock(&pool->lock);
+    (*job->fn)(job->arg);
+    (void)pthread_mutex_lock(&pool->lock);
+
+    job->grp->pending--;
+    (void)pthread_cond_broadcast(&pool->done_cv);
+    free(job);
+}
+
+
+/*
+ * worker_thread
+ *   DESCRIPTION: Function executed by each worker thread.  Runs queued
+ *                jobs in FIFO order until the pool is destroyed.
+ *   INPUTS: arg -- the pool
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: none
+ */
+static void* worker_thread(void* arg) {
+    pool_t*     pool = arg; /* the pool served by this thread */
+    pool_job_t* job;        /* job being executed             */
+
+    trace_thread_name("pool worker");
+    (void)pthread_mutex_lock(&pool->lock);
+    while (!pool->stopping) {
+        if (NULL == (job = take_job(pool, NULL))) {
+            pthread_cond_wait(&pool->work_cv, &pool->lock);
+            continue;
+        }
+        run_job(pool, job);
+    }
+    (void)pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+
+/*
+ * pool_create
+ *   DESCRIPTION: Create a pool of worker threads.
+ *   INPUTS: n_threads -- number of worker threads(0 runs all jobs in
+ *                        waiting threads; negative selects the default)
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the new pool, or NULL on failure
+ *   SIDE EFFECTS: dynamically allocates memory; starts threads
+ */
+pool_t* pool_create(int32_t n_threads) {
+    pool_t* pool; /* the new pool */
+
+    if (0 > n_threads) {
+        n_threads = pool_default_threads();
+    }
+    if (MAX_POOL_THREADS < n_threads) {
+        n_threads = MAX_POOL_THREADS;
+    }
+    if (NULL == (pool = malloc(sizeof (*pool)))) {
+        return NULL;
+    }
+    (void)pthread_mutex_init(&pool->lock, NULL);
+    (void)pthread_cond_init(&pool->work_cv, NULL);
+    (void)pthread_cond_init(&pool->done_cv, NULL);
+    pool->head = pool->tail = NULL;
+    pool->stopping = 0;
+
+    /* Start the workers.  If some fail to start, use the rest. */
+    for (pool->n_threads = 0; n_threads > pool->n_threads; pool->n_threads++) {
+        if (0 != pthread_create(&pool->threads[pool->n_threads], NULL, worker_thread, pool)) {
+            break;
+        }
+    }
+    return pool;
+}
+
+
+/*
+ * pool_destroy
+ *   DESCRIPTION: Stop the worker threads of a pool and free it.  All
+ *                submitted jobs must have been waited for.
+ *   INPUTS: pool -- the pool
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: joins worker threads; frees memory
+ */
+void pool_destroy(pool_t* pool) {
+    int32_t i; /* loop index over worker threads */
+
+    (void)pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    (void)pthread_cond_broadcast(&pool->work_cv);
+    (void)pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; pool->n_threads > i; i++) {
+        (void)pthread_join(pool->threads[i], NULL);
+    }
+    (void)pthread_cond_destroy(&pool->done_cv);
+    (void)pthread_cond_destroy(&pool->work_cv);
+    (void)pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+
+/*
+ * create_default_pool
+ *   DESCRIPTION: Create the shared pool(called once via pthread_once).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets default_pool
+ */
+static void create_default_pool() {
+    default_pool = pool_create(-1);
+}
+
+
+/*
+ * pool_default
+ *   DESCRIPTION: Get the shared pool, creating it on first use.  The
+ *                shared pool lives until the program terminates.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the shared pool, or NULL if it cannot be created
+ *   SIDE EFFECTS: may start worker threads
+ */
+pool_t* pool_default() {
+    (void)pthread_once(&default_once, create_default_pool);
+    return default_pool;
+}
+
+
+/*
+ * pool_default_threads
+ *   DESCRIPTION: Get the default number of worker threads for a pool.
+ *                The ADVENTURE_THREADS environment variable overrides
+ *                the number of online CPUs.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of worker threads to use
+ *   SIDE EFFECTS: none
+ */
+int32_t pool_default_threads() {
+    const char* env;   /* value of ADVENTURE_THREADS */
+    long        count; /* thread count               */
+
+    if (NULL != (env = getenv("ADVENTURE_THREADS"))) {
+        count = strtol(env, NULL, 10);
+        return (0 > count ? 0 : (MAX_POOL_THREADS < count ? MAX_POOL_THREADS : count));
+    }
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (1 > count ? 1 : (MAX_POOL_THREADS < count ? MAX_POOL_THREADS : count));
+}
+
+
+/*
+ * pool_size
+ *   DESCRIPTION: Get the number of worker threads in a pool.
+ *   INPUTS: pool -- the pool
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of worker threads
+ *   SIDE EFFECTS: none
+ */
+int32_t pool_size(const pool_t* pool) {
+    return pool->n_threads;
+}
+
+
+/*
+ * pool_submit
+ *   DESCRIPTION: Queue a job for execution by the pool.
+ *   INPUTS: pool -- the pool
+ *           grp -- group to which the job belongs
+ *           fn -- function to call
+ *           arg -- argument to pass to fn
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: dynamically allocates memory for the queue entry
+ */
+int32_t pool_submit(pool_t* pool, pool_group_t* grp, pool_fn_t fn, void* arg) {
+    pool_job_t* job; /* queue entry for the job */
+
+    if (NULL == (job = malloc(sizeof (*job)))) {
+        return -1;
+    }
+    job->fn = fn;
+    job->arg = arg;
+    job->grp = grp;
+    job->next = NULL;
+
+    (void)pthread_mutex_lock(&pool->lock);
+    if (NULL == pool->tail) {
+        pool->head = job;
+    }
+    else {
+        pool->tail->next = job;
+    }
+    pool->tail = job;
+    grp->pending++;
+    (void)pthread_cond_signal(&pool->work_cv);
+    (void)pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+
+/*
+ * pool_wait
+ *   DESCRIPTION: Wait until every job in a group has finished.  Rather
+ *                than sleeping while jobs of the group are still queued,
+ *                the calling thread runs them itself.
+ *   INPUTS: pool -- the pool
+ *           grp -- the group
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may execute jobs in the calling thread
+ */
+void pool_wait(pool_t* pool, pool_group_t* grp) {
+    pool_job_t* job; /* queued job of the group */
+
+    (void)pthread_mutex_lock(&pool->lock);
+    while (0 < grp->pending) {
+        if (NULL != (job = take_job(pool, grp))) {
+            run_job(pool, job);
+        }
+        else {
+            pthread_cond_wait(&pool->done_cv, &pool->lock);
+        }
+    }
+    (void)pthread_mutex_unlock(&pool->lock);
+}
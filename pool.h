@@ -0,0 +1,71 @@
+/* tab:4
+ *
+ * pool.h - header file for the worker thread pool
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      pool.h
+ */
+#ifndef POOL_H
+#define POOL_H
+
+
+#include <stdint.h>
+
+
+/*
+ * A pool of worker threads that execute jobs from a shared FIFO queue.
+ * Jobs are submitted as part of a group, and the submitter waits for the
+ * group rather than for the whole pool, so several independent users
+ * (and nested users) can share one pool.  A thread waiting for a group
+ * runs that group's queued jobs itself rather than sleeping, so waiting
+ * never deadlocks even when called from inside a job, and a pool with
+ * no worker threads simply runs every job in the waiting thread.
+ */
+typedef struct pool_t pool_t;
+
+/* a job: called once with the argument given to pool_submit */
+typedef void (*pool_fn_t)(void* arg);
+
+/*
+ * A group of jobs.  Initialize pending to 0 before the first submission.
+ * The structure must remain valid until pool_wait returns.
+ */
+typedef struct pool_group_t pool_group_t;
+struct pool_group_t {
+    int32_t pending;    /* jobs submitted but not yet finished */
+};
+
+/*
+ * Create a pool with the given number of worker threads; a negative
+ * count selects the default(see pool_default_threads).  Returns NULL
+ * on failure.
+ */
+extern pool_t* pool_create(int32_t n_threads);
+
+/* Stop the worker threads and free a pool.  Queued jobs must be done. */
+extern void pool_destroy(pool_t* pool);
+
+/*
+ * Get the shared pool used by the game, creating it on first use.  Returns
+ * NULL if the pool cannot be created.
+ */
+extern pool_t* pool_default(void);
+
+/*
+ * Get the default number of worker threads: the ADVENTURE_THREADS
+ * environment variable if set, or otherwise the number of online CPUs.
+ */
+extern int32_t pool_default_threads(void);
+
+/* Get the number of worker threads in a pool. */
+extern int32_t pool_size(const pool_t* pool);
+
+/* Queue a job as part of a group.  Returns 0 on success, -1 on failure. */
+extern int32_t pool_submit(pool_t* pool, pool_group_t* grp, pool_fn_t fn, void* arg);
+
+/* Wait for all jobs in a group to finish, helping to run them. */
+extern void pool_wait(pool_t* pool, pool_group_t* grp);
+
+#endif /* POOL_H */
@@ -0,0 +1,1072 @@
+/* tab:4
+ *
+ * simd.c - vectorized photo quantization kernels
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      simd.c
+ */
+
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#include "photo.h"
+#include "simd.h"
+
+
+/*
+ * The histogram kernels count pixels in sub-histograms of SUB_BINS
+ * counters each, using a different sub-histogram for adjacent pixels so
+ * that runs of one color(common in photos) do not make each update wait
+ * for the previous update of the same counter.  A counter's key is a
+ * pixel's 4:4:4 index plus the two low bits of green, which leaves only
+ * the low bits of red and blue varying among the pixels that share a
+ * key.  Each counter packs the number of pixels and the sums of those
+ * two bits into one 64-bit word, so a pixel costs a single update.  The
+ * fields hold up to HIST_CHUNK pixels, so counters are merged into the
+ * octree after each chunk.
+ */
+#define SUB_HISTS      2          /* number of sub-histograms(power of 2) */
+#define SUB_BINS       16384      /* counters in each sub-histogram       */
+#define HIST_R0_SHIFT  21         /* shift for sum of red low bits        */
+#define HIST_B0_SHIFT  42         /* shift for sum of blue low bits       */
+#define HIST_FIELD     0x1FFFFF   /* mask for one packed field            */
+#define HIST_CHUNK     0x100000   /* pixels counted before merging        */
+
+/* key for a 5:6:5 pixel: RRRR GGGGGG BBBB(low bits of red and blue dropped) */
+#define HIST_KEY(p)    ((((p) >> 12) << 10) | (((p) >> 1) & 0x3FF))
+
+/* index of the low bits of red and blue of a pixel in hist_inc */
+#define HIST_LOW(p)    ((((p) >> 11) & 1) | (((p) & 1) << 1))
+
+/* 4:4:4 index of a 5:6:5 pixel */
+#define LEVEL_4_INDEX(p) ((((p) >> 12) << 8) | ((((p) >> 7) & 0xF) << 4) | (((p) >> 1) & 0xF))
+
+/* packed counter update for each combination of red and blue low bits */
+static const uint64_t hist_inc[4] = {
+    1,
+    1 | (1ULL << HIST_R0_SHIFT),
+    1 | (1ULL << HIST_B0_SHIFT),
+    1 | (1ULL << HIST_R0_SHIFT) | (1ULL << HIST_B0_SHIFT)
+};
+
+
+/* a set of kernel versions */
+typedef struct simd_kernels_t simd_kernels_t;
+struct simd_kernels_t {
+    const char* name;                                             /* version name */
+    void (*count)(const uint16_t* src, uint32_t n, uint64_t* hist); /* histogram    */
+    void (*remap)(const uint16_t* src, uint8_t* dst, uint32_t width,
+                  uint32_t height, const uint8_t* palette_of);     /* remap photo  */
+    void (*remap_lut)(const uint16_t* src, uint8_t* dst, uint32_t width,
+                      uint32_t height, const uint8_t* lut);        /* remap by LUT */
+    void (*blend)(uint8_t* dst, const uint8_t* src, uint32_t n,
+                  uint8_t transparent);                            /* draw object  */
+    void (*deinterleave)(uint8_t* const planes[4], const uint8_t* src,
+                         uint32_t n);                              /* split line   */
+    void (*transpose)(uint8_t* dst, uint32_t dst_stride, const uint8_t* src,
+                      uint32_t src_stride, uint32_t cols,
+                      uint32_t rows);                              /* cols to rows */
+};
+
+
+/* local functions--see function headers for details */
+static void blend_scalar(uint8_t* dst, const uint8_t* src, uint32_t n, uint8_t transparent);
+static void choose_kernels(void);
+static const simd_kernels_t* find_kernels(const char* name);
+static void count_scalar(const uint16_t* src, uint32_t n, uint64_t* hist);
+static void deinterleave_scalar(uint8_t* const planes[4], const uint8_t* src, uint32_t n);
+static void merge_histogram(uint64_t* hist, struct octree_node* level_4);
+static void remap_lut_scalar(const uint16_t* src, uint8_t* dst, uint32_t width,
+                             uint32_t height, const uint8_t* lut);
+static void remap_row(const uint16_t* src, uint8_t* dst, uint32_t n,
+                      const uint8_t* palette_of);
+static void remap_scalar(const uint16_t* src, uint8_t* dst, uint32_t width,
+                         uint32_t height, const uint8_t* palette_of);
+static void transpose_scalar(uint8_t* dst, uint32_t dst_stride, const uint8_t* src,
+                             uint32_t src_stride, uint32_t cols, uint32_t rows);
+#if defined(SIMD_X86)
+static void blend_sse2(uint8_t* dst, const uint8_t* src, uint32_t n, uint8_t transparent);
+static void blend_avx2(uint8_t* dst, const uint8_t* src, uint32_t n, uint8_t transparent);
+static void count_sse2(const uint16_t* src, uint32_t n, uint64_t* hist);
+static void count_avx2(const uint16_t* src, uint32_t n, uint64_t* hist);
+static void deinterleave_sse2(uint8_t* const planes[4], const uint8_t* src, uint32_t n);
+static void deinterleave_ssse3(uint8_t* const planes[4], const uint8_t* src, uint32_t n);
+static void deinterleave_avx2(uint8_t* const planes[4], const uint8_t* src, uint32_t n);
+static void remap_sse2(const uint16_t* src, uint8_t* dst, uint32_t width,
+                       uint32_t height, const uint8_t* palette_of);
+static void remap_avx2(const uint16_t* src, uint8_t* dst, uint32_t width,
+                       uint32_t height, const uint8_t* palette_of);
+static void remap_lut_avx2(const uint16_t* src, uint8_t* dst, uint32_t width,
+                           uint32_t height, const uint8_t* lut);
+static void transpose_sse2(uint8_t* dst, uint32_t dst_stride, const uint8_t* src,
+                           uint32_t src_stride, uint32_t cols, uint32_t rows);
+#endif
+
+
+/* file-scope variables */
+static const simd_kernels_t scalar_kernels = {
+    "scalar", count_scalar, remap_scalar, remap_lut_scalar, blend_scalar,
+    deinterleave_scalar, transpose_scalar
+};
+#if defined(SIMD_X86)
+static const simd_kernels_t sse2_kernels = {
+    "sse2", count_sse2, remap_sse2, remap_lut_scalar, blend_sse2,
+    deinterleave_sse2, transpose_sse2
+};
+static const simd_kernels_t ssse3_kernels = {
+    "ssse3", count_sse2, remap_sse2, remap_lut_scalar, blend_sse2,
+    deinterleave_ssse3, transpose_sse2
+};
+static const simd_kernels_t avx2_kernels = {
+    "avx2", count_avx2, remap_avx2, remap_lut_avx2, blend_avx2,
+    deinterleave_avx2, transpose_sse2
+};
+#endif
+static const simd_kernels_t* kernels = &scalar_kernels;         /* version in use */
+static pthread_once_t        kernels_once = PTHREAD_ONCE_INIT; /* chooses it once */
+
+/*
+ * Packed sub-histograms for each thread.  These are allocated on first
+ * use and left cleared by merge_histogram, so they can be reused for the
+ * next photo without clearing or reallocating them.
+ */
+static __thread uint64_t* thread_hist = NULL;
+
+
+/*
+ * choose_kernels
+ *   DESCRIPTION: Choose the fastest kernel versions supported by the CPU
+ *                and allowed by the ADVENTURE_SIMD environment variable
+ *                (called once via pthread_once).  An unknown version
+ *                name does not limit the choice.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets kernels
+ */
+static void choose_kernels() {
+    static const char* const order[] = { /* versions, fastest first */
+        "avx2", "ssse3", "sse2", "scalar"
+    };
+    const char*           env;   /* value of ADVENTURE_SIMD */
+    const simd_kernels_t* k;     /* supported version       */
+    int32_t               first; /* fastest version allowed */
+    int32_t               i;     /* index over versions     */
+
+    env = getenv("ADVENTURE_SIMD");
+    for (first = 0, i = 0; sizeof (order) / sizeof (order[0]) > i; i++) {
+        if (NULL != env && 0 == strcmp(env, order[i])) {
+            first = i;
+        }
+    }
+    for (i = first; sizeof (order) / sizeof (order[0]) > i; i++) {
+        if (NULL != (k = find_kernels(order[i]))) {
+            kernels = k;
+            return;
+        }
+    }
+}
+
+
+/*
+ * find_kernels
+ *   DESCRIPTION: Find a kernel version by name.
+ *   INPUTS: name -- "scalar", "sse2", "ssse3", or "avx2"
+ *   OUTPUTS: none
+ *   RETURN VALUE: the version, or NULL if it is unknown or not supported
+ *                 by the CPU
+ *   SIDE EFFECTS: none
+ */
+static const simd_kernels_t* find_kernels(const char* name) {
+    if (0 == strcmp(name, "scalar")) {
+        return &scalar_kernels;
+    }
+#if defined(SIMD_X86)
+    __builtin_cpu_init();
+    if (0 == strcmp(name, "sse2") && __builtin_cpu_supports("sse2")) {
+        return &sse2_kernels;
+    }
+    if (0 == strcmp(name, "ssse3") && __builtin_cpu_supports("ssse3")) {
+        return &ssse3_kernels;
+    }
+    if (0 == strcmp(name, "avx2") && __builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+#endif
+    return NULL;
+}
+
+
+/*
+ * merge_histogram
+ *   DESCRIPTION: Add the packed counters of all sub-histograms to a
+ *                level 4 octree histogram and clear them.  The red,
+ *                green, and blue sums are rebuilt from each counter's
+ *                key(which holds the high bits of every pixel counted)
+ *                and the packed sums of the low bits.
+ *   INPUTS: hist -- SUB_HISTS sub-histograms of SUB_BINS counters
+ *           level_4 -- the octree histogram
+ *   OUTPUTS: hist -- cleared
+ *            level_4 -- counts and sums added
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void merge_histogram(uint64_t* hist, struct octree_node* level_4) {
+    uint32_t            key;   /* index over counters       */
+    int32_t             sub;   /* index over sub-histograms */
+    uint64_t            c;     /* packed counter total      */
+    uint32_t            count; /* pixels counted for key    */
+    struct octree_node* node;  /* octree node for key       */
+
+    for (key = 0; SUB_BINS > key; key++) {
+        for (c = 0, sub = 0; SUB_HISTS > sub; sub++) {
+            c += hist[sub * SUB_BINS + key];
+            hist[sub * SUB_BINS + key] = 0;
+        }
+        if (0 == c) {
+            continue;
+        }
+        count = c & HIST_FIELD;
+        node = &level_4[((key >> 10) << 8) | (((key >> 6) & 0xF) << 4) | (key & 0xF)];
+        node->number_of_pixels += count;
+        node->red_msb += count * ((key >> 10) << 1) + ((c >> HIST_R0_SHIFT) & HIST_FIELD);
+        node->green_msb += count * ((key >> 4) & 0x3F);
+        node->blue_msb += count * ((key & 0xF) << 1) + (c >> HIST_B0_SHIFT);
+    }
+}
+
+
+/*
+ * count_scalar
+ *   DESCRIPTION: Count pixels into packed sub-histograms(scalar version).
+ *   INPUTS: src -- 5:6:5 RGB pixels
+ *           n -- number of pixels(no more than HIST_CHUNK)
+ *           hist -- SUB_HISTS sub-histograms of SUB_BINS counters
+ *   OUTPUTS: hist -- pixels added
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void count_scalar(const uint16_t* src, uint32_t n, uint64_t* hist) {
+    uint32_t i;  /* index over pixels */
+
+    for (i = 0; n > i; i++) {
+        hist[(i & (SUB_HISTS - 1)) * SUB_BINS + HIST_KEY(src[i])] += hist_inc[HIST_LOW(src[i])];
+    }
+}
+
+
+/*
+ * remap_row
+ *   DESCRIPTION: Map pixels to palette colors one at a time.  Used by
+ *                all versions for pixels left over at the end of a row.
+ *   INPUTS: src -- 5:6:5 RGB pixels
+ *           n -- number of pixels
+ *           palette_of -- palette color for each 4:4:4 index
+ *   OUTPUTS: dst -- palette colors
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void remap_row(const uint16_t* src, uint8_t* dst, uint32_t n,
+                      const uint8_t* palette_of) {
+    uint32_t i;  /* index over pixels */
+
+    for (i = 0; n > i; i++) {
+        dst[i] = palette_of[LEVEL_4_INDEX(src[i])];
+    }
+}
+
+
+/*
+ * remap_scalar
+ *   DESCRIPTION: Map the pixels of a photo to palette colors(scalar
+ *                version).
+ *   INPUTS: src -- 5:6:5 RGB pixels, rows from bottom to top
+ *           width, height -- size of photo in pixels
+ *           palette_of -- palette color for each 4:4:4 index
+ *   OUTPUTS: dst -- palette colors, rows from top to bottom
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void remap_scalar(const uint16_t* src, uint8_t* dst, uint32_t width,
+                         uint32_t height, const uint8_t* palette_of) {
+    uint32_t y;  /* index over rows */
+
+    for (y = height; y-- > 0; src += width) {
+        remap_row(src, &dst[width * y], width, palette_of);
+    }
+}
+
+
+/*
+ * remap_lut_scalar
+ *   DESCRIPTION: Map the pixels of a photo to palette colors through a
+ *                table indexed by pixel value(scalar version, also used
+ *                by the SSE2 kernels, since SSE2 has no gather).
+ *   INPUTS: src -- 5:6:5 RGB pixels, rows from bottom to top
+ *           width, height -- size of photo in pixels
+ *           lut -- palette color for each 5:6:5 pixel value
+ *   OUTPUTS: dst -- palette colors, rows from top to bottom
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void remap_lut_scalar(const uint16_t* src, uint8_t* dst, uint32_t width,
+                             uint32_t height, const uint8_t* lut) {
+    uint8_t* out;  /* output row          */
+    uint32_t x;    /* index over columns  */
+    uint32_t y;    /* index over rows     */
+
+    for (y = height; y-- > 0; src += width) {
+        out = &dst[width * y];
+        for (x = 0; width > x; x++) {
+            out[x] = lut[src[x]];
+        }
+    }
+}
+
+
+/*
+ * blend_scalar
+ *   DESCRIPTION: Draw object pixels over a line, skipping transparent
+ *                pixels(scalar version, also used for pixels left over
+ *                by the other versions).
+ *   INPUTS: dst -- line of pixels
+ *           src -- object pixels
+ *           n -- number of pixels
+ *           transparent -- color of transparent object pixels
+ *   OUTPUTS: dst -- object pixels drawn
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void blend_scalar(uint8_t* dst, const uint8_t* src, uint32_t n, uint8_t transparent) {
+    uint32_t i;  /* index over pixels */
+
+    for (i = 0; n > i; i++) {
+        if (transparent != src[i]) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+
+/*
+ * deinterleave_scalar
+ *   DESCRIPTION: Split a line of pixels among the four mode X planes
+ *                (scalar version, also used for pixels left over by the
+ *                other versions).
+ *   INPUTS: src -- line of pixels
+ *           n -- number of pixels
+ *   OUTPUTS: planes -- pixel 4j + p of the line is written to planes[p][j]
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void deinterleave_scalar(uint8_t* const planes[4], const uint8_t* src, uint32_t n) {
+    uint32_t i;  /* index over pixels */
+
+    for (i = 0; n > i; i++) {
+        planes[i & 3][i >> 2] = src[i];
+    }
+}
+
+
+/*
+ * transpose_scalar
+ *   DESCRIPTION: Write columns of pixels as rows(scalar version, also
+ *                used for pixels left over by the other versions).
+ *   INPUTS: src -- first column
+ *           src_stride -- distance between columns in src
+ *           cols -- number of columns
+ *           rows -- number of pixels in each column
+ *           dst_stride -- distance between rows in dst
+ *   OUTPUTS: dst -- pixel r of column c is written to dst[r * dst_stride + c]
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void transpose_scalar(uint8_t* dst, uint32_t dst_stride, const uint8_t* src,
+                             uint32_t src_stride, uint32_t cols, uint32_t rows) {
+    uint8_t* out;  /* pixel of dst being written */
+    uint32_t c;    /* index over columns         */
+    uint32_t r;    /* index over rows            */
+
+    for (c = 0; cols > c; c++, src += src_stride) {
+        for (out = &dst[c], r = 0; rows > r; r++, out += dst_stride) {
+            *out = src[r];
+        }
+    }
+}
+
+
+#if defined(SIMD_X86)
+
+/*
+ * blend_sse2
+ *   DESCRIPTION: Draw object pixels over a line, skipping transparent
+ *                pixels(SSE2 version).  Sixteen pixels at a time are
+ *                compared with the transparent color, and the result is
+ *                used as a mask to select between line and object.
+ *   INPUTS: dst -- line of pixels
+ *           src -- object pixels
+ *           n -- number of pixels
+ *           transparent -- color of transparent object pixels
+ *   OUTPUTS: dst -- object pixels drawn
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("sse2")))
+static void blend_sse2(uint8_t* dst, const uint8_t* src, uint32_t n, uint8_t transparent) {
+    __m128i  clear = _mm_set1_epi8(transparent); /* transparent color    */
+    __m128i  s;                                  /* 16 object pixels     */
+    __m128i  mask;                               /* transparent pixels   */
+    uint32_t i;                                  /* index over pixels    */
+
+    for (i = 0; n >= i + 16; i += 16) {
+        s = _mm_loadu_si128((const __m128i*)&src[i]);
+        mask = _mm_cmpeq_epi8(s, clear);
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_or_si128(
+            _mm_and_si128(mask, _mm_loadu_si128((const __m128i*)&dst[i])),
+            _mm_andnot_si128(mask, s)));
+    }
+    blend_scalar(&dst[i], &src[i], n - i, transparent);
+}
+
+
+/*
+ * blend_avx2
+ *   DESCRIPTION: Draw object pixels over a line, skipping transparent
+ *                pixels(AVX2 version).  Thirty-two pixels at a time are
+ *                compared with the transparent color and blended, then
+ *                sixteen at a time for the rest of the row.
+ *   INPUTS: dst -- line of pixels
+ *           src -- object pixels
+ *           n -- number of pixels
+ *           transparent -- color of transparent object pixels
+ *   OUTPUTS: dst -- object pixels drawn
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("avx2")))
+static void blend_avx2(uint8_t* dst, const uint8_t* src, uint32_t n, uint8_t transparent) {
+    __m256i  clear = _mm256_set1_epi8(transparent); /* transparent color */
+    __m256i  s;                                     /* 32 object pixels  */
+    __m128i  s16;                                   /* 16 object pixels  */
+    uint32_t i;                                     /* index over pixels */
+
+    for (i = 0; n >= i + 32; i += 32) {
+        s = _mm256_loadu_si256((const __m256i*)&src[i]);
+        _mm256_storeu_si256((__m256i*)&dst[i], _mm256_blendv_epi8(
+            s, _mm256_loadu_si256((const __m256i*)&dst[i]), _mm256_cmpeq_epi8(s, clear)));
+    }
+    if (n >= i + 16) {
+        s16 = _mm_loadu_si128((const __m128i*)&src[i]);
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_blendv_epi8(
+            s16, _mm_loadu_si128((const __m128i*)&dst[i]),
+            _mm_cmpeq_epi8(s16, _mm256_castsi256_si128(clear))));
+        i += 16;
+    }
+    blend_scalar(&dst[i], &src[i], n - i, transparent);
+}
+
+
+/*
+ * count_sse2
+ *   DESCRIPTION: Count pixels into packed sub-histograms(SSE2 version).
+ *                Keys and low-bit indices are computed for eight pixels
+ *                at a time; the counter updates themselves are scalar.
+ *   INPUTS: src -- 5:6:5 RGB pixels
+ *           n -- number of pixels(no more than HIST_CHUNK)
+ *           hist -- SUB_HISTS sub-histograms of SUB_BINS counters
+ *   OUTPUTS: hist -- pixels added
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("sse2")))
+static void count_sse2(const uint16_t* src, uint32_t n, uint64_t* hist) {
+    uint16_t key[8] __attribute__((aligned(16))); /* keys of 8 pixels      */
+    uint16_t low[8] __attribute__((aligned(16))); /* low bits of 8 pixels  */
+    __m128i  p;                                   /* 8 pixels              */
+    uint32_t i;                                   /* index over pixels     */
+    int32_t  j;                                   /* index over 8 pixels   */
+
+    for (i = 0; n >= i + 8; i += 8) {
+        p = _mm_loadu_si128((const __m128i*)&src[i]);
+        _mm_store_si128((__m128i*)key, _mm_or_si128(
+            _mm_slli_epi16(_mm_srli_epi16(p, 12), 10),
+            _mm_and_si128(_mm_srli_epi16(p, 1), _mm_set1_epi16(0x3FF))));
+        _mm_store_si128((__m128i*)low, _mm_or_si128(
+            _mm_and_si128(_mm_srli_epi16(p, 11), _mm_set1_epi16(1)),
+            _mm_and_si128(_mm_slli_epi16(p, 1), _mm_set1_epi16(2))));
+        for (j = 0; 8 > j; j++) {
+            hist[(j & (SUB_HISTS - 1)) * SUB_BINS + key[j]] += hist_inc[low[j]];
+        }
+    }
+    count_scalar(&src[i], n - i, hist);
+}
+
+
+/*
+ * count_avx2
+ *   DESCRIPTION: Count pixels into packed sub-histograms(AVX2 version).
+ *                Keys and low-bit indices are computed for sixteen
+ *                pixels at a time; the counter updates are scalar.
+ *   INPUTS: src -- 5:6:5 RGB pixels
+ *           n -- number of pixels(no more than HIST_CHUNK)
+ *           hist -- SUB_HISTS sub-histograms of SUB_BINS counters
+ *   OUTPUTS: hist -- pixels added
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("avx2")))
+static void count_avx2(const uint16_t* src, uint32_t n, uint64_t* hist) {
+    uint16_t key[16] __attribute__((aligned(32))); /* keys of 16 pixels     */
+    uint16_t low[16] __attribute__((aligned(32))); /* low bits of 16 pixels */
+    __m256i  p;                                    /* 16 pixels             */
+    uint32_t i;                                    /* index over pixels     */
+    int32_t  j;                                    /* index over 16 pixels  */
+
+    for (i = 0; n >= i + 16; i += 16) {
+        p = _mm256_loadu_si256((const __m256i*)&src[i]);
+        _mm256_store_si256((__m256i*)key, _mm256_or_si256(
+            _mm256_slli_epi16(_mm256_srli_epi16(p, 12), 10),
+            _mm256_and_si256(_mm256_srli_epi16(p, 1), _mm256_set1_epi16(0x3FF))));
+        _mm256_store_si256((__m256i*)low, _mm256_or_si256(
+            _mm256_and_si256(_mm256_srli_epi16(p, 11), _mm256_set1_epi16(1)),
+            _mm256_and_si256(_mm256_slli_epi16(p, 1), _mm256_set1_epi16(2))));
+        for (j = 0; 16 > j; j++) {
+            hist[(j & (SUB_HISTS - 1)) * SUB_BINS + key[j]] += hist_inc[low[j]];
+        }
+    }
+    count_scalar(&src[i], n - i, hist);
+}
+
+
+/*
+ * remap_sse2
+ *   DESCRIPTION: Map the pixels of a photo to palette colors(SSE2
+ *                version).  The 4:4:4 indices are computed for eight
+ *                pixels at a time; SSE2 has no gather, so the table
+ *                lookups are scalar.
+ *   INPUTS: src -- 5:6:5 RGB pixels, rows from bottom to top
+ *           width, height -- size of photo in pixels
+ *           palette_of -- palette color for each 4:4:4 index
+ *   OUTPUTS: dst -- palette colors, rows from top to bottom
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("sse2")))
+static void remap_sse2(const uint16_t* src, uint8_t* dst, uint32_t width,
+                       uint32_t height, const uint8_t* palette_of) {
+    uint16_t idx[8] __attribute__((aligned(16))); /* indices of 8 pixels */
+    __m128i  p;                                   /* 8 pixels            */
+    __m128i  mask = _mm_set1_epi16(0xF);          /* one 4-bit field     */
+    uint8_t* out;                                 /* output row          */
+    uint32_t x;                                   /* index over columns  */
+    uint32_t y;                                   /* index over rows     */
+    int32_t  j;                                   /* index over 8 pixels */
+
+    for (y = height; y-- > 0; src += width) {
+        out = &dst[width * y];
+        for (x = 0; width >= x + 8; x += 8) {
+            p = _mm_loadu_si128((const __m128i*)&src[x]);
+            _mm_store_si128((__m128i*)idx, _mm_or_si128(_mm_or_si128(
+                _mm_slli_epi16(_mm_srli_epi16(p, 12), 8),
+                _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(p, 7), mask), 4)),
+                _mm_and_si128(_mm_srli_epi16(p, 1), mask)));
+            for (j = 0; 8 > j; j++) {
+                out[x + j] = palette_of[idx[j]];
+            }
+        }
+        remap_row(&src[x], &out[x], width - x, palette_of);
+    }
+}
+
+
+/*
+ * remap_avx2
+ *   DESCRIPTION: Map the pixels of a photo to palette colors(AVX2
+ *                version).  Eight pixels at a time are widened to 32
+ *                bits, converted to 4:4:4 indices, and looked up with a
+ *                gather from a copy of the table widened to 32-bit
+ *                entries; the low byte of each result is then packed
+ *                into eight output bytes.
+ *   INPUTS: src -- 5:6:5 RGB pixels, rows from bottom to top
+ *           width, height -- size of photo in pixels
+ *           palette_of -- palette color for each 4:4:4 index
+ *   OUTPUTS: dst -- palette colors, rows from top to bottom
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("avx2")))
+static void remap_avx2(const uint16_t* src, uint8_t* dst, uint32_t width,
+                       uint32_t height, const uint8_t* palette_of) {
+    int32_t  wide[LEVEL_4_SIZE];   /* palette_of with 32-bit entries */
+    __m256i  p;                    /* 8 pixels, widened              */
+    __m256i  idx;                  /* 4:4:4 indices of 8 pixels      */
+    __m256i  mask = _mm256_set1_epi32(0xF);  /* one 4-bit field      */
+    __m256i  low_bytes;            /* selects byte 0 of each entry   */
+    __m256i  gather_order;         /* moves low bytes together       */
+    __m256i  colors;               /* colors of 8 pixels             */
+    uint8_t* out;                  /* output row                     */
+    uint32_t x;                    /* index over columns             */
+    uint32_t y;                    /* index over rows                */
+
+    /* Small photos are not worth widening the table for. */
+    if (LEVEL_4_SIZE > width * height) {
+        remap_scalar(src, dst, width, height, palette_of);
+        return;
+    }
+    for (x = 0; LEVEL_4_SIZE > x; x++) {
+        wide[x] = palette_of[x];
+    }
+
+    low_bytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    gather_order = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+    for (y = height; y-- > 0; src += width) {
+        out = &dst[width * y];
+        for (x = 0; width >= x + 8; x += 8) {
+            p = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&src[x]));
+            idx = _mm256_or_si256(_mm256_or_si256(
+                _mm256_slli_epi32(_mm256_srli_epi32(p, 12), 8),
+                _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(p, 7), mask), 4)),
+                _mm256_and_si256(_mm256_srli_epi32(p, 1), mask));
+            colors = _mm256_i32gather_epi32(wide, idx, 4);
+            colors = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(colors, low_bytes),
+                                                 gather_order);
+            _mm_storel_epi64((__m128i*)&out[x], _mm256_castsi256_si128(colors));
+        }
+        remap_row(&src[x], &out[x], width - x, palette_of);
+    }
+}
+
+
+/*
+ * remap_lut_avx2
+ *   DESCRIPTION: Map the pixels of a photo to palette colors through a
+ *                table indexed by pixel value(AVX2 version).  Eight
+ *                pixels at a time are widened to 32 bits and used as
+ *                byte offsets for a gather of four bytes each(hence the
+ *                SIMD_LUT_PAD bytes after the table); the low byte of
+ *                each result is then packed into eight output bytes.
+ *   INPUTS: src -- 5:6:5 RGB pixels, rows from bottom to top
+ *           width, height -- size of photo in pixels
+ *           lut -- palette color for each 5:6:5 pixel value
+ *   OUTPUTS: dst -- palette colors, rows from top to bottom
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("avx2")))
+static void remap_lut_avx2(const uint16_t* src, uint8_t* dst, uint32_t width,
+                           uint32_t height, const uint8_t* lut) {
+    __m256i  p;                    /* 8 pixels, widened              */
+    __m256i  low_bytes;            /* selects byte 0 of each entry   */
+    __m256i  gather_order;         /* moves low bytes together       */
+    __m256i  colors;               /* colors of 8 pixels             */
+    uint8_t* out;                  /* output row                     */
+    uint32_t x;                    /* index over columns             */
+    uint32_t y;                    /* index over rows                */
+
+    low_bytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    gather_order = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+    for (y = height; y-- > 0; src += width) {
+        out = &dst[width * y];
+        for (x = 0; width >= x + 8; x += 8) {
+            p = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&src[x]));
+            colors = _mm256_i32gather_epi32((const int*)lut, p, 1);
+            colors = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(colors, low_bytes),
+                                                 gather_order);
+            _mm_storel_epi64((__m128i*)&out[x], _mm256_castsi256_si128(colors));
+        }
+        for (; width > x; x++) {
+            out[x] = lut[src[x]];
+        }
+    }
+}
+
+/*
+ * deinterleave_sse2
+ *   DESCRIPTION: Split a line of pixels among the four mode X planes
+ *                (SSE2 version).  Sixty-four pixels at a time are split
+ *                into even and odd pixels by masking and packing, and
+ *                each half is split the same way again, leaving sixteen
+ *                pixels for each plane.
+ *   INPUTS: src -- line of pixels
+ *           n -- number of pixels
+ *   OUTPUTS: planes -- pixel 4j + p of the line is written to planes[p][j]
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("sse2")))
+static void deinterleave_sse2(uint8_t* const planes[4], const uint8_t* src, uint32_t n) {
+    __m128i  low = _mm_set1_epi16(0x00FF); /* mask for even pixels   */
+    __m128i  a, b, c, d;                   /* 64 pixels              */
+    __m128i  even0, odd0, even1, odd1;     /* pixels 2k and 2k + 1   */
+    uint32_t i;                            /* index over pixels      */
+    uint8_t* const rest[4] = {             /* planes for pixels left */
+        planes[0] + (n & ~63) / 4, planes[1] + (n & ~63) / 4,
+        planes[2] + (n & ~63) / 4, planes[3] + (n & ~63) / 4
+    };
+
+    for (i = 0; n >= i + 64; i += 64) {
+        a = _mm_loadu_si128((const __m128i*)&src[i]);
+        b = _mm_loadu_si128((const __m128i*)&src[i + 16]);
+        c = _mm_loadu_si128((const __m128i*)&src[i + 32]);
+        d = _mm_loadu_si128((const __m128i*)&src[i + 48]);
+        even0 = _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low));
+        odd0 = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        even1 = _mm_packus_epi16(_mm_and_si128(c, low), _mm_and_si128(d, low));
+        odd1 = _mm_packus_epi16(_mm_srli_epi16(c, 8), _mm_srli_epi16(d, 8));
+        _mm_storeu_si128((__m128i*)&planes[0][i >> 2], _mm_packus_epi16(
+            _mm_and_si128(even0, low), _mm_and_si128(even1, low)));
+        _mm_storeu_si128((__m128i*)&planes[1][i >> 2], _mm_packus_epi16(
+            _mm_and_si128(odd0, low), _mm_and_si128(odd1, low)));
+        _mm_storeu_si128((__m128i*)&planes[2][i >> 2], _mm_packus_epi16(
+            _mm_srli_epi16(even0, 8), _mm_srli_epi16(even1, 8)));
+        _mm_storeu_si128((__m128i*)&planes[3][i >> 2], _mm_packus_epi16(
+            _mm_srli_epi16(odd0, 8), _mm_srli_epi16(odd1, 8)));
+    }
+    deinterleave_scalar(rest, &src[i], n - i);
+}
+
+
+/*
+ * deinterleave_ssse3
+ *   DESCRIPTION: Split a line of pixels among the four mode X planes
+ *                (SSSE3 version).  Each group of sixteen pixels is
+ *                shuffled(pshufb) so that each plane's four pixels are
+ *                adjacent, and four groups are then transposed as 32-bit
+ *                words to collect sixteen pixels for each plane from 64
+ *                pixels.
+ *   INPUTS: src -- line of pixels
+ *           n -- number of pixels
+ *   OUTPUTS: planes -- pixel 4j + p of the line is written to planes[p][j]
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("ssse3")))
+static void deinterleave_ssse3(uint8_t* const planes[4], const uint8_t* src, uint32_t n) {
+    __m128i  split = _mm_setr_epi8(        /* gathers each plane's pixels */
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    __m128i  a, b, c, d;                   /* 64 pixels                   */
+    __m128i  ab_lo, ab_hi, cd_lo, cd_hi;   /* words of a and b, c and d   */
+    uint32_t i;                            /* index over pixels           */
+    uint8_t* const rest[4] = {             /* planes for pixels left      */
+        planes[0] + (n & ~63) / 4, planes[1] + (n & ~63) / 4,
+        planes[2] + (n & ~63) / 4, planes[3] + (n & ~63) / 4
+    };
+
+    for (i = 0; n >= i + 64; i += 64) {
+        a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i]), split);
+        b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i + 16]), split);
+        c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i + 32]), split);
+        d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i + 48]), split);
+        ab_lo = _mm_unpacklo_epi32(a, b);
+        ab_hi = _mm_unpackhi_epi32(a, b);
+        cd_lo = _mm_unpacklo_epi32(c, d);
+        cd_hi = _mm_unpackhi_epi32(c, d);
+        _mm_storeu_si128((__m128i*)&planes[0][i >> 2], _mm_unpacklo_epi64(ab_lo, cd_lo));
+        _mm_storeu_si128((__m128i*)&planes[1][i >> 2], _mm_unpackhi_epi64(ab_lo, cd_lo));
+        _mm_storeu_si128((__m128i*)&planes[2][i >> 2], _mm_unpacklo_epi64(ab_hi, cd_hi));
+        _mm_storeu_si128((__m128i*)&planes[3][i >> 2], _mm_unpackhi_epi64(ab_hi, cd_hi));
+    }
+    deinterleave_scalar(rest, &src[i], n - i);
+}
+
+
+/*
+ * deinterleave_avx2
+ *   DESCRIPTION: Split a line of pixels among the four mode X planes
+ *                (AVX2 version).  Each group of sixteen pixels is
+ *                shuffled so that each plane's four pixels are adjacent,
+ *                and the groups are then transposed as 32-bit words to
+ *                collect 32 pixels for each plane from 128 pixels.  The
+ *                SSSE3 version handles the rest of the line.
+ *   INPUTS: src -- line of pixels
+ *           n -- number of pixels
+ *   OUTPUTS: planes -- pixel 4j + p of the line is written to planes[p][j]
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("avx2")))
+static void deinterleave_avx2(uint8_t* const planes[4], const uint8_t* src, uint32_t n) {
+    __m256i  split = _mm256_setr_epi8(     /* gathers each plane's pixels */
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    __m256i  order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7); /* words in pixel order */
+    __m256i  a, b, c, d;                   /* 128 pixels                  */
+    __m256i  ab_lo, ab_hi, cd_lo, cd_hi;   /* words of a and b, c and d   */
+    uint32_t i;                            /* index over pixels           */
+    uint8_t* const rest[4] = {             /* planes for pixels left      */
+        planes[0] + (n & ~127) / 4, planes[1] + (n & ~127) / 4,
+        planes[2] + (n & ~127) / 4, planes[3] + (n & ~127) / 4
+    };
+
+    for (i = 0; n >= i + 128; i += 128) {
+        a = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)&src[i]), split);
+        b = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)&src[i + 32]), split);
+        c = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)&src[i + 64]), split);
+        d = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)&src[i + 96]), split);
+        ab_lo = _mm256_unpacklo_epi32(a, b);
+        ab_hi = _mm256_unpackhi_epi32(a, b);
+        cd_lo = _mm256_unpacklo_epi32(c, d);
+        cd_hi = _mm256_unpackhi_epi32(c, d);
+        _mm256_storeu_si256((__m256i*)&planes[0][i >> 2], _mm256_permutevar8x32_epi32(
+            _mm256_unpacklo_epi64(ab_lo, cd_lo), order));
+        _mm256_storeu_si256((__m256i*)&planes[1][i >> 2], _mm256_permutevar8x32_epi32(
+            _mm256_unpackhi_epi64(ab_lo, cd_lo), order));
+        _mm256_storeu_si256((__m256i*)&planes[2][i >> 2], _mm256_permutevar8x32_epi32(
+            _mm256_unpacklo_epi64(ab_hi, cd_hi), order));
+        _mm256_storeu_si256((__m256i*)&planes[3][i >> 2], _mm256_permutevar8x32_epi32(
+            _mm256_unpackhi_epi64(ab_hi, cd_hi), order));
+    }
+
+    /*
+     * Clear the upper halves of the AVX registers before running SSE
+     * code, which would otherwise pay to preserve them.
+     */
+    _mm256_zeroupper();
+    deinterleave_ssse3(rest, &src[i], n - i);
+}
+
+
+/*
+ * transpose_sse2
+ *   DESCRIPTION: Write columns of pixels as rows(SSE2 version, also used
+ *                by the SSSE3 and AVX2 kernels).  Blocks of sixteen columns by
+ *                sixteen rows are transposed in registers by interleaving
+ *                bytes, then 16-, 32-, and 64-bit words.
+ *   INPUTS: src -- first column
+ *           src_stride -- distance between columns in src
+ *           cols -- number of columns
+ *           rows -- number of pixels in each column
+ *           dst_stride -- distance between rows in dst
+ *   OUTPUTS: dst -- pixel r of column c is written to dst[r * dst_stride + c]
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("sse2")))
+static void transpose_sse2(uint8_t* dst, uint32_t dst_stride, const uint8_t* src,
+                           uint32_t src_stride, uint32_t cols, uint32_t rows) {
+    __m128i  x[16];  /* block being transposed     */
+    __m128i  t[16];  /* block after interleaving   */
+    uint32_t c;      /* first column of block      */
+    uint32_t r;      /* first row of block         */
+    uint32_t k;      /* index over block registers */
+
+    for (c = 0; cols >= c + 16; c += 16) {
+        for (r = 0; rows >= r + 16; r += 16) {
+            for (k = 0; 16 > k; k++) {
+                x[k] = _mm_loadu_si128((const __m128i*)&src[(c + k) * src_stride + r]);
+            }
+            for (k = 0; 16 > k; k += 2) {
+                t[k] = _mm_unpacklo_epi8(x[k], x[k + 1]);
+                t[k + 1] = _mm_unpackhi_epi8(x[k], x[k + 1]);
+            }
+            for (k = 0; 16 > k; k += 4) {
+                x[k] = _mm_unpacklo_epi16(t[k], t[k + 2]);
+                x[k + 1] = _mm_unpackhi_epi16(t[k], t[k + 2]);
+                x[k + 2] = _mm_unpacklo_epi16(t[k + 1], t[k + 3]);
+                x[k + 3] = _mm_unpackhi_epi16(t[k + 1], t[k + 3]);
+            }
+            for (k = 0; 16 > k; k += 8) {
+                t[k] = _mm_unpacklo_epi32(x[k], x[k + 4]);
+                t[k + 1] = _mm_unpackhi_epi32(x[k], x[k + 4]);
+                t[k + 2] = _mm_unpacklo_epi32(x[k + 1], x[k + 5]);
+                t[k + 3] = _mm_unpackhi_epi32(x[k + 1], x[k + 5]);
+                t[k + 4] = _mm_unpacklo_epi32(x[k + 2], x[k + 6]);
+                t[k + 5] = _mm_unpackhi_epi32(x[k + 2], x[k + 6]);
+                t[k + 6] = _mm_unpacklo_epi32(x[k + 3], x[k + 7]);
+                t[k + 7] = _mm_unpackhi_epi32(x[k + 3], x[k + 7]);
+            }
+            for (k = 0; 8 > k; k++) {
+                _mm_storeu_si128((__m128i*)&dst[(r + 2 * k) * dst_stride + c],
+                                 _mm_unpacklo_epi64(t[k], t[k + 8]));
+                _mm_storeu_si128((__m128i*)&dst[(r + 2 * k + 1) * dst_stride + c],
+                                 _mm_unpackhi_epi64(t[k], t[k + 8]));
+            }
+        }
+        transpose_scalar(&dst[r * dst_stride + c], dst_stride, &src[c * src_stride + r],
+                         src_stride, 16, rows - r);
+    }
+    transpose_scalar(&dst[c], dst_stride, &src[c * src_stride], src_stride, cols - c, rows);
+}
+
+#endif /* defined(SIMD_X86) */
+
+
+/*
+ * simd_histogram
+ *   DESCRIPTION: Add pixels to a level 4 octree histogram using the
+ *                chosen kernel version.
+ *   INPUTS: src -- 5:6:5 RGB pixels
+ *           n -- number of pixels
+ *           level_4 -- the octree histogram
+ *   OUTPUTS: level_4 -- counts and sums added
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: dynamically allocates memory for counters the first
+ *                 time it is called in each thread; if that fails,
+ *                 counts pixels with the scalar octree update instead
+ */
+void simd_histogram(const uint16_t* src, uint32_t n, struct octree_node level_4[LEVEL_4_SIZE]) {
+    uint64_t*           hist;  /* packed sub-histograms  */
+    uint32_t            len;   /* pixels in one chunk    */
+    uint32_t            i;     /* index over pixels      */
+    struct octree_node* node;  /* node for one pixel     */
+
+    (void)pthread_once(&kernels_once, choose_kernels);
+    if (NULL == (hist = thread_hist) &&
+        NULL == (hist = thread_hist = calloc(SUB_HISTS * SUB_BINS, sizeof (hist[0])))) {
+        for (i = 0; n > i; i++) {
+            node = &level_4[LEVEL_4_INDEX(src[i])];
+            node->red_msb += (src[i] >> 11) & 0x1F;
+            node->green_msb += (src[i] >> 5) & 0x3F;
+            node->blue_msb += src[i] & 0x1F;
+            node->number_of_pixels++;
+        }
+        return;
+    }
+    for (; 0 < n; src += len, n -= len) {
+        len = (HIST_CHUNK < n ? HIST_CHUNK : n);
+        (*kernels->count)(src, len, hist);
+        merge_histogram(hist, level_4);
+    }
+}
+
+
+/*
+ * simd_remap
+ *   DESCRIPTION: Map the pixels of a photo to palette colors using the
+ *                chosen kernel version.
+ *   INPUTS: src -- 5:6:5 RGB pixels, rows from bottom to top
+ *           width, height -- size of photo in pixels
+ *           palette_of -- palette color for each 4:4:4 index
+ *   OUTPUTS: dst -- palette colors, rows from top to bottom
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void simd_remap(const uint16_t* src, uint8_t* dst, uint32_t width, uint32_t height,
+                const uint8_t palette_of[LEVEL_4_SIZE]) {
+    (void)pthread_once(&kernels_once, choose_kernels);
+    (*kernels->remap)(src, dst, width, height, palette_of);
+}
+
+
+/*
+ * simd_remap_lut
+ *   DESCRIPTION: Map the pixels of a photo to palette colors through a
+ *                table indexed by pixel value using the chosen kernel
+ *                version.
+ *   INPUTS: src -- 5:6:5 RGB pixels, rows from bottom to top
+ *           width, height -- size of photo in pixels
+ *           lut -- palette color for each 5:6:5 pixel value, followed
+ *                  by SIMD_LUT_PAD readable bytes
+ *   OUTPUTS: dst -- palette colors, rows from top to bottom
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void simd_remap_lut(const uint16_t* src, uint8_t* dst, uint32_t width, uint32_t height,
+                    const uint8_t* lut) {
+    (void)pthread_once(&kernels_once, choose_kernels);
+    (*kernels->remap_lut)(src, dst, width, height, lut);
+}
+
+
+/*
+ * simd_blend
+ *   DESCRIPTION: Draw object pixels over a line, skipping transparent
+ *                pixels, using the chosen kernel version.
+ *   INPUTS: dst -- line of pixels
+ *           src -- object pixels
+ *           n -- number of pixels
+ *           transparent -- color of transparent object pixels
+ *   OUTPUTS: dst -- object pixels drawn
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void simd_blend(uint8_t* dst, const uint8_t* src, uint32_t n, uint8_t transparent) {
+    (void)pthread_once(&kernels_once, choose_kernels);
+    (*kernels->blend)(dst, src, n, transparent);
+}
+
+
+/*
+ * simd_deinterleave
+ *   DESCRIPTION: Split a line of pixels among the four mode X planes
+ *                using the chosen kernel version.
+ *   INPUTS: src -- line of pixels
+ *           n -- number of pixels
+ *   OUTPUTS: planes -- pixel 4j + p of the line is written to planes[p][j]
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void simd_deinterleave(uint8_t* const planes[4], const uint8_t* src, uint32_t n) {
+    (void)pthread_once(&kernels_once, choose_kernels);
+    (*kernels->deinterleave)(planes, src, n);
+}
+
+
+/*
+ * simd_transpose
+ *   DESCRIPTION: Write columns of pixels as rows using the chosen kernel
+ *                version.
+ *   INPUTS: src -- first column
+ *           src_stride -- distance between columns in src
+ *           cols -- number of columns
+ *           rows -- number of pixels in each column
+ *           dst_stride -- distance between rows in dst
+ *   OUTPUTS: dst -- pixel r of column c is written to dst[r * dst_stride + c]
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void simd_transpose(uint8_t* dst, uint32_t dst_stride, const uint8_t* src,
+                    uint32_t src_stride, uint32_t cols, uint32_t rows) {
+    (void)pthread_once(&kernels_once, choose_kernels);
+    (*kernels->transpose)(dst, dst_stride, src, src_stride, cols, rows);
+}
+
+
+/*
+ * simd_kernel_name
+ *   DESCRIPTION: Get the name of the kernel version in use.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: "scalar", "sse2", "ssse3", or "avx2"
+ *   SIDE EFFECTS: chooses the kernel version if not yet chosen
+ */
+const char* simd_kernel_name() {
+    (void)pthread_once(&kernels_once, choose_kernels);
+    return kernels->name;
+}
+
+
+/*
+ * simd_use_kernels
+ *   DESCRIPTION: Switch to a kernel version by name, overriding the
+ *                choice made from the CPU and ADVENTURE_SIMD.  Used to
+ *                compare the versions; no other thread may be running a
+ *                kernel.
+ *   INPUTS: name -- "scalar", "sse2", "ssse3", or "avx2"
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or -1 if the version is unknown or not
+ *                 supported by the CPU
+ *   SIDE EFFECTS: sets kernels
+ */
+int32_t simd_use_kernels(const char* name) {
+    const simd_kernels_t* k;  /* version found */
+
+    (void)pthread_once(&kernels_once, choose_kernels);
+    if (NULL == (k = find_kernels(name))) {
+        return -1;
+    }
+    kernels = k;
+    return 0;
+}
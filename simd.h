@@ -0,0 +1,86 @@
+/* tab:4
+ *
+ * simd.h - header file for the vectorized photo quantization kernels
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      simd.h
+ */
+#ifndef SIMD_H
+#define SIMD_H
+
+
+#include <stdint.h>
+
+#include "photo.h"
+
+
+/*
+ * Per-pixel kernels used to quantize and draw room photos and to move
+ * lines of pixels into the mode X planes.  Each kernel has a scalar
+ * version and, on x86, SSE2, SSSE3, and AVX2 versions(the SSSE3 set
+ * differs from SSE2 only in simd_deinterleave); the fastest version
+ * supported by the CPU is chosen the first time a kernel is called.
+ * The ADVENTURE_SIMD environment variable("scalar", "sse2", "ssse3", or
+ * "avx2") limits the choice, which is useful for comparing the versions.
+ * All versions produce identical results(see simd_check.c).
+ */
+
+/*
+ * Add the 5:6:5 RGB pixels src[0..n-1] to a level 4 octree histogram:
+ * each pixel adds its red, green, and blue values and a count of one to
+ * the node with its 4:4:4 index.
+ */
+extern void simd_histogram(const uint16_t* src, uint32_t n,
+                           struct octree_node level_4[LEVEL_4_SIZE]);
+
+/*
+ * Map the 5:6:5 RGB pixels of a width x height photo to palette colors:
+ * each pixel becomes palette_of[] at its 4:4:4 index.  As in photo files,
+ * src holds rows from bottom to top; dst receives rows from top to bottom.
+ */
+extern void simd_remap(const uint16_t* src, uint8_t* dst, uint32_t width,
+                       uint32_t height, const uint8_t palette_of[LEVEL_4_SIZE]);
+
+/*
+ * Map the 5:6:5 RGB pixels of a width x height photo to palette colors
+ * through a table indexed by the pixel value itself(PHOTO_LUT_SIZE
+ * entries).  Rows are flipped as in simd_remap.  The AVX2 version reads
+ * four bytes per lookup, so the table must be followed by SIMD_LUT_PAD
+ * readable bytes.
+ */
+#define SIMD_LUT_PAD 3
+extern void simd_remap_lut(const uint16_t* src, uint8_t* dst, uint32_t width,
+                           uint32_t height, const uint8_t* lut);
+
+/*
+ * Draw n pixels of an object image over a line of pixels: each pixel of
+ * src replaces the pixel of dst unless it has the transparent color.
+ */
+extern void simd_blend(uint8_t* dst, const uint8_t* src, uint32_t n, uint8_t transparent);
+
+/*
+ * Split n pixels of a line among the four mode X planes: pixel 4j + p
+ * is written to planes[p][j].
+ */
+extern void simd_deinterleave(uint8_t* const planes[4], const uint8_t* src, uint32_t n);
+
+/*
+ * Write cols columns of rows pixels each as rows: pixel r of the column
+ * at src + c * src_stride is written to dst[r * dst_stride + c].
+ */
+extern void simd_transpose(uint8_t* dst, uint32_t dst_stride, const uint8_t* src,
+                           uint32_t src_stride, uint32_t cols, uint32_t rows);
+
+/* Get the name of the kernel version in use("scalar", "sse2", "ssse3", "avx2"). */
+extern const char* simd_kernel_name(void);
+
+/*
+ * Switch to a kernel version by name, for comparing the versions.  No
+ * other thread may be running a kernel.  Returns 0 on success, or -1 if
+ * the version is unknown or not supported by the CPU.
+ */
+extern int32_t simd_use_kernels(const char* name);
+
+#endif /* SIMD_H */
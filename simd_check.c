@@ -0,0 +1,417 @@
+/* tab:4
+ *
+ * simd_check.c - test program comparing the kernels of each vectorized
+ *                kernel version with the scalar version
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      simd_check.c
+ */
+
+
+/*
+ * This file is a standalone test program(run by "make check").  For each
+ * kernel version supported by the CPU, every kernel is called on random
+ * inputs--random sizes(favoring those just past a multiple of the vector
+ * width, which leave short tails), random alignment of every pointer,
+ * and random strides--and the whole output buffers, including the bytes
+ * around the area written, are compared with those written by the
+ * scalar version.  The histogram is also given more than HIST_CHUNK
+ * pixels of a single color, so that its packed counters are filled and
+ * merged more than once.  An optional argument gives the random seed.
+ */
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd.h"
+
+
+#define CHECK_CASES  4000 /* random cases for each kernel and version */
+#define HIST_CASES   200  /* random cases for the histogram(slower)   */
+#define HIST_CHUNK   0x100000 /* pixels the histogram counts before    */
+                              /* ... merging(as in simd.c)             */
+#define MAX_PIXELS   4000 /* most pixels in a random histogram case   */
+#define MAX_WIDTH    300  /* widest photo given to the remap kernels  */
+#define MAX_HEIGHT   5    /* tallest photo given to the remap kernels */
+#define MAX_LINE     1300 /* longest line given to simd_deinterleave  */
+#define MAX_BLOCK    80   /* most columns or rows of a transpose      */
+#define MAX_PAD      20   /* most extra bytes in a stride             */
+#define MAX_SKEW     32   /* most bytes by which a pointer is offset  */
+#define GUARD        64   /* bytes checked after the area written     */
+
+
+/* local functions--see function headers for details */
+static int32_t check_blend(const char* name, int32_t cases);
+static int32_t check_deinterleave(const char* name, int32_t cases);
+static int32_t check_histogram(const char* name, int32_t cases);
+static int32_t check_remap(const char* name, int32_t cases);
+static int32_t check_transpose(const char* name, int32_t cases);
+static void fill_pixels(uint16_t* px, uint32_t n);
+static void fill_random(uint8_t* buf, uint32_t len);
+static uint32_t random_length(uint32_t max);
+
+
+/*
+ * fill_random
+ *   DESCRIPTION: Fill a buffer with random bytes.
+ *   INPUTS: len -- size of buffer
+ *   OUTPUTS: buf -- random bytes
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: advances the rand sequence
+ */
+static void fill_random(uint8_t* buf, uint32_t len) {
+    uint32_t i;  /* index over bytes */
+
+    for (i = 0; len > i; i++) {
+        buf[i] = rand();
+    }
+}
+
+
+/*
+ * fill_pixels
+ *   DESCRIPTION: Fill a buffer with random 5:6:5 RGB pixels, mixing runs
+ *                of one color(as in photos) with unrelated pixels.
+ *   INPUTS: n -- number of pixels
+ *   OUTPUTS: px -- random pixels
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: advances the rand sequence
+ */
+static void fill_pixels(uint16_t* px, uint32_t n) {
+    uint32_t i;  /* index over pixels */
+
+    for (i = 0; n > i; i++) {
+        px[i] = (0 < i && 0 != rand() % 4 ? px[i - 1] : rand());
+    }
+}
+
+
+/*
+ * random_length
+ *   DESCRIPTION: Choose a random number of pixels, favoring lengths
+ *                just past a multiple of 16, 32, or 64, which leave the
+ *                vector versions a short tail.
+ *   INPUTS: max -- largest length
+ *   OUTPUTS: none
+ *   RETURN VALUE: the length
+ *   SIDE EFFECTS: advances the rand sequence
+ */
+static uint32_t random_length(uint32_t max) {
+    uint32_t n;  /* the length */
+
+    n = (0 == rand() % 2 ? rand() % (max + 1) :
+         (16 << (rand() % 3)) * (rand() % 5) + rand() % 16);
+    return (max < n ? max : n);
+}
+
+
+/*
+ * check_histogram
+ *   DESCRIPTION: Compare simd_histogram in a kernel version with the
+ *                scalar version on random pixels added to a histogram
+ *                that already holds random counts.  The first case has
+ *                more than HIST_CHUNK pixels of the color whose low bits
+ *                are all set, so that the packed counters fill every
+ *                field and are merged more than once.
+ *   INPUTS: name -- kernel version to check
+ *           cases -- number of random cases
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if all outputs match, or -1 otherwise
+ *   SIDE EFFECTS: prints the first mismatch to stderr
+ */
+static int32_t check_histogram(const char* name, int32_t cases) {
+    static uint16_t           src[HIST_CHUNK + MAX_PIXELS]; /* pixels         */
+    static struct octree_node ref[LEVEL_4_SIZE];            /* scalar counts  */
+    static struct octree_node out[LEVEL_4_SIZE];            /* checked counts */
+    const uint16_t* px;  /* first pixel counted  */
+    uint32_t        n;   /* pixels counted       */
+    uint32_t        k;   /* index over nodes     */
+    int32_t         i;   /* index over cases     */
+
+    for (i = 0; cases > i; i++) {
+        if (0 == i) {
+            n = HIST_CHUNK + 1 + rand() % MAX_PIXELS;
+            for (k = 0; n > k; k++) {
+                src[k] = 0xFFFF;
+            }
+            px = src;
+        }
+        else {
+            n = random_length(MAX_PIXELS);
+            px = &src[rand() % MAX_SKEW];
+            fill_pixels(src, MAX_PIXELS + MAX_SKEW);
+        }
+        for (k = 0; LEVEL_4_SIZE > k; k++) {
+            ref[k].red_msb = rand() % 0x10000;
+            ref[k].green_msb = rand() % 0x10000;
+            ref[k].blue_msb = rand() % 0x10000;
+            ref[k].number_of_pixels = rand() % 0x1000;
+        }
+        (void)memcpy(out, ref, sizeof (out));
+
+        (void)simd_use_kernels("scalar");
+        simd_histogram(px, n, ref);
+        (void)simd_use_kernels(name);
+        simd_histogram(px, n, out);
+        if (0 != memcmp(out, ref, sizeof (out))) {
+            fprintf(stderr, "simd_check: %s histogram differs from scalar for %u pixels "
+                    "at offset %u\n", name, n, (uint32_t)(px - src));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * check_remap
+ *   DESCRIPTION: Compare simd_remap and simd_remap_lut in a kernel
+ *                version with the scalar version on random photos, with
+ *                a random palette and table.  Photos are a few rows of
+ *                random width, with the pixels and the output each at a
+ *                random offset.
+ *   INPUTS: name -- kernel version to check
+ *           cases -- number of random photos
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if all outputs match, or -1 otherwise
+ *   SIDE EFFECTS: prints the first mismatch to stderr
+ */
+static int32_t check_remap(const char* name, int32_t cases) {
+    static uint16_t src[MAX_WIDTH * MAX_HEIGHT + MAX_SKEW];         /* pixels     */
+    static uint8_t  ref[MAX_WIDTH * MAX_HEIGHT + MAX_SKEW + GUARD]; /* scalar     */
+    static uint8_t  out[MAX_WIDTH * MAX_HEIGHT + MAX_SKEW + GUARD]; /* checked    */
+    static uint8_t  palette_of[LEVEL_4_SIZE];                       /* colors     */
+    static uint8_t  lut[PHOTO_LUT_SIZE + SIMD_LUT_PAD];             /* table      */
+    const uint16_t* px;         /* first pixel of photo       */
+    uint32_t        width;      /* size of photo              */
+    uint32_t        height;
+    uint32_t        dst_skew;   /* offset of output in buffer */
+    int32_t         table;      /* remapping through lut      */
+    int32_t         i;          /* index over cases           */
+
+    fill_random(palette_of, sizeof (palette_of));
+    fill_random(lut, sizeof (lut));
+    for (i = 0; cases > i; i++) {
+        width = 1 + random_length(MAX_WIDTH - 1);
+        height = 1 + rand() % MAX_HEIGHT;
+        table = (i & 1);
+        px = &src[rand() % MAX_SKEW];
+        dst_skew = rand() % MAX_SKEW;
+        fill_pixels(src, sizeof (src) / sizeof (src[0]));
+        fill_random(ref, sizeof (ref));
+        (void)memcpy(out, ref, sizeof (out));
+
+        (void)simd_use_kernels("scalar");
+        if (table) {
+            simd_remap_lut(px, &ref[dst_skew], width, height, lut);
+        }
+        else {
+            simd_remap(px, &ref[dst_skew], width, height, palette_of);
+        }
+        (void)simd_use_kernels(name);
+        if (table) {
+            simd_remap_lut(px, &out[dst_skew], width, height, lut);
+        }
+        else {
+            simd_remap(px, &out[dst_skew], width, height, palette_of);
+        }
+        if (0 != memcmp(out, ref, sizeof (out))) {
+            fprintf(stderr, "simd_check: %s %s differs from scalar for %u x %u "
+                    "(offsets %u and %u)\n", name, (table ? "remap by table" : "remap"),
+                    width, height, (uint32_t)(px - src), dst_skew);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * check_blend
+ *   DESCRIPTION: Compare simd_blend in a kernel version with the scalar
+ *                version on random lines of object pixels, about a third
+ *                of which have the transparent color.
+ *   INPUTS: name -- kernel version to check
+ *           cases -- number of random lines
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if all outputs match, or -1 otherwise
+ *   SIDE EFFECTS: prints the first mismatch to stderr
+ */
+static int32_t check_blend(const char* name, int32_t cases) {
+    static uint8_t src[MAX_LINE + MAX_SKEW];         /* object pixels  */
+    static uint8_t ref[MAX_LINE + MAX_SKEW + GUARD]; /* scalar output  */
+    static uint8_t out[MAX_LINE + MAX_SKEW + GUARD]; /* checked output */
+    const uint8_t* obj;          /* first object pixel          */
+    uint32_t       n;            /* pixels in line              */
+    uint32_t       dst_skew;     /* offset of line in ref, out  */
+    uint8_t        transparent;  /* transparent color           */
+    uint32_t       k;            /* index over pixels           */
+    int32_t        i;            /* index over cases            */
+
+    for (i = 0; cases > i; i++) {
+        n = random_length(MAX_LINE);
+        obj = &src[rand() % MAX_SKEW];
+        dst_skew = rand() % MAX_SKEW;
+        transparent = rand();
+        for (k = 0; sizeof (src) > k; k++) {
+            src[k] = (0 == rand() % 3 ? transparent : rand());
+        }
+        fill_random(ref, sizeof (ref));
+        (void)memcpy(out, ref, sizeof (out));
+
+        (void)simd_use_kernels("scalar");
+        simd_blend(&ref[dst_skew], obj, n, transparent);
+        (void)simd_use_kernels(name);
+        simd_blend(&out[dst_skew], obj, n, transparent);
+        if (0 != memcmp(out, ref, sizeof (out))) {
+            fprintf(stderr, "simd_check: %s blend differs from scalar for %u pixels "
+                    "(offsets %u and %u)\n", name, n, (uint32_t)(obj - src), dst_skew);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * check_deinterleave
+ *   DESCRIPTION: Compare simd_deinterleave in a kernel version with the
+ *                scalar version on random lines.  Each plane is written
+ *                into its own buffer at a random offset; lengths near
+ *                the block sizes of the vector versions are favored.
+ *   INPUTS: name -- kernel version to check
+ *           cases -- number of random lines
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if all outputs match, or -1 otherwise
+ *   SIDE EFFECTS: prints the first mismatch to stderr
+ */
+static int32_t check_deinterleave(const char* name, int32_t cases) {
+    static uint8_t src[MAX_LINE + MAX_SKEW];                /* line of pixels */
+    static uint8_t ref[4][MAX_LINE / 4 + MAX_SKEW + GUARD]; /* scalar planes  */
+    static uint8_t out[4][MAX_LINE / 4 + MAX_SKEW + GUARD]; /* checked planes */
+    uint8_t*       ref_planes[4]; /* planes written by scalar version  */
+    uint8_t*       out_planes[4]; /* planes written by checked version */
+    const uint8_t* line;          /* first pixel of line               */
+    uint32_t       n;             /* pixels in line                    */
+    uint32_t       skew;          /* offset of a plane in its buffer   */
+    int32_t        p;             /* index over planes                 */
+    int32_t        i;             /* index over cases                  */
+
+    for (i = 0; cases > i; i++) {
+        n = (0 == (i & 1) ? rand() % (MAX_LINE + 1) :
+             (64 << (rand() % 3)) * (rand() % 4) + rand() % 8);
+        n = (MAX_LINE < n ? MAX_LINE : n);
+        line = &src[rand() % MAX_SKEW];
+        fill_random(src, sizeof (src));
+        fill_random((uint8_t*)ref, sizeof (ref));
+        (void)memcpy(out, ref, sizeof (out));
+        for (p = 0; 4 > p; p++) {
+            skew = rand() % MAX_SKEW;
+            ref_planes[p] = &ref[p][skew];
+            out_planes[p] = &out[p][skew];
+        }
+
+        (void)simd_use_kernels("scalar");
+        simd_deinterleave(ref_planes, line, n);
+        (void)simd_use_kernels(name);
+        simd_deinterleave(out_planes, line, n);
+        if (0 != memcmp(out, ref, sizeof (out))) {
+            fprintf(stderr, "simd_check: %s deinterleave differs from scalar for %u pixels "
+                    "at offset %u\n", name, n, (uint32_t)(line - src));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * check_transpose
+ *   DESCRIPTION: Compare simd_transpose in a kernel version with the
+ *                scalar version on random blocks with random strides and
+ *                offsets.
+ *   INPUTS: name -- kernel version to check
+ *           cases -- number of random blocks
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if all outputs match, or -1 otherwise
+ *   SIDE EFFECTS: prints the first mismatch to stderr
+ */
+static int32_t check_transpose(const char* name, int32_t cases) {
+    static uint8_t src[MAX_BLOCK * (MAX_BLOCK + MAX_PAD) + MAX_SKEW];         /* columns */
+    static uint8_t ref[MAX_BLOCK * (MAX_BLOCK + MAX_PAD) + MAX_SKEW + GUARD]; /* scalar  */
+    static uint8_t out[MAX_BLOCK * (MAX_BLOCK + MAX_PAD) + MAX_SKEW + GUARD]; /* checked */
+    uint32_t       cols;       /* columns in block              */
+    uint32_t       rows;       /* pixels in each column         */
+    uint32_t       src_stride; /* distance between columns      */
+    uint32_t       dst_stride; /* distance between rows         */
+    uint32_t       src_skew;   /* offset of block in src        */
+    uint32_t       dst_skew;   /* offset of rows in ref and out */
+    int32_t        i;          /* index over cases              */
+
+    for (i = 0; cases > i; i++) {
+        cols = rand() % (MAX_BLOCK + 1);
+        rows = rand() % (MAX_BLOCK + 1);
+        src_stride = rows + rand() % (MAX_PAD + 1);
+        dst_stride = cols + rand() % (MAX_PAD + 1);
+        src_skew = rand() % MAX_SKEW;
+        dst_skew = rand() % MAX_SKEW;
+        fill_random(src, sizeof (src));
+        fill_random(ref, sizeof (ref));
+        (void)memcpy(out, ref, sizeof (out));
+
+        (void)simd_use_kernels("scalar");
+        simd_transpose(&ref[dst_skew], dst_stride, &src[src_skew], src_stride, cols, rows);
+        (void)simd_use_kernels(name);
+        simd_transpose(&out[dst_skew], dst_stride, &src[src_skew], src_stride, cols, rows);
+        if (0 != memcmp(out, ref, sizeof (out))) {
+            fprintf(stderr, "simd_check: %s transpose differs from scalar for %u x %u "
+                    "(strides %u and %u, offsets %u and %u)\n", name, cols, rows,
+                    src_stride, dst_stride, src_skew, dst_skew);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * main
+ *   DESCRIPTION: Check each kernel version supported by the CPU against
+ *                the scalar version.
+ *   INPUTS: argc, argv -- optional random seed
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if every version matches, or 1 otherwise
+ *   SIDE EFFECTS: prints a line for each version
+ */
+int main(int argc, char** argv) {
+    static const char* const versions[] = { /* versions to compare */
+        "sse2", "ssse3", "avx2"
+    };
+    uint32_t seed = (1 < argc ? strtoul(argv[1], NULL, 0) : 391); /* random seed */
+    uint32_t i;          /* index over versions */
+    int32_t  failed = 0; /* a version is wrong  */
+
+    srand(seed);
+    for (i = 0; sizeof (versions) / sizeof (versions[0]) > i; i++) {
+        if (0 != simd_use_kernels(versions[i])) {
+            printf("simd_check: %s: not supported, skipped\n", versions[i]);
+            continue;
+        }
+        if (0 != check_histogram(versions[i], HIST_CASES) ||
+            0 != check_remap(versions[i], CHECK_CASES) ||
+            0 != check_blend(versions[i], CHECK_CASES) ||
+            0 != check_deinterleave(versions[i], CHECK_CASES) ||
+            0 != check_transpose(versions[i], CHECK_CASES)) {
+            failed = 1;
+            continue;
+        }
+        printf("simd_check: %s: every kernel matches scalar(%d histograms, %d cases of "
+               "each other kernel, seed %u)\n", versions[i], HIST_CASES, CHECK_CASES, seed);
+    }
+    return failed;
+}
@@ -37,6 +37,7 @@
 
 #include "text.h"
 #include "modex.h"
+#include "trace.h"
 
 /*
  * These font data were read out of video memory during text mode and
@@ -562,6 +563,9 @@ unsigned char font_data[256][16] = {
      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
 };
 
+/* the status bar image(declared in modex.h) */
+unsigned char buffer[STATUS_BAR_SIZE];
+
 /*
  * text_to_graphics
  *     DESCRIPTION: Fills the buffer with text-image data.
@@ -570,7 +574,6 @@ unsigned char font_data[256][16] = {
  *     RETURN VALUE: none
  *     SIDE EFFECTS: Fills the buffer array with corresponding converted text-image.
  */
-extern unsigned char buffer[BUFFER_SIZE];
 void text_to_graphics(char input_type, const char* input_string_pointer) {
 
 	/* Image size = 320 per row, 16 pixel for text + 1 pixel above + 1 pixel below */
@@ -582,12 +585,15 @@ void text_to_graphics(char input_type, const char* input_string_pointer) {
 	char input_string[string_length];
 	strcpy(input_string, input_string_pointer);	
 
+	TRACE_BEGIN("text_to_graphics");
+
 	/* Clear or initialize the screen with no components */
 	if (input_type == 'C') {
-		for (i = 0; i < BUFFER_SIZE; i++) {
+		for (i = 0; i < STATUS_BAR_SIZE; i++) {
 			/* Fill the background with blue color, 3 is the color for blue */
 			buffer[i] = BLUE_CODE;
 		}
+		TRACE_END("text_to_graphics");
 		return;
 	}
 	
@@ -600,7 +606,7 @@ void text_to_graphics(char input_type, const char* input_string_pointer) {
 	/* Clear all the components first, then display only the status message */
 	/* Display on the center */
 	else if (input_type == 'S') {
-		for (i = 0; i < BUFFER_SIZE; i++) {
+		for (i = 0; i < STATUS_BAR_SIZE; i++) {
 			buffer[i] = BLUE_CODE;
 		}
 		offset = (PIXELS_PER_ROW - TEXT_PIXEL_WIDTH * string_length) / 2;
@@ -634,5 +640,6 @@ void text_to_graphics(char input_type, const char* input_string_pointer) {
 		}
 	}
 	
+	TRACE_END("text_to_graphics");
 	return;	
 }
@@ -39,7 +39,6 @@
 /* The default VGA text mode font is 8x16 pixels. */
 #define FONT_WIDTH   8
 #define FONT_HEIGHT 16
-#define BUFFER_SIZE 5760
 #define BLUE_CODE 3
 #define YELLOW_CODE 0x3C
 #define BIT_MASK 0x80
@@ -0,0 +1,265 @@
+/* tab:4
+ *
+ * trace.c - frame-phase tracing with Chrome trace-event export
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      trace.c
+ */
+
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "trace.h"
+
+
+/* limit on the number of threads traced */
+#define MAX_TRACE_THREADS 80
+
+
+/* types local to this file(declared in trace.h) */
+
+/* A recorded event. */
+typedef struct trace_ev_t trace_ev_t;
+struct trace_ev_t {
+    uint64_t    ns;     /* time since tracing started(ns) */
+    const char* name;   /* name of the phase              */
+    char        phase;  /* 'B' for begin, 'E' for end     */
+};
+
+/*
+ * The events of one thread.  Only the owning thread writes the ring;
+ * count is the number of events ever recorded, so the newest event is
+ * at (count - 1) % TRACE_RING_EVENTS.
+ */
+typedef struct trace_ring_t trace_ring_t;
+struct trace_ring_t {
+    const char* name;                     /* thread name, or NULL */
+    uint64_t    count;                    /* events recorded      */
+    trace_ev_t  ev[TRACE_RING_EVENTS];    /* the ring             */
+};
+
+
+/* local functions--see function headers for details */
+static trace_ring_t* claim_ring(void);
+static uint64_t trace_clock(void);
+
+
+/* file-scope variables */
+volatile int32_t trace_on = 0;             /* tracing is on            */
+static const char* trace_file = NULL;      /* file written by dump     */
+static struct timespec trace_start;        /* time tracing started     */
+static trace_ring_t* rings[MAX_TRACE_THREADS]; /* rings of all threads */
+static int32_t n_rings = 0;                /* number of rings claimed  */
+static int32_t dropped_threads = 0;        /* threads without a ring   */
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER; /* claims */
+static __thread trace_ring_t* my_ring = NULL; /* calling thread's ring */
+static __thread int32_t no_ring = 0;      /* no ring could be claimed */
+
+
+/*
+ * trace_init
+ *   DESCRIPTION: Turn tracing on if the ADVENTURE_TRACE environment
+ *                variable names a file to write, and name the calling
+ *                thread "main".
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may allocate the calling thread's ring
+ */
+void trace_init() {
+    if (NULL == (trace_file = getenv("ADVENTURE_TRACE")) || '\0' == trace_file[0]) {
+        return;
+    }
+    (void)clock_gettime(CLOCK_MONOTONIC, &trace_start);
+    trace_on = 1;
+    trace_thread_name("main");
+}
+
+
+/*
+ * trace_clock
+ *   DESCRIPTION: Get the time since tracing started.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: time in nanoseconds
+ *   SIDE EFFECTS: none
+ */
+static uint64_t trace_clock() {
+    struct timespec now; /* current time */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - trace_start.tv_sec) * 1000000000 +
+           (now.tv_nsec - trace_start.tv_nsec);
+}
+
+
+/*
+ * claim_ring
+ *   DESCRIPTION: Allocate a ring for the calling thread.  Each thread
+ *                tries only once; threads beyond MAX_TRACE_THREADS, or
+ *                for which allocation fails, are not traced.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the calling thread's ring, or NULL if it has none
+ *   SIDE EFFECTS: dynamically allocates memory
+ */
+static trace_ring_t* claim_ring() {
+    trace_ring_t* ring; /* the new ring */
+
+    if (no_ring) {
+        return NULL;
+    }
+    no_ring = 1;
+    if (NULL == (ring = malloc(sizeof (*ring)))) {
+        return NULL;
+    }
+    ring->name = NULL;
+    ring->count = 0;
+
+    (void)pthread_mutex_lock(&ring_lock);
+    if (MAX_TRACE_THREADS > n_rings) {
+        rings[n_rings++] = ring;
+        my_ring = ring;
+    }
+    else {
+        dropped_threads++;
+    }
+    (void)pthread_mutex_unlock(&ring_lock);
+
+    if (NULL == my_ring) {
+        free(ring);
+    }
+    return my_ring;
+}
+
+
+/*
+ * trace_event
+ *   DESCRIPTION: Record an event in the calling thread's ring.  Called
+ *                through TRACE_BEGIN and TRACE_END, which check that
+ *                tracing is on.
+ *   INPUTS: name -- name of the phase(a string constant)
+ *           phase -- 'B' at the start of the phase, 'E' at the end
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may overwrite the thread's oldest event
+ */
+void trace_event(const char* name, char phase) {
+    trace_ring_t* ring = my_ring; /* the calling thread's ring */
+    trace_ev_t*   ev;             /* the new event             */
+
+    if (NULL == ring && NULL == (ring = claim_ring())) {
+        return;
+    }
+    ev = &ring->ev[ring->count % TRACE_RING_EVENTS];
+    ev->ns = trace_clock();
+    ev->name = name;
+    ev->phase = phase;
+    ring->count++;
+}
+
+
+/*
+ * trace_thread_name
+ *   DESCRIPTION: Name the calling thread in the trace.
+ *   INPUTS: name -- the name(a string constant)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may allocate the calling thread's ring
+ */
+void trace_thread_name(const char* name) {
+    trace_ring_t* ring = my_ring; /* the calling thread's ring */
+
+    if (!trace_on || (NULL == ring && NULL == (ring = claim_ring()))) {
+        return;
+    }
+    ring->name = name;
+}
+
+
+/*
+ * trace_dump
+ *   DESCRIPTION: Turn tracing off and write every thread's events to the
+ *                file named by ADVENTURE_TRACE in Chrome trace-event
+ *                JSON format.  When a ring has wrapped, end events whose
+ *                begin events were overwritten are left out.  Threads
+ *                still running may record one last event while the
+ *                file is written; that event may be lost.
+ *   INPUTS: ignore -- ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes the trace file; prints a summary to stdout
+ */
+void trace_dump(void* ignore) {
+    FILE*         f;        /* the trace file                      */
+    trace_ring_t* ring;     /* ring being written                  */
+    trace_ev_t*   ev;       /* event being written                 */
+    uint64_t      count;    /* events recorded by the thread       */
+    uint64_t      k;        /* loop index over the ring's events   */
+    uint64_t      written;  /* events written to the file          */
+    uint64_t      lost;     /* events overwritten in the rings     */
+    int32_t       depth;    /* phases open in the thread           */
+    int32_t       i;        /* loop index over rings               */
+    const char*   sep = ""; /* separator before the next event     */
+
+    if (!trace_on) {
+        return;
+    }
+    trace_on = 0;
+
+    if (NULL == (f = fopen(trace_file, "w"))) {
+        perror(trace_file);
+        return;
+    }
+    (void)fprintf(f, "{\"traceEvents\":[");
+    written = lost = 0;
+    (void)pthread_mutex_lock(&ring_lock);
+    for (i = 0; n_rings > i; i++) {
+        ring = rings[i];
+        count = ring->count;
+        if (NULL != ring->name) {
+            (void)fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                          "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", sep, i + 1, ring->name);
+            sep = ",";
+        }
+        k = (TRACE_RING_EVENTS < count ? count - TRACE_RING_EVENTS : 0);
+        lost += k;
+        for (depth = 0; count > k; k++) {
+            ev = &ring->ev[k % TRACE_RING_EVENTS];
+            if ('E' == ev->phase) {
+                if (0 == depth) {
+                    continue;
+                }
+                depth--;
+            }
+            else {
+                depth++;
+            }
+            (void)fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,"
+                          "\"pid\":1,\"tid\":%d}", sep, ev->name, ev->phase,
+                          (unsigned long long)(ev->ns / 1000),
+                          (unsigned)(ev->ns % 1000), i + 1);
+            sep = ",";
+            written++;
+        }
+    }
+    (void)fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    (void)fclose(f);
+
+    printf("trace: %llu events from %d threads written to %s",
+           (unsigned long long)written, n_rings, trace_file);
+    if (0 < lost) {
+        printf("; %llu oldest events overwritten", (unsigned long long)lost);
+    }
+    if (0 < dropped_threads) {
+        printf("; %d threads not traced", dropped_threads);
+    }
+    printf("\n");
+    (void)pthread_mutex_unlock(&ring_lock);
+}
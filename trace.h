@@ -0,0 +1,77 @@
+/* tab:4
+ *
+ * trace.h - header file for frame-phase tracing
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      trace.h
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+
+#include <stdint.h>
+
+
+/*
+ * Scoped trace points mark the start and end of the phases of the game
+ * loop(reading commands, drawing lines, filling buffers, showing the
+ * screen, and so on).  Each thread records its events in its own ring
+ * of TRACE_RING_EVENTS entries, allocated when the thread records its
+ * first event; once a ring is full, its oldest events are overwritten.
+ * On exit, all rings are written as a Chrome trace-event JSON file,
+ * which can be opened with chrome://tracing or Perfetto.
+ *
+ * Tracing is turned on by setting the ADVENTURE_TRACE environment
+ * variable to the name of the file to write.  When tracing is off, each
+ * trace point costs one load and a branch, so the trace points stay in
+ * normal builds.
+ *
+ * The name passed to a trace point must be a string constant: only the
+ * pointer is recorded.  Every TRACE_BEGIN must be matched by a
+ * TRACE_END with the same name in the same thread.
+ */
+
+/* number of events kept per thread */
+#define TRACE_RING_EVENTS 65536
+
+/* nonzero while tracing is on(set by trace_init) */
+extern volatile int32_t trace_on;
+
+/* Mark the start of a phase. */
+#define TRACE_BEGIN(name)               \
+do {                                    \
+    if (trace_on) {                     \
+        trace_event((name), 'B');       \
+    }                                   \
+} while (0)
+
+/* Mark the end of a phase. */
+#define TRACE_END(name)                 \
+do {                                    \
+    if (trace_on) {                     \
+        trace_event((name), 'E');       \
+    }                                   \
+} while (0)
+
+/*
+ * Turn tracing on if ADVENTURE_TRACE is set.  Call from the main thread
+ * before other threads start.
+ */
+extern void trace_init(void);
+
+/* Record an event(phase 'B' or 'E') for the calling thread. */
+extern void trace_event(const char* name, char phase);
+
+/* Name the calling thread in the trace(name must be a string constant). */
+extern void trace_thread_name(const char* name);
+
+/*
+ * Turn tracing off and write the events recorded by all threads to the
+ * file named by ADVENTURE_TRACE.  Does nothing if tracing is off.  The
+ * argument is ignored(for use as a cleanup function).
+ */
+extern void trace_dump(void* ignore);
+
+#endif /* TRACE_H */
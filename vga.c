@@ -0,0 +1,642 @@
+/* tab:4
+ *
+ * vga.c - VGA hardware access backends
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      vga.c
+ */
+
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define VGA_X86 1
+#include <sys/io.h>
+#endif
+
+#include "vga.h"
+
+
+/* VGA memory parameters */
+#define VID_MEM_SIZE    131072  /* bytes mapped at 0xA0000           */
+#define PLANE_SIZE       65536  /* bytes in each plane               */
+
+/* numbers of registers in each model register file */
+#define NUM_SEQ_REGS         8
+#define NUM_CRTC_REGS       32
+#define NUM_GFX_REGS        16
+#define NUM_ATTR_REGS       32
+
+
+/* A backend: one function for each operation in vga.h. */
+typedef struct vga_ops_t vga_ops_t;
+struct vga_ops_t {
+    const char* name;
+    int32_t (*open)(void);
+    void (*close)(void);
+    void (*outb)(uint16_t port, uint8_t val);
+    uint8_t (*inb)(uint16_t port);
+    void (*write)(uint32_t addr, const void* src, uint32_t len);
+    void (*fill)(uint32_t addr, uint8_t val, uint32_t len);
+};
+
+/*
+ * State of the VGA model.  Each register file is written by setting an
+ * index at one port and then writing the data port(or, for the attribute
+ * controller, by alternating index and data writes to one port; reading
+ * port 0x3DA returns the controller to expecting an index).  Video
+ * memory below PLANE_SIZE is stored as four planes; the rest of the
+ * window(used only by text mode) is stored as plain bytes.
+ */
+typedef struct vga_model_t vga_model_t;
+struct vga_model_t {
+    uint8_t planes[4][PLANE_SIZE];           /* the four memory planes     */
+    uint8_t high_mem[VID_MEM_SIZE - PLANE_SIZE]; /* window above planes   */
+    uint8_t misc;                            /* miscellaneous output       */
+    uint8_t seq_index;                       /* sequencer index(0x3C4)     */
+    uint8_t seq[NUM_SEQ_REGS];               /* sequencer registers        */
+    uint8_t crtc_index;                      /* CRTC index(0x3D4)          */
+    uint8_t crtc[NUM_CRTC_REGS];             /* CRTC registers             */
+    uint8_t gfx_index;                       /* graphics index(0x3CE)      */
+    uint8_t gfx[NUM_GFX_REGS];               /* graphics registers         */
+    uint8_t attr_index;                      /* attribute index and PAS    */
+    uint8_t attr_data_next;                  /* 1 if 0x3C0 expects data    */
+    uint8_t attr[NUM_ATTR_REGS];             /* attribute registers        */
+    uint8_t status;                          /* input status 1(0x3DA)      */
+    uint8_t dac_write;                       /* DAC write color(0x3C8)     */
+    uint8_t dac_read;                        /* DAC read color(0x3C7)      */
+    uint8_t dac_write_comp;                  /* next component written     */
+    uint8_t dac_read_comp;                   /* next component read        */
+    uint8_t palette[256][3];                 /* DAC palette(6-bit RGB)     */
+};
+
+
+/* local functions--see function headers for details */
+static int32_t hw_open(void);
+static void hw_close(void);
+static void hw_outb(uint16_t port, uint8_t val);
+static uint8_t hw_inb(uint16_t port);
+static void hw_write(uint32_t addr, const void* src, uint32_t len);
+static void hw_fill(uint32_t addr, uint8_t val, uint32_t len);
+static int32_t model_open(void);
+static void model_close(void);
+static void model_outb(uint16_t port, uint8_t val);
+static uint8_t model_inb(uint16_t port);
+static void model_write(uint32_t addr, const void* src, uint32_t len);
+static void model_fill(uint32_t addr, uint8_t val, uint32_t len);
+
+
+/* the backends */
+static const vga_ops_t hw_ops = {
+    "hw", hw_open, hw_close, hw_outb, hw_inb, hw_write, hw_fill
+};
+static const vga_ops_t model_ops = {
+    "model", model_open, model_close, model_outb, model_inb, model_write,
+    model_fill
+};
+
+/* file-scope variables */
+static const vga_ops_t* ops = &hw_ops;  /* backend in use                */
+static unsigned char* mem_image;        /* hardware video memory mapping */
+static vga_model_t* model = NULL;       /* model state(while in use)     */
+
+
+/*
+ * vga_open
+ *   DESCRIPTION: Choose a backend(see vga.h) and open it.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: prints an error message to stdout on failure
+ */
+int32_t vga_open() {
+    const char* env = getenv("ADVENTURE_VGA"); /* requested backend */
+
+    if (NULL != env) {
+        ops = (0 == strcmp(env, "model") ? &model_ops : &hw_ops);
+    }
+    else {
+        ops = (0 == access("/dev/mem", R_OK | W_OK) ? &hw_ops : &model_ops);
+    }
+    return (*ops->open)();
+}
+
+
+/*
+ * vga_close
+ *   DESCRIPTION: Close the backend opened by vga_open.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: releases video memory
+ */
+void vga_close() {
+    (*ops->close)();
+}
+
+
+/*
+ * vga_backend
+ *   DESCRIPTION: Get the name of the backend in use.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: "hw" or "model"
+ *   SIDE EFFECTS: none
+ */
+const char* vga_backend() {
+    return ops->name;
+}
+
+
+/*
+ * vga_outb
+ *   DESCRIPTION: Write a byte to a VGA port.
+ *   INPUTS: port -- the port
+ *           val -- the byte
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes VGA state
+ */
+void vga_outb(uint16_t port, uint8_t val) {
+    (*ops->outb)(port, val);
+}
+
+
+/*
+ * vga_outw
+ *   DESCRIPTION: Write two bytes to two consecutive VGA ports: the low
+ *                byte(usually a register index) to port and the high
+ *                byte(the register value) to port + 1.  This has the
+ *                same effect as a 16-bit port write on the VGA.
+ *   INPUTS: port -- the first port
+ *           val -- the two bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes VGA state
+ */
+void vga_outw(uint16_t port, uint16_t val) {
+#if defined(VGA_X86)
+    if (&hw_ops == ops) {
+        asm volatile("outw %w1, (%w0)" : : "d"(port), "a"(val) : "memory");
+        return;
+    }
+#endif
+    (*ops->outb)(port, val & 0xFF);
+    (*ops->outb)(port + 1, val >> 8);
+}
+
+
+/*
+ * vga_inb
+ *   DESCRIPTION: Read a byte from a VGA port.
+ *   INPUTS: port -- the port
+ *   OUTPUTS: none
+ *   RETURN VALUE: the byte read
+ *   SIDE EFFECTS: reading port 0x3DA resets the attribute controller to
+ *                 expect an index
+ */
+uint8_t vga_inb(uint16_t port) {
+    return (*ops->inb)(port);
+}
+
+
+/*
+ * vga_write
+ *   DESCRIPTION: Copy bytes to video memory.
+ *   INPUTS: addr -- offset in video memory(from 0xA0000)
+ *           src -- the bytes to copy
+ *           len -- number of bytes to copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes video memory
+ */
+void vga_write(uint32_t addr, const void* src, uint32_t len) {
+    (*ops->write)(addr, src, len);
+}
+
+
+/*
+ * vga_fill
+ *   DESCRIPTION: Set bytes of video memory to one value.
+ *   INPUTS: addr -- offset in video memory(from 0xA0000)
+ *           val -- the value
+ *           len -- number of bytes to set
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes video memory
+ */
+void vga_fill(uint32_t addr, uint8_t val, uint32_t len) {
+    (*ops->fill)(addr, val, len);
+}
+
+
+/*
+ * hw_open
+ *   DESCRIPTION: Map video memory into our address space; obtain permission
+ *                to access VGA ports.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: prints an error message to stdout on failure
+ */
+static int32_t hw_open() {
+#if defined(VGA_X86)
+    int mem_fd;    /* file descriptor for physical memory image */
+
+    /* Obtain permission to access ports 0x03C0 through 0x03DA. */
+    if (ioperm(0x03C0, 0x03DA - 0x03C0 + 1, 1) == -1) {
+        perror("set port permissions");
+        return -1;
+    }
+
+    /* Open file to access physical memory. */
+    if ((mem_fd = open("/dev/mem", O_RDWR)) == -1) {
+        perror("open /dev/mem");
+        return -1;
+    }
+
+    /* Map video memory(0xA0000 - 0xBFFFF) into our address space. */
+    if ((mem_image = mmap(0, VID_MEM_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, mem_fd, 0xA0000)) == MAP_FAILED) {
+        perror("mmap video memory");
+        (void)close(mem_fd);
+        return -1;
+    }
+
+    /* Close /dev/mem file descriptor and return success. */
+    (void)close(mem_fd);
+    return 0;
+#else
+    puts("VGA ports are not available on this architecture");
+    return -1;
+#endif
+}
+
+
+/*
+ * hw_close
+ *   DESCRIPTION: Unmap video memory.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void hw_close() {
+    (void)munmap(mem_image, VID_MEM_SIZE);
+}
+
+
+/*
+ * hw_outb
+ *   DESCRIPTION: Write a byte to a VGA port.
+ *   INPUTS: port -- the port
+ *           val -- the byte
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void hw_outb(uint16_t port, uint8_t val) {
+#if defined(VGA_X86)
+    asm volatile("outb %b1, (%w0)" : : "d"(port), "a"(val) : "memory");
+#endif
+}
+
+
+/*
+ * hw_inb
+ *   DESCRIPTION: Read a byte from a VGA port.
+ *   INPUTS: port -- the port
+ *   OUTPUTS: none
+ *   RETURN VALUE: the byte read
+ *   SIDE EFFECTS: none
+ */
+static uint8_t hw_inb(uint16_t port) {
+    uint8_t val = 0;  /* byte read */
+
+#if defined(VGA_X86)
+    asm volatile("inb (%w1), %b0" : "=a"(val) : "d"(port) : "memory");
+#endif
+    return val;
+}
+
+
+/*
+ * hw_write
+ *   DESCRIPTION: Copy bytes to video memory.
+ *   INPUTS: addr -- offset in video memory
+ *           src -- the bytes to copy
+ *           len -- number of bytes to copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void hw_write(uint32_t addr, const void* src, uint32_t len) {
+    unsigned char* dst = mem_image + addr; /* destination in video memory */
+    size_t         n = len;                /* bytes left to copy          */
+
+#if defined(VGA_X86)
+    /*
+     * memcpy is actually probably good enough here, and is usually
+     * implemented using ISA-specific features like those below,
+     * but the code here provides an example of x86 string moves
+     */
+    asm volatile("                                                  \n\
+        cld                                                         \n\
+        rep movsb        /* copy ECX bytes from M[ESI] to M[EDI] */ \n\
+        "
+        : "+S"(src), "+D"(dst), "+c"(n)
+        :
+        : "memory"
+    );
+#else
+    (void)memcpy(dst, src, n);
+#endif
+}
+
+
+/*
+ * hw_fill
+ *   DESCRIPTION: Set bytes of video memory to one value.
+ *   INPUTS: addr -- offset in video memory
+ *           val -- the value
+ *           len -- number of bytes to set
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void hw_fill(uint32_t addr, uint8_t val, uint32_t len) {
+    (void)memset(mem_image + addr, val, len);
+}
+
+
+/*
+ * model_open
+ *   DESCRIPTION: Create the VGA model with all memory and registers zeroed.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: dynamically allocates memory; prints an error message
+ *                 to stdout on failure
+ */
+static int32_t model_open() {
+    if (NULL == model && NULL == (model = calloc(1, sizeof (*model)))) {
+        perror("allocate VGA model");
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * model_close
+ *   DESCRIPTION: Discard the VGA model.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees memory
+ */
+static void model_close() {
+    free(model);
+    model = NULL;
+}
+
+
+/*
+ * model_outb
+ *   DESCRIPTION: Emulate a write to a VGA port.  Writes to ports that the
+ *                model does not implement are ignored.
+ *   INPUTS: port -- the port
+ *           val -- the byte
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes model registers
+ */
+static void model_outb(uint16_t port, uint8_t val) {
+    switch (port) {
+        case 0x03C0:
+            if (model->attr_data_next) {
+                model->attr[model->attr_index & (NUM_ATTR_REGS - 1)] = val;
+            }
+            else {
+                model->attr_index = val;
+            }
+            model->attr_data_next ^= 1;
+            break;
+        case 0x03C2: model->misc = val; break;
+        case 0x03C4: model->seq_index = val; break;
+        case 0x03C5: model->seq[model->seq_index & (NUM_SEQ_REGS - 1)] = val; break;
+        case 0x03C7: model->dac_read = val; model->dac_read_comp = 0; break;
+        case 0x03C8: model->dac_write = val; model->dac_write_comp = 0; break;
+        case 0x03C9:
+            /* Each color takes three writes; then the index advances. */
+            model->palette[model->dac_write][model->dac_write_comp] = val & 0x3F;
+            if (3 == ++model->dac_write_comp) {
+                model->dac_write_comp = 0;
+                model->dac_write++;
+            }
+            break;
+        case 0x03CE: model->gfx_index = val; break;
+        case 0x03CF: model->gfx[model->gfx_index & (NUM_GFX_REGS - 1)] = val; break;
+        case 0x03D4: model->crtc_index = val; break;
+        case 0x03D5: model->crtc[model->crtc_index & (NUM_CRTC_REGS - 1)] = val; break;
+        default: break;
+    }
+}
+
+
+/*
+ * model_inb
+ *   DESCRIPTION: Emulate a read from a VGA port.  Input status register 1
+ *                alternates between reporting and not reporting vertical
+ *                retrace so that code waiting for either state never
+ *                waits forever.
+ *   INPUTS: port -- the port
+ *   OUTPUTS: none
+ *   RETURN VALUE: the byte read(0xFF for ports the model does not
+ *                 implement)
+ *   SIDE EFFECTS: reading port 0x3DA resets the attribute controller to
+ *                 expect an index
+ */
+static uint8_t model_inb(uint16_t port) {
+    uint8_t val; /* byte read */
+
+    switch (port) {
+        case 0x03C0: return model->attr_index;
+        case 0x03C1: return model->attr[model->attr_index & (NUM_ATTR_REGS - 1)];
+        case 0x03C4: return model->seq_index;
+        case 0x03C5: return model->seq[model->seq_index & (NUM_SEQ_REGS - 1)];
+        case 0x03C8: return model->dac_write;
+        case 0x03C9:
+            val = model->palette[model->dac_read][model->dac_read_comp];
+            if (3 == ++model->dac_read_comp) {
+                model->dac_read_comp = 0;
+                model->dac_read++;
+            }
+            return val;
+        case 0x03CC: return model->misc;
+        case 0x03CE: return model->gfx_index;
+        case 0x03CF: return model->gfx[model->gfx_index & (NUM_GFX_REGS - 1)];
+        case 0x03D4: return model->crtc_index;
+        case 0x03D5: return model->crtc[model->crtc_index & (NUM_CRTC_REGS - 1)];
+        case 0x03DA:
+            model->attr_data_next = 0;
+            model->status ^= 0x09;  /* display enable and vertical retrace */
+            return model->status;
+        default: return 0xFF;
+    }
+}
+
+
+/*
+ * model_write
+ *   DESCRIPTION: Emulate a copy to video memory.  Bytes below PLANE_SIZE
+ *                go to each plane enabled by the sequencer map mask, as
+ *                in mode X; the font data written in text mode also lands
+ *                in plane 2 this way.
+ *   INPUTS: addr -- offset in video memory
+ *           src -- the bytes to copy
+ *           len -- number of bytes to copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes model memory
+ */
+static void model_write(uint32_t addr, const void* src, uint32_t len) {
+    const uint8_t* from = src; /* next byte to copy        */
+    uint32_t       n;          /* bytes copied into planes */
+    int32_t        p;          /* loop index over planes   */
+
+    if (PLANE_SIZE > addr) {
+        n = (PLANE_SIZE - addr < len ? PLANE_SIZE - addr : len);
+        for (p = 0; 4 > p; p++) {
+            if (0 != (model->seq[2] & (1 << p))) {
+                (void)memcpy(&model->planes[p][addr], from, n);
+            }
+        }
+        addr += n;
+        from += n;
+        len -= n;
+    }
+    if (0 < len && VID_MEM_SIZE > addr) {
+        n = (VID_MEM_SIZE - addr < len ? VID_MEM_SIZE - addr : len);
+        (void)memcpy(&model->high_mem[addr - PLANE_SIZE], from, n);
+    }
+}
+
+
+/*
+ * model_fill
+ *   DESCRIPTION: Emulate setting bytes of video memory to one value(see
+ *                model_write).
+ *   INPUTS: addr -- offset in video memory
+ *           val -- the value
+ *           len -- number of bytes to set
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes model memory
+ */
+static void model_fill(uint32_t addr, uint8_t val, uint32_t len) {
+    uint32_t n;  /* bytes set in planes      */
+    int32_t  p;  /* loop index over planes   */
+
+    if (PLANE_SIZE > addr) {
+        n = (PLANE_SIZE - addr < len ? PLANE_SIZE - addr : len);
+        for (p = 0; 4 > p; p++) {
+            if (0 != (model->seq[2] & (1 << p))) {
+                (void)memset(&model->planes[p][addr], val, n);
+            }
+        }
+        addr += n;
+        len -= n;
+    }
+    if (0 < len && VID_MEM_SIZE > addr) {
+        n = (VID_MEM_SIZE - addr < len ? VID_MEM_SIZE - addr : len);
+        (void)memset(&model->high_mem[addr - PLANE_SIZE], val, n);
+    }
+}
+
+
+/*
+ * vga_model_frame
+ *   DESCRIPTION: Render the model's display.  Each character row of
+ *                (maximum scan line + 1) scan lines displays one line of
+ *                video memory, and lines are the CRTC offset register
+ *                times two bytes apart(byte mode).  Line 0 starts at the
+ *                CRTC start address, and video memory addressing restarts
+ *                at 0 after the line compare scan line.  In each line,
+ *                pixel x comes from plane (x + pan) & 3 at byte
+ *                (x + pan) / 4, where pan is the pel panning in pixels;
+ *                panning is dropped below the split if attribute mode
+ *                control bit 5 is set.  The frame shows the first scan
+ *                line of each pair of the 400-line display.
+ *   INPUTS: none
+ *   OUTPUTS: frame -- the palette index of each pixel
+ *   RETURN VALUE: 0 on success, -1 if the model is not in use or the VGA
+ *                 is not in mode X(unchained 256-color mode)
+ *   SIDE EFFECTS: none
+ */
+int32_t vga_model_frame(uint8_t frame[VGA_FRAME_Y_DIM][VGA_FRAME_X_DIM]) {
+    const uint8_t* crtc;     /* CRTC registers                     */
+    uint32_t       start;    /* CRTC start address                 */
+    uint32_t       stride;   /* bytes between lines                */
+    uint32_t       compare;  /* line compare scan line             */
+    uint32_t       height;   /* scan lines per line of memory      */
+    uint32_t       pan;      /* pel panning in pixels              */
+    uint32_t       scan;     /* scan line shown in a frame row     */
+    uint32_t       line;     /* address of line shown in the row   */
+    uint32_t       col;      /* pixel position in the memory line  */
+    int32_t        x;        /* loop index over frame columns      */
+    int32_t        y;        /* loop index over frame rows         */
+
+    if (NULL == model || 0 != (model->seq[4] & 0x08) || 0 == (model->gfx[5] & 0x40)) {
+        return -1;
+    }
+    crtc = model->crtc;
+    start = (crtc[0x0C] << 8) | crtc[0x0D];
+    stride = crtc[0x13] * 2;
+    compare = crtc[0x18] | ((crtc[0x07] & 0x10) << 4) | ((crtc[0x09] & 0x40) << 3);
+    height = ((crtc[0x09] & 0x1F) + 1) << (crtc[0x09] >> 7);
+    pan = (model->attr[0x13] >> 1) & 3;
+
+    for (y = 0; VGA_FRAME_Y_DIM > y; y++) {
+        scan = 2 * y;
+        if (compare >= scan) {
+            line = start + (scan / height) * stride;
+        }
+        else {
+            line = ((scan - compare - 1) / height) * stride;
+            if (0 != (model->attr[0x10] & 0x20)) {
+                pan = 0;
+            }
+        }
+        for (x = 0; VGA_FRAME_X_DIM > x; x++) {
+            col = x + pan;
+            frame[y][x] = model->planes[col & 3][(line + (col >> 2)) & (PLANE_SIZE - 1)];
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * vga_model_palette
+ *   DESCRIPTION: Copy the model's DAC palette.
+ *   INPUTS: none
+ *   OUTPUTS: palette -- the 6-bit red, green, and blue values of each color
+ *   RETURN VALUE: 0 on success, -1 if the model is not in use
+ *   SIDE EFFECTS: none
+ */
+int32_t vga_model_palette(uint8_t palette[256][3]) {
+    if (NULL == model) {
+        return -1;
+    }
+    (void)memcpy(palette, model->palette, sizeof (model->palette));
+    return 0;
+}
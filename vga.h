@@ -0,0 +1,81 @@
+/* tab:4
+ *
+ * vga.h - header file for the VGA hardware access backends
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      vga.h
+ */
+#ifndef VGA_H
+#define VGA_H
+
+
+#include <stdint.h>
+
+
+/*
+ * All VGA port and video memory accesses made by modex.c go through a
+ * backend.  The hardware backend obtains permission to use ports 0x3C0
+ * through 0x3DA and maps video memory(0xA0000 - 0xBFFFF) from /dev/mem.
+ * The model backend emulates the VGA in plain memory: the four 64kB
+ * planes written through the sequencer map mask, the sequencer, CRTC,
+ * graphics, and attribute controller registers, and the DAC palette.
+ * With the model, the game's display can be rendered, compared, and
+ * timed without a VGA or root privileges.
+ *
+ * The ADVENTURE_VGA environment variable("hw" or "model") chooses the
+ * backend.  By default, the hardware backend is used whenever /dev/mem
+ * can be opened for writing, and the model otherwise.
+ */
+
+/* size of the frames rendered by the model(mode X resolution) */
+#define VGA_FRAME_X_DIM 320
+#define VGA_FRAME_Y_DIM 200
+
+/*
+ * Choose a backend and open it.  Returns 0 on success, or -1 on failure
+ * (after printing an error message).
+ */
+extern int32_t vga_open(void);
+
+/* Close the backend opened by vga_open. */
+extern void vga_close(void);
+
+/* Get the name of the backend in use("hw" or "model"). */
+extern const char* vga_backend(void);
+
+/* Write a byte to a VGA port. */
+extern void vga_outb(uint16_t port, uint8_t val);
+
+/* Write two bytes(low byte first) to two consecutive VGA ports. */
+extern void vga_outw(uint16_t port, uint16_t val);
+
+/* Read a byte from a VGA port. */
+extern uint8_t vga_inb(uint16_t port);
+
+/*
+ * Copy len bytes to video memory at offset addr from 0xA0000.  In mode X,
+ * the bytes go to each plane enabled by the sequencer map mask.
+ */
+extern void vga_write(uint32_t addr, const void* src, uint32_t len);
+
+/* Set len bytes of video memory at offset addr to val(as vga_write). */
+extern void vga_fill(uint32_t addr, uint8_t val, uint32_t len);
+
+/*
+ * Render the display produced by the model's video memory and registers
+ * as one palette index per pixel, honoring the CRTC start address,
+ * offset, and line compare(split screen) registers and the attribute
+ * controller's horizontal pel panning.  Returns 0 on success, or -1 if
+ * the model is not in use or the VGA is not in mode X.
+ */
+extern int32_t vga_model_frame(uint8_t frame[VGA_FRAME_Y_DIM][VGA_FRAME_X_DIM]);
+
+/*
+ * Copy the model's DAC palette(6-bit RGB values).  Returns 0 on success,
+ * or -1 if the model is not in use.
+ */
+extern int32_t vga_model_palette(uint8_t palette[256][3]);
+
+#endif /* VGA_H */
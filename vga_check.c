@@ -0,0 +1,296 @@
+/* tab:4
+ *
+ * vga_check.c - test program comparing the frames shown through the
+ *               VGA model with the logical image
+ *
+ * Written for the ECE391 MP2 adventure game after its original
+ * distribution; not covered by the original author's copyright notice.
+ *
+ * Filename:      vga_check.c
+ */
+
+
+/*
+ * This file is a standalone test program(run by "make check" with
+ * ADVENTURE_VGA=model, once with page flipping and once with panning,
+ * ADVENTURE_PAN=1).  The mode X code draws a synthetic image much larger
+ * than the screen while the view window follows a scripted path--long
+ * sweeps in each direction that wrap the build buffer rings and the
+ * panning canvas many times--and then a random path with jumps that
+ * redraw the whole screen.  After every step, the frame rendered by the
+ * VGA model from its video memory and registers must show exactly the
+ * image at the view window, with the status bar below it.  An optional
+ * argument gives the number of random steps.
+ */
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modex.h"
+#include "vga.h"
+
+
+#define CHECK_STEPS  3000 /* random steps by default               */
+#define IMAGE_WIDTH  1024 /* size of the synthetic image(as the    */
+#define IMAGE_HEIGHT 600  /* ... largest room photos)              */
+#define MAX_STEP     8    /* largest scroll step along a sweep     */
+
+
+/* local functions--see function headers for details */
+static int32_t check_frame(const char* what, int32_t step);
+static void fill_horiz(int x, int y, int count, unsigned char* buf);
+static void fill_vert(int x, int y, int count, unsigned char* buf);
+static uint8_t image_pixel(int32_t x, int32_t y);
+static int32_t move_view(int32_t nx, int32_t ny);
+static int32_t sweep(int32_t tx, int32_t ty, int32_t* step);
+
+
+/* file-scope variables */
+static int32_t view_x = 0;  /* view window position */
+static int32_t view_y = 0;
+static uint8_t frame[VGA_FRAME_Y_DIM][VGA_FRAME_X_DIM]; /* frame rendered */
+
+
+/*
+ * image_pixel
+ *   DESCRIPTION: Get a pixel of the synthetic image, which varies along
+ *                both axes so that misplaced lines, planes, or pixels
+ *                show up as differences.
+ *   INPUTS: x, y -- pixel position
+ *   OUTPUTS: none
+ *   RETURN VALUE: palette index of the pixel
+ *   SIDE EFFECTS: none
+ */
+static uint8_t image_pixel(int32_t x, int32_t y) {
+    return (x * 3 + y * 5 + (x >> 3) + (y >> 2) * 7) & 0xFF;
+}
+
+
+/*
+ * fill_horiz
+ *   DESCRIPTION: Line callback for set_mode_X: get horizontal lines of
+ *                the synthetic image.
+ *   INPUTS: x, y -- left end of first line
+ *           count -- number of lines
+ *   OUTPUTS: buf -- SCROLL_X_DIM pixels for each line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void fill_horiz(int x, int y, int count, unsigned char* buf) {
+    int32_t k;  /* index over lines  */
+    int32_t i;  /* index over pixels */
+
+    for (k = 0; count > k; k++) {
+        for (i = 0; SCROLL_X_DIM > i; i++) {
+            buf[k * SCROLL_X_DIM + i] = image_pixel(x + i, y + k);
+        }
+    }
+}
+
+
+/*
+ * fill_vert
+ *   DESCRIPTION: Line callback for set_mode_X: get vertical lines of the
+ *                synthetic image.
+ *   INPUTS: x, y -- top end of first line
+ *           count -- number of lines
+ *   OUTPUTS: buf -- SCROLL_Y_DIM pixels for each line
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void fill_vert(int x, int y, int count, unsigned char* buf) {
+    int32_t k;  /* index over lines  */
+    int32_t i;  /* index over pixels */
+
+    for (k = 0; count > k; k++) {
+        for (i = 0; SCROLL_Y_DIM > i; i++) {
+            buf[k * SCROLL_Y_DIM + i] = image_pixel(x + k, y + i);
+        }
+    }
+}
+
+
+/*
+ * check_frame
+ *   DESCRIPTION: Render the frame shown by the VGA model and compare it
+ *                with the image at the view window and with the status
+ *                bar image, which is stored one plane after another
+ *                (see text_to_graphics) and is shown in the rows below
+ *                the image(its last row falls below the screen).
+ *   INPUTS: what -- part of the path, for messages
+ *           step -- step number, for messages
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the frame matches, or -1 otherwise
+ *   SIDE EFFECTS: prints the first difference to stderr
+ */
+static int32_t check_frame(const char* what, int32_t step) {
+    int32_t r;     /* index over frame rows    */
+    int32_t c;     /* index over frame columns */
+    int32_t s;     /* row of the status bar    */
+    uint8_t want;  /* pixel expected           */
+
+    if (0 != vga_model_frame(frame)) {
+        fprintf(stderr, "vga_check: the VGA model cannot render a frame\n");
+        return -1;
+    }
+    for (r = 0; VGA_FRAME_Y_DIM > r; r++) {
+        for (c = 0; VGA_FRAME_X_DIM > c; c++) {
+            if (SCROLL_Y_DIM > r) {
+                want = image_pixel(view_x + c, view_y + r);
+            }
+            else {
+                s = r - SCROLL_Y_DIM;
+                want = buffer[(c & 3) * (STATUS_BAR_SIZE / 4) + s * (SCROLL_X_DIM / 4) + (c >> 2)];
+            }
+            if (want != frame[r][c]) {
+                fprintf(stderr, "vga_check: %s step %d, view (%d,%d): pixel (%d,%d) is %u, "
+                        "not %u\n", what, step, view_x, view_y, c, r, frame[r][c], want);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * move_view
+ *   DESCRIPTION: Move the view window, draw the lines exposed(or the
+ *                whole screen after a jump) as the game does, show the
+ *                screen, and check the frame.
+ *   INPUTS: nx, ny -- new view window position
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the frame matches, or -1 otherwise
+ *   SIDE EFFECTS: draws into the build buffer and video memory
+ */
+static int32_t move_view(int32_t nx, int32_t ny) {
+    static int32_t step = 0;  /* steps taken so far */
+    int32_t        dx = nx - view_x;
+    int32_t        dy = ny - view_y;
+
+    set_view_window(nx, ny);
+    view_x = nx;
+    view_y = ny;
+    if (SCROLL_X_DIM <= abs(dx) || SCROLL_Y_DIM <= abs(dy)) {
+        draw_horiz_lines(0, SCROLL_Y_DIM);
+    }
+    else {
+        if (0 < dy) {
+            draw_horiz_lines(SCROLL_Y_DIM - dy, dy);
+        }
+        else if (0 > dy) {
+            draw_horiz_lines(0, -dy);
+        }
+        if (0 < dx) {
+            draw_vert_lines(SCROLL_X_DIM - dx, dx);
+        }
+        else if (0 > dx) {
+            draw_vert_lines(0, -dx);
+        }
+    }
+    show_screen();
+    return check_frame("path", step++);
+}
+
+
+/*
+ * sweep
+ *   DESCRIPTION: Scroll the view window in a straight line to a target
+ *                position, with steps of 1 to MAX_STEP pixels in turn.
+ *   INPUTS: tx, ty -- target position
+ *           step -- step size to use next
+ *   OUTPUTS: step -- advanced
+ *   RETURN VALUE: 0 if every frame matches, or -1 otherwise
+ *   SIDE EFFECTS: draws into the build buffer and video memory
+ */
+static int32_t sweep(int32_t tx, int32_t ty, int32_t* step) {
+    int32_t dx;  /* horizontal move of one step */
+    int32_t dy;  /* vertical move of one step   */
+
+    while (tx != view_x || ty != view_y) {
+        dx = (tx > view_x ? 1 : (tx < view_x ? -1 : 0)) * *step;
+        dy = (ty > view_y ? 1 : (ty < view_y ? -1 : 0)) * *step;
+        dx = (abs(dx) > abs(tx - view_x) ? tx - view_x : dx);
+        dy = (abs(dy) > abs(ty - view_y) ? ty - view_y : dy);
+        *step = *step % MAX_STEP + 1;
+        if (0 != move_view(view_x + dx, view_y + dy)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * main
+ *   DESCRIPTION: Draw the synthetic image along the scripted path and
+ *                then a random path, checking every frame.
+ *   INPUTS: argc, argv -- optional number of random steps
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if every frame matches, or 1 otherwise
+ *   SIDE EFFECTS: uses the VGA backend
+ */
+int main(int argc, char** argv) {
+    static const int32_t path[][2] = {  /* corners of the scripted path */
+        { IMAGE_WIDTH - SCROLL_X_DIM, 0 },
+        { IMAGE_WIDTH - SCROLL_X_DIM, IMAGE_HEIGHT - SCROLL_Y_DIM },
+        { 0, IMAGE_HEIGHT - SCROLL_Y_DIM },
+        { 0, 0 },
+        { IMAGE_HEIGHT - SCROLL_Y_DIM, IMAGE_HEIGHT - SCROLL_Y_DIM },
+        { IMAGE_WIDTH - SCROLL_X_DIM, 0 },
+        { 1, 1 }
+    };
+    int32_t steps = (1 < argc ? atoi(argv[1]) : CHECK_STEPS); /* random steps */
+    int32_t step = 1;  /* step size along the path */
+    int32_t nx;        /* next view window position */
+    int32_t ny;
+    int32_t i;         /* index over path and steps */
+    int32_t failed = 0; /* a frame differed         */
+
+    if (0 != set_mode_X(fill_horiz, fill_vert)) {
+        return 1;
+    }
+    if (0 != strcmp(vga_backend(), "model")) {
+        clear_mode_X();
+        fputs("vga_check: set ADVENTURE_VGA=model to run the check\n", stderr);
+        return 1;
+    }
+    add_status_bar('S', "vga_check");
+    set_view_window(0, 0);
+    draw_horiz_lines(0, SCROLL_Y_DIM);
+    show_screen();
+    failed = (0 != check_frame("first", 0));
+
+    /* the scripted path */
+    for (i = 0; !failed && sizeof (path) / sizeof (path[0]) > i; i++) {
+        failed = (0 != sweep(path[i][0], path[i][1], &step));
+    }
+
+    /* random steps, jumps, and status bar changes */
+    srand(391);
+    for (i = 0; !failed && steps > i; i++) {
+        nx = view_x + rand() % (2 * MAX_STEP + 1) - MAX_STEP;
+        ny = view_y + rand() % (2 * MAX_STEP + 1) - MAX_STEP;
+        if (0 == rand() % 50) {
+            nx = rand() % (IMAGE_WIDTH - SCROLL_X_DIM + 1);
+            ny = rand() % (IMAGE_HEIGHT - SCROLL_Y_DIM + 1);
+        }
+        if (0 == rand() % 20) {
+            add_status_bar((0 == (i & 1) ? 'R' : 'S'), (0 == (i & 2) ? "lobby" : "status"));
+        }
+        nx = (0 > nx ? 0 : (IMAGE_WIDTH - SCROLL_X_DIM < nx ? IMAGE_WIDTH - SCROLL_X_DIM : nx));
+        ny = (0 > ny ? 0 : (IMAGE_HEIGHT - SCROLL_Y_DIM < ny ? IMAGE_HEIGHT - SCROLL_Y_DIM : ny));
+        failed = (0 != move_view(nx, ny));
+    }
+
+    clear_mode_X();
+    if (!failed) {
+        printf("vga_check: %s presentation: every frame matches\n",
+               (NULL != getenv("ADVENTURE_PAN") && 0 != atoi(getenv("ADVENTURE_PAN")) ?
+                "panning" : "page flipping"));
+    }
+    return failed;
+}
@@ -34,16 +34,24 @@
  */
 
 
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 
 #include "assert.h"
 #include "photo.h"
+#include "pool.h"
 #include "world.h"
 
 
 /* parameters defined for this file */
 
+/* default depth of room graph searched for photos to prefetch */
+#define PREFETCH_DEPTH 2
+
 /* room identifiers */
 enum {
     R_NONE = -1,
@@ -173,17 +181,77 @@ enum {
 
 /* types local to this file(declared in types.h) */
 
+/*
+ * A room photo.  Photos are read when first needed and kept in memory
+ * subject to a memory budget(see room_photo); the least recently used
+ * photos are released when the budget is exceeded and read again when
+ * next needed.  The photo's size is read once when the world is built,
+ * so the size of a room is known even when its photo is not in memory.
+ * Rooms and swap slots refer to these records, so swapping a photo
+ * only exchanges pointers.  Photos may be read by prefetch jobs in the
+ * worker pool, so all fields other than filename are protected by
+ * photo_lock.
+ */
+typedef struct photo_slot_t photo_slot_t;
+struct photo_slot_t {
+    const char*    filename;  /* file name for photo                   */
+    photo_header_t hdr;       /* height and width of photo             */
+    photo_t*       photo;     /* photo if in memory, or NULL           */
+    uint32_t       bytes;     /* memory held by photo if in memory     */
+    uint32_t       copies;    /* ... of which in column/plane copies   */
+    int32_t        loading;   /* photo is being read by some thread    */
+    uint32_t       near_gen;  /* prefetch_gen when last near the screen */
+    photo_slot_t*  lru_prev;  /* next more recently used photo in LRU  */
+    photo_slot_t*  lru_next;  /* next less recently used photo in LRU  */
+};
+
+/* A request to prefetch one room photo(see start_prefetch). */
+typedef struct prefetch_t prefetch_t;
+struct prefetch_t {
+    photo_slot_t* slot;  /* the photo to read                      */
+    uint32_t      gen;   /* value of prefetch_gen when requested   */
+};
+
+/*
+ * Objects in a room are indexed by the bands of rows and of columns of
+ * the room photo that they overlap, so that the objects that may cross
+ * a line being drawn are found without walking the room's contents.
+ * Each band covers OBJ_BAND_DIM rows(or columns); objects placed beyond
+ * the last band are listed in the last band.
+ */
+#define OBJ_BAND_SHIFT 4
+#define OBJ_BAND_DIM   (1 << OBJ_BAND_SHIFT)
+#define N_ROW_BANDS    ((MAX_PHOTO_HEIGHT + OBJ_BAND_DIM - 1) >> OBJ_BAND_SHIFT)
+#define N_COL_BANDS    ((MAX_PHOTO_WIDTH + OBJ_BAND_DIM - 1) >> OBJ_BAND_SHIFT)
+
+/*
+ * The objects overlapping one band, in the same order as in the room's
+ * contents.  The list is allocated when first needed and grows by
+ * doubling.
+ */
+typedef struct obj_band_t obj_band_t;
+struct obj_band_t {
+    obj_place_t* list;   /* objects overlapping band         */
+    int32_t      count;  /* number of objects in list        */
+    int32_t      size;   /* number of entries allocated      */
+};
+
 /*
  * The structure representing a room in the world. The backpack/inventory
- * is also a 'room'(#0, R_INVENTORY).
+ * is also a 'room'(#0, R_INVENTORY).  If memory for the object index
+ * cannot be allocated, the index is abandoned for the room(unindexed is
+ * set), and its objects are found by walking its contents instead.
  */
 struct room_t {
     const char* name;       /* name of room                   */
-    photo_t*    view;       /* photo currently shown for room */
+    photo_slot_t* view;     /* photo currently shown for room */
     object_t*   contents;   /* linked list of objects in room */
     room_t*     left;       /* room to the "left"             */
     room_t*     enter;      /* doors, etc.                    */
     room_t*     right;      /* room to the "right"            */
+    obj_band_t  row_band[N_ROW_BANDS]; /* objects by rows     */
+    obj_band_t  col_band[N_COL_BANDS]; /* objects by columns  */
+    int32_t     unindexed;  /* object index is not maintained */
 };
 
 /*
@@ -358,16 +426,34 @@ static const swap_data_t swap_data[N_SWAPS] = {
 };
 
 
+
 /* functions local to this file--see function headers for details */
+static int32_t band_insert(obj_band_t* band, const object_t* o);
+static void band_remove(obj_band_t* band, const object_t* o);
 static void do_photo_swap(room_t* r, int32_t which);
+static void evict_photos(const photo_slot_t* keep, uint64_t limit);
 static object_t* find_in_room(const room_t* r, const char* arg);
+static void index_object(room_t* r, const object_t* o);
+static int32_t init_photo_slot(photo_slot_t* slot, const char* filename);
 static void insert_object_at(object_t* o, room_t* r, int32_t x, int32_t y);
 static void insert_object(object_t* o, room_t* r);
+static void load_job(void* arg);
+static photo_t* load_photo_slot(photo_slot_t* slot);
+static void lru_push(photo_slot_t* slot);
+static void lru_remove(photo_slot_t* slot);
 static void move_object_to_inventory(object_t* obj);
+static void obj_image_job(void* arg);
 static object_t* obj_special_get(room_t* r, const char* arg);
+static uint64_t photo_budget_from_env(void);
 static int32_t player_flag_is_set(int32_t fnum);
 static void player_set_flag(int32_t fnum);
+static void prefetch_job(void* arg);
+static photo_t* read_photo_slot(photo_slot_t* slot, int32_t touch);
 static void remove_object(object_t* o);
+static void set_slot_copies(photo_slot_t* slot, int32_t on);
+static void start_prefetch(const room_t* r);
+static void unindex_object(room_t* r, const object_t* o);
+static uint64_t usec_since(const struct timespec* start);
 
 
 /* file-scope variables */
@@ -376,10 +462,56 @@ static void remove_object(object_t* o);
  * overkill for this game, but it's nice not to worry about the number of
  * flags...
  */
-static room_t   room[N_ROOMS];                       /* rooms                */
-static object_t object[N_OBJECTS];                   /* objects              */
-static uint32_t player_flags[(NUM_FLAGS + 31) / 32]; /* accomplishment flags */
-static photo_t* swap_photo[N_SWAPS];                 /* swapping photos      */
+static room_t        room[N_ROOMS];                       /* rooms                */
+static object_t      object[N_OBJECTS];                   /* objects              */
+static uint32_t      player_flags[(NUM_FLAGS + 31) / 32]; /* accomplishment flags */
+static photo_slot_t  room_slot[N_ROOMS];                  /* initial room photos  */
+static photo_slot_t  swap_slot[N_SWAPS];                  /* initial swap photos  */
+static photo_slot_t* swap_photo[N_SWAPS];                 /* swapping photos      */
+static image_t*      obj_data_img[N_OBJECTS];             /* images for obj_data  */
+static pool_group_t  obj_image_grp = {0};                 /* object image reads   */
+
+/*
+ * Room photos in memory form a doubly-linked list in order of use, from
+ * lru_head(most recent) to lru_tail.  The photo of the room last given
+ * to room_pin_photo(the room on the screen) is never released.  The
+ * list, the counters, and the photo records are protected by photo_lock;
+ * photo_cv is broadcast whenever a photo read finishes.  The pinned
+ * photo is changed only by the main thread and is never released, so
+ * the main thread may use it without the lock.
+ *
+ * When a room is pinned, photos of nearby rooms are read by jobs in the
+ * worker pool(prefetch_grp).  Each room pinned starts a new generation
+ * of prefetch requests; jobs from older generations do nothing.
+ *
+ * Only the pinned photo and the photos of rooms within prefetch range
+ * (those with near_gen equal to prefetch_gen) keep their column and plane
+ * order copies(see add_photo_copies), which more than double a photo's
+ * memory.  Other photos in memory lose their copies when a room is
+ * pinned, and get them back when they come within range again.
+ *
+ * If the pinned photo is not in memory, it is read by a job in the pool
+ * (load_grp), and a preview is drawn until the read finishes(see
+ * room_pin_photo).  The preview belongs to the main thread and is freed
+ * when it is replaced.  The times from entering the room to the first
+ * frame and to the frame with the photo itself are recorded in the
+ * counters.
+ */
+static pthread_mutex_t    photo_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t     photo_cv = PTHREAD_COND_INITIALIZER;
+static photo_slot_t*      lru_head = NULL;    /* most recently used photo  */
+static photo_slot_t*      lru_tail = NULL;    /* least recently used photo */
+static photo_slot_t*      pinned_slot = NULL; /* photo of room on screen   */
+static room_photo_stats_t photo_stats;        /* residency counters        */
+static int32_t            prefetch_depth;     /* rooms away to prefetch    */
+static uint32_t           prefetch_gen = 0;   /* current generation        */
+static pool_group_t       prefetch_grp = {0}; /* all prefetch jobs         */
+static photo_t*           pinned_photo = NULL;   /* photo or preview drawn  */
+static photo_t*           pinned_preview = NULL; /* preview of pinned photo */
+static int32_t            preview_enabled;       /* previews are allowed    */
+static int32_t            final_pending;      /* photo not yet drawn       */
+static struct timespec    entry_time;         /* when room was pinned      */
+static pool_group_t       load_grp = {0};     /* reads of pinned photos    */
 
 
 /*
@@ -392,7 +524,7 @@ static photo_t* swap_photo[N_SWAPS];                 /* swapping photos      */
  *   SIDE EFFECTS: none
  */
 static void do_photo_swap(room_t* r, int32_t which) {
-    photo_t* tmp;    /* temporary variable to help with swap */
+    photo_slot_t* tmp;    /* temporary variable to help with swap */
 
     /* Swap the photos. */
     tmp               = r->view;
@@ -401,6 +533,38 @@ static void do_photo_swap(room_t* r, int32_t which) {
 }
 
 
+/*
+ * evict_photos
+ *   DESCRIPTION: Release room photos, least recently used first, until
+ *                the memory held by room photos is no more than a limit.
+ *                The photo of the room on the screen is never released.
+ *                Caller must hold photo_lock.
+ *   INPUTS: keep -- another photo that must not be released(may be NULL)
+ *           limit -- memory limit in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees photos; updates residency counters
+ */
+static void evict_photos(const photo_slot_t* keep, uint64_t limit) {
+    photo_slot_t* slot; /* loop index over photos in memory */
+    photo_slot_t* prev; /* next more recently used photo    */
+
+    for (slot = lru_tail; NULL != slot && limit < photo_stats.bytes; slot = prev) {
+        prev = slot->lru_prev;
+        if (keep == slot || pinned_slot == slot) {
+            continue;
+        }
+        lru_remove(slot);
+        photo_stats.bytes -= slot->bytes;
+        photo_stats.copy_bytes -= slot->copies;
+        photo_stats.resident--;
+        photo_stats.evictions++;
+        free_photo(slot->photo);
+        slot->photo = NULL;
+    }
+}
+
+
 /*
  * find_in_room
  *   DESCRIPTION: Find an object by name in a room.  The name must match
@@ -427,6 +591,27 @@ static object_t* find_in_room(const room_t* r, const char* arg) {
 }
 
 
+/*
+ * init_photo_slot
+ *   DESCRIPTION: Set up a room photo record for a photo file, reading
+ *                the photo's size but not its pixels.
+ *   INPUTS: filename -- file name for photo
+ *   OUTPUTS: slot -- the photo record
+ *   RETURN VALUE: 0 on success, -1 if the photo file is unreadable or
+ *                 invalid
+ *   SIDE EFFECTS: none
+ */
+static int32_t init_photo_slot(photo_slot_t* slot, const char* filename) {
+    slot->filename = filename;
+    slot->photo = NULL;
+    slot->bytes = slot->copies = 0;
+    slot->loading = 0;
+    slot->near_gen = 0;
+    slot->lru_prev = slot->lru_next = NULL;
+    return read_photo_header(filename, &slot->hdr);
+}
+
+
 /*
  * insert_object_at
  *   DESCRIPTION: Place an object at a specific(x,y) location in a room.
@@ -448,10 +633,143 @@ static void insert_object_at(object_t* o, room_t* r, int32_t x, int32_t y) {
     o->x = x;
     o->y = y;
 
-    /* Now add the object to the new room's contents. */
+    /* Now add the object to the new room's contents and index. */
     o->loc = r;
     o->next = r->contents;
     r->contents = o;
+    index_object(r, o);
+}
+
+
+/*
+ * band_insert
+ *   DESCRIPTION: Add an object to the front of a band of a room's object
+ *                index, matching its place at the head of the room's
+ *                contents.
+ *   INPUTS: band -- the band
+ *           o -- the object(already positioned)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, or -1 if the band cannot grow
+ *   SIDE EFFECTS: may dynamically allocate memory for the band
+ */
+static int32_t band_insert(obj_band_t* band, const object_t* o) {
+    obj_place_t* list; /* grown list    */
+    int32_t      size; /* new list size */
+
+    if (band->size == band->count) {
+        size = (0 == band->size ? 4 : 2 * band->size);
+        if (NULL == (list = realloc(band->list, size * sizeof (list[0])))) {
+            return -1;
+        }
+        band->list = list;
+        band->size = size;
+    }
+    (void)memmove(&band->list[1], &band->list[0], band->count * sizeof (band->list[0]));
+    band->list[0].obj = o;
+    band->list[0].img = o->img;
+    band->list[0].x = o->x;
+    band->list[0].y = o->y;
+    band->count++;
+    return 0;
+}
+
+
+/*
+ * band_remove
+ *   DESCRIPTION: Take an object out of a band of a room's object index,
+ *                keeping the order of the others.
+ *   INPUTS: band -- the band
+ *           o -- the object
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void band_remove(obj_band_t* band, const object_t* o) {
+    int32_t i; /* loop index over objects in band */
+
+    for (i = 0; band->count > i; i++) {
+        if (o == band->list[i].obj) {
+            band->count--;
+            (void)memmove(&band->list[i], &band->list[i + 1],
+                          (band->count - i) * sizeof (band->list[0]));
+            return;
+        }
+    }
+}
+
+
+/*
+ * index_object
+ *   DESCRIPTION: Add an object just placed at the head of a room's
+ *                contents to the room's object index.  If the index
+ *                cannot grow, it is abandoned for the room.
+ *   INPUTS: r -- the room
+ *           o -- the object
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may dynamically allocate memory for the index
+ */
+static void index_object(room_t* r, const object_t* o) {
+    int32_t first; /* first band overlapped     */
+    int32_t last;  /* last band overlapped      */
+    int32_t i;     /* loop index over bands     */
+
+    if (r->unindexed) {
+        return;
+    }
+    first = o->y >> OBJ_BAND_SHIFT;
+    last = (o->y + image_height(o->img) - 1) >> OBJ_BAND_SHIFT;
+    for (i = first; last >= i && N_ROW_BANDS > i; i++) {
+        if (0 != band_insert(&r->row_band[i], o)) {
+            r->unindexed = 1;
+            return;
+        }
+    }
+    if (N_ROW_BANDS <= first && 0 != band_insert(&r->row_band[N_ROW_BANDS - 1], o)) {
+        r->unindexed = 1;
+        return;
+    }
+    first = o->x >> OBJ_BAND_SHIFT;
+    last = (o->x + image_width(o->img) - 1) >> OBJ_BAND_SHIFT;
+    for (i = first; last >= i && N_COL_BANDS > i; i++) {
+        if (0 != band_insert(&r->col_band[i], o)) {
+            r->unindexed = 1;
+            return;
+        }
+    }
+    if (N_COL_BANDS <= first && 0 != band_insert(&r->col_band[N_COL_BANDS - 1], o)) {
+        r->unindexed = 1;
+    }
+}
+
+
+/*
+ * unindex_object
+ *   DESCRIPTION: Take an object out of a room's object index.
+ *   INPUTS: r -- the room
+ *           o -- the object(still positioned in the room)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void unindex_object(room_t* r, const object_t* o) {
+    int32_t first; /* first band overlapped     */
+    int32_t last;  /* last band overlapped      */
+    int32_t i;     /* loop index over bands     */
+
+    if (r->unindexed) {
+        return;
+    }
+    first = o->y >> OBJ_BAND_SHIFT;
+    last = (o->y + image_height(o->img) - 1) >> OBJ_BAND_SHIFT;
+    for (i = (N_ROW_BANDS <= first ? N_ROW_BANDS - 1 : first); last >= i && N_ROW_BANDS > i; i++) {
+        band_remove(&r->row_band[i], o);
+    }
+    first = o->x >> OBJ_BAND_SHIFT;
+    last = (o->x + image_width(o->img) - 1) >> OBJ_BAND_SHIFT;
+    for (i = (N_COL_BANDS <= first ? N_COL_BANDS - 1 : first); last >= i && N_COL_BANDS > i; i++) {
+        band_remove(&r->col_band[i], o);
+    }
 }
 
 
@@ -475,11 +793,11 @@ static void insert_object(object_t* o, room_t* r) {
 
 
     /* Choose a random x location. */
-    range = photo_width(r->view) - image_width(o->img);
+    range = r->view->hdr.width - image_width(o->img);
     xpos = (0 >= range ? 0 : (rand() % range));
 
     /* Place in the lowest quarter of the roo photo if the object fits... */
-    space = photo_height(r->view);
+    space = r->view->hdr.height;
     img_ht = image_height(o->img);
     range = space / 4 - img_ht;
     if (0 >= range) {
@@ -496,6 +814,104 @@ static void insert_object(object_t* o, room_t* r) {
 }
 
 
+/*
+ * load_job
+ *   DESCRIPTION: Pool job that reads the photo of the room on the screen
+ *                while its preview is drawn(see room_pin_photo).
+ *   INPUTS: arg -- the photo record
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may read and free photos
+ */
+static void load_job(void* arg) {
+    photo_slot_t* slot = arg;
+
+    (void)pthread_mutex_lock(&photo_lock);
+    if (NULL == slot->photo && !slot->loading) {
+        (void)read_photo_slot(slot, 1);
+    }
+    (void)pthread_mutex_unlock(&photo_lock);
+}
+
+
+/*
+ * load_photo_slot
+ *   DESCRIPTION: Get a room photo, reading it if it is not in memory,
+ *                and mark it as the most recently used photo.  If the
+ *                photo is being read by another thread, wait for that
+ *                read rather than starting another.  Caller must hold
+ *                photo_lock.
+ *   INPUTS: slot -- the photo record
+ *   OUTPUTS: none
+ *   RETURN VALUE: the photo, or NULL if it cannot be read
+ *   SIDE EFFECTS: may read and free photos; updates residency counters
+ */
+static photo_t* load_photo_slot(photo_slot_t* slot) {
+    if (slot->loading) {
+        photo_stats.waits++;
+        do {
+            pthread_cond_wait(&photo_cv, &photo_lock);
+        } while (slot->loading);
+    }
+    if (NULL != slot->photo) {
+        photo_stats.hits++;
+        lru_remove(slot);
+        lru_push(slot);
+        return slot->photo;
+    }
+    photo_stats.misses++;
+    return read_photo_slot(slot, 0);
+}
+
+
+/*
+ * lru_push
+ *   DESCRIPTION: Add a room photo to the head of the LRU list.  Caller
+ *                must hold photo_lock.
+ *   INPUTS: slot -- the photo record(must not be in the list)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void lru_push(photo_slot_t* slot) {
+    slot->lru_prev = NULL;
+    slot->lru_next = lru_head;
+    if (NULL != lru_head) {
+        lru_head->lru_prev = slot;
+    }
+    else {
+        lru_tail = slot;
+    }
+    lru_head = slot;
+}
+
+
+/*
+ * lru_remove
+ *   DESCRIPTION: Remove a room photo from the LRU list.  Caller must
+ *                hold photo_lock.
+ *   INPUTS: slot -- the photo record(must be in the list)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void lru_remove(photo_slot_t* slot) {
+    if (NULL != slot->lru_prev) {
+        slot->lru_prev->lru_next = slot->lru_next;
+    }
+    else {
+        lru_head = slot->lru_next;
+    }
+    if (NULL != slot->lru_next) {
+        slot->lru_next->lru_prev = slot->lru_prev;
+    }
+    else {
+        lru_tail = slot->lru_prev;
+    }
+    slot->lru_prev = slot->lru_next = NULL;
+}
+
+
 /*
  * move_object_to_inventory
  *   DESCRIPTION: Move an object into the player's inventory.  Try to
@@ -534,6 +950,22 @@ static void move_object_to_inventory(object_t* obj) {
 }
 
 
+/*
+ * obj_image_job
+ *   DESCRIPTION: Pool job that reads the image of an object while the
+ *                world is built(see build_world).
+ *   INPUTS: arg -- the object's entry in obj_data
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: stores the image(or NULL on failure) in obj_data_img
+ */
+static void obj_image_job(void* arg) {
+    const obj_data_t* data = arg;
+
+    obj_data_img[data - obj_data] = read_obj_image(data->filename);
+}
+
+
 /*
  * obj_special_get
  *   DESCRIPTION: Handle special effects "get" commands, in which a player
@@ -574,6 +1006,34 @@ static object_t* obj_special_get(room_t* r, const char* arg) {
 }
 
 
+/*
+ * photo_budget_from_env
+ *   DESCRIPTION: Get the memory budget for room photos from the
+ *                ADVENTURE_PHOTO_BUDGET environment variable: a number
+ *                of bytes, optionally followed by 'K' or 'M'.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the budget in bytes, or 0 for no limit(also used when
+ *                 the variable is not set or not valid)
+ *   SIDE EFFECTS: none
+ */
+static uint64_t photo_budget_from_env() {
+    const char*        env;    /* value of ADVENTURE_PHOTO_BUDGET */
+    char*              end;    /* end of number in value          */
+    unsigned long long budget; /* budget read                     */
+
+    if (NULL == (env = getenv("ADVENTURE_PHOTO_BUDGET"))) {
+        return 0;
+    }
+    budget = strtoull(env, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': budget <<= 10; end++; break;
+        case 'm': case 'M': budget <<= 20; end++; break;
+    }
+    return ('\0' == *end ? budget : 0);
+}
+
+
 /*
  * player_flag_is_set
  *   DESCRIPTION: Checks whether the player has accomplished a specified task.
@@ -601,6 +1061,104 @@ static void player_set_flag(int32_t fnum) {
 }
 
 
+/*
+ * prefetch_job
+ *   DESCRIPTION: Pool job that reads a room photo before it is needed,
+ *                or restores the copies of a photo in memory that lost
+ *                them(see set_slot_copies).  Nothing is done if the
+ *                player has moved to another room since the request was
+ *                made, or if the photo is being read.
+ *   INPUTS: arg -- the prefetch_t describing the request
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may read and free photos; frees the request
+ */
+static void prefetch_job(void* arg) {
+    prefetch_t* req = arg;
+
+    (void)pthread_mutex_lock(&photo_lock);
+    if (prefetch_gen != req->gen) {
+        photo_stats.prefetch_cancels++;
+    }
+    else if (NULL == req->slot->photo && !req->slot->loading &&
+             NULL != read_photo_slot(req->slot, 1)) {
+        photo_stats.prefetches++;
+    }
+    else if (NULL != req->slot->photo && 0 == req->slot->copies) {
+        set_slot_copies(req->slot, 1);
+    }
+    (void)pthread_mutex_unlock(&photo_lock);
+    free(req);
+}
+
+
+/*
+ * read_photo_slot
+ *   DESCRIPTION: Read a room photo that is not in memory and make it the
+ *                most recently used photo.  Less recently used photos
+ *                are first released as needed to keep within the memory
+ *                budget.  If the read fails for lack of memory, all
+ *                other photos that can be released are released and the
+ *                read is tried once more; a missing or bad file is not
+ *                retried, so that it does not empty the LRU.  Caller
+ *                must hold photo_lock, which is released during the
+ *                read.
+ *   INPUTS: slot -- the photo record
+ *           touch -- if non-zero, fault in the photo's pixel data before
+ *                    making the photo available
+ *   OUTPUTS: none
+ *   RETURN VALUE: the photo, or NULL if it cannot be read
+ *   SIDE EFFECTS: may read and free photos; updates residency counters;
+ *                 wakes threads waiting for the read
+ */
+static photo_t* read_photo_slot(photo_slot_t* slot, int32_t touch) {
+    uint64_t need;  /* memory needed for photo */
+    photo_t* photo; /* photo read              */
+
+    /* Make room for the photo first to keep within the budget. */
+    if (0 != photo_stats.budget) {
+        need = photo_bytes(&slot->hdr);
+        evict_photos(NULL, need < photo_stats.budget ? photo_stats.budget - need : 0);
+    }
+
+    slot->loading = 1;
+    (void)pthread_mutex_unlock(&photo_lock);
+    if (NULL == (photo = read_photo(slot->filename)) && ENOMEM == errno) {
+        (void)pthread_mutex_lock(&photo_lock);
+        evict_photos(NULL, 0);
+        (void)pthread_mutex_unlock(&photo_lock);
+        photo = read_photo(slot->filename);
+    }
+    if (NULL != photo && touch) {
+        touch_photo(photo);
+    }
+    (void)pthread_mutex_lock(&photo_lock);
+    slot->loading = 0;
+    (void)pthread_cond_broadcast(&photo_cv);
+
+    if (NULL == (slot->photo = photo)) {
+        photo_stats.failures++;
+        return NULL;
+    }
+
+    /* The file may have changed since the world was built. */
+    slot->hdr.width = photo_width(photo);
+    slot->hdr.height = photo_height(photo);
+    slot->bytes = photo_memory(photo, &slot->copies);
+    photo_stats.resident++;
+    photo_stats.bytes += slot->bytes;
+    photo_stats.copy_bytes += slot->copies;
+    if (photo_stats.peak_bytes < photo_stats.bytes) {
+        photo_stats.peak_bytes = photo_stats.bytes;
+    }
+    lru_push(slot);
+    if (0 != photo_stats.budget) {
+        evict_photos(slot, photo_stats.budget);
+    }
+    return photo;
+}
+
+
 /*
  * remove_object
  *   DESCRIPTION: Take an object out of its current location, leaving it
@@ -617,6 +1175,7 @@ static void remove_object(object_t* o) {
     if (NULL != o->loc) {
 
         /* Remove from previous room(with safety check)... */
+        unindex_object(o->loc, o);
         for (find = &o->loc->contents; NULL != *find; find = &(*find)->next) {
             if (o == *find) {
                 /* We found the predecessor! Unlink the object. */
@@ -631,6 +1190,136 @@ static void remove_object(object_t* o) {
 }
 
 
+/*
+ * set_slot_copies
+ *   DESCRIPTION: Add or remove the column and plane order copies of a
+ *                room photo in memory(see add_photo_copies) and update
+ *                the residency counters.  Caller must hold photo_lock.
+ *   INPUTS: slot -- the photo record(photo in memory)
+ *           on -- non-zero to add the copies, or 0 to remove them
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: allocates or frees memory
+ */
+static void set_slot_copies(photo_slot_t* slot, int32_t on) {
+    photo_stats.bytes -= slot->bytes;
+    photo_stats.copy_bytes -= slot->copies;
+    if (on) {
+        add_photo_copies(slot->photo);
+    }
+    else {
+        (void)set_photo_columns(slot->photo, 0);
+        (void)set_photo_planes(slot->photo, 0);
+    }
+    slot->bytes = photo_memory(slot->photo, &slot->copies);
+    photo_stats.bytes += slot->bytes;
+    photo_stats.copy_bytes += slot->copies;
+    if (photo_stats.peak_bytes < photo_stats.bytes) {
+        photo_stats.peak_bytes = photo_stats.bytes;
+    }
+}
+
+
+/*
+ * start_prefetch
+ *   DESCRIPTION: Start reading the photos of rooms near a room in the
+ *                worker pool.  Rooms are found by a breadth-first search
+ *                over the left, enter, and right links up to a depth of
+ *                prefetch_depth, so photos are requested in order of
+ *                graph distance.  Requests stop when the photos found so
+ *                far would exceed the memory budget, so prefetching never
+ *                releases photos that it has just requested.  Requests
+ *                made for previously pinned rooms are cancelled.  The
+ *                rooms found are marked as near the screen, and other
+ *                photos in memory lose their copies(see set_slot_copies).
+ *                Caller must hold photo_lock.
+ *   INPUTS: r -- the room on the screen
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: queues pool jobs; frees memory
+ */
+static void start_prefetch(const room_t* r) {
+    const room_t* queue[N_ROOMS]; /* rooms in order of distance     */
+    int32_t       dist[N_ROOMS];  /* distance of rooms in queue     */
+    uint8_t       seen[N_ROOMS];  /* room already in queue          */
+    int32_t       head;           /* index of room being expanded   */
+    int32_t       tail;           /* number of rooms in queue       */
+    const room_t* next[3];        /* neighbors of room              */
+    int32_t       i;              /* index over neighbors           */
+    int32_t       id;             /* index of neighbor in room      */
+    uint64_t      total;          /* memory needed for nearby rooms */
+    pool_t*       pool;           /* pool for reading photos        */
+    prefetch_t*   req;            /* prefetch request               */
+    photo_slot_t* slot;           /* loop index over photos in LRU  */
+
+    prefetch_gen++;
+    if (NULL != (pool = pool_default()) && 0 == pool_size(pool)) {
+        pool = NULL;
+    }
+
+    (void)memset(seen, 0, sizeof (seen));
+    queue[0] = r;
+    dist[0] = 0;
+    seen[r - room] = 1;
+    total = photo_bytes(&r->view->hdr);
+    for (head = 0, tail = 1; tail > head; head++) {
+        if (0 < dist[head]) {
+            /* Keep nearer photos in memory in preference to farther ones. */
+            if (0 != photo_stats.budget &&
+                photo_stats.budget < (total += photo_bytes(&queue[head]->view->hdr))) {
+                break;
+            }
+            queue[head]->view->near_gen = prefetch_gen;
+            if (NULL != pool && (NULL == queue[head]->view->photo || 0 == queue[head]->view->copies) &&
+                !queue[head]->view->loading && NULL != (req = malloc(sizeof (*req)))) {
+                req->slot = queue[head]->view;
+                req->gen = prefetch_gen;
+                if (0 != pool_submit(pool, &prefetch_grp, prefetch_job, req)) {
+                    free(req);
+                }
+            }
+        }
+        if (prefetch_depth <= dist[head]) {
+            continue;
+        }
+        next[0] = queue[head]->left;
+        next[1] = queue[head]->enter;
+        next[2] = queue[head]->right;
+        for (i = 0; 3 > i; i++) {
+            if (NULL != next[i] && !seen[id = next[i] - room]) {
+                seen[id] = 1;
+                queue[tail] = next[i];
+                dist[tail++] = dist[head] + 1;
+            }
+        }
+    }
+
+    /* Photos no longer near the screen give up their copies. */
+    for (slot = lru_head; NULL != slot; slot = slot->lru_next) {
+        if (pinned_slot != slot && prefetch_gen != slot->near_gen && 0 != slot->copies) {
+            set_slot_copies(slot, 0);
+        }
+    }
+}
+
+
+/*
+ * usec_since
+ *   DESCRIPTION: Get the time elapsed since a given time.
+ *   INPUTS: start -- the earlier time(CLOCK_MONOTONIC)
+ *   OUTPUTS: none
+ *   RETURN VALUE: microseconds elapsed
+ *   SIDE EFFECTS: none
+ */
+static uint64_t usec_since(const struct timespec* start) {
+    struct timespec now; /* current time */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - start->tv_sec) * 1000000LL +
+            (now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+
 /*
  * obj_get_x
  *   DESCRIPTION: Get x position of object within containing room.
@@ -699,6 +1388,70 @@ object_t* room_contents_iterate(const room_t* r) {
 }
 
 
+/*
+ * room_objects_on_row
+ *   DESCRIPTION: Get the objects in a room that may overlap a row of the
+ *                room photo.  The objects are listed in the same order
+ *                as by room_contents_iterate, but may include objects
+ *                that lie near the row without overlapping it.  The same
+ *                list serves every row from y up to(but not including)
+ *                the row returned in end.
+ *   INPUTS: r -- pointer to the room
+ *           y -- the row
+ *   OUTPUTS: n -- number of objects listed
+ *            end -- first row beyond y that may need a different list
+ *   RETURN VALUE: the objects, or NULL if the room's objects are not
+ *                 indexed(in which case room_contents_iterate must be
+ *                 used)
+ *   SIDE EFFECTS: none
+ */
+const obj_place_t* room_objects_on_row(const room_t* r, int32_t y, int32_t* n, int32_t* end) {
+    int32_t           idx;  /* index of band holding row */
+    const obj_band_t* band; /* band holding row          */
+
+    if (r->unindexed) {
+        return NULL;
+    }
+    idx = (0 > y ? 0 : (N_ROW_BANDS <= (y >> OBJ_BAND_SHIFT) ? N_ROW_BANDS - 1 : (y >> OBJ_BAND_SHIFT)));
+    band = &r->row_band[idx];
+    *n = band->count;
+    *end = (N_ROW_BANDS - 1 == idx ? INT32_MAX : (idx + 1) << OBJ_BAND_SHIFT);
+    return band->list;
+}
+
+
+/*
+ * room_objects_on_column
+ *   DESCRIPTION: Get the objects in a room that may overlap a column of
+ *                the room photo.  The objects are listed in the same
+ *                order as by room_contents_iterate, but may include
+ *                objects that lie near the column without overlapping it.
+ *                The same list serves every column from x up to(but not
+ *                including) the column returned in end.
+ *   INPUTS: r -- pointer to the room
+ *           x -- the column
+ *   OUTPUTS: n -- number of objects listed
+ *            end -- first column beyond x that may need a different list
+ *   RETURN VALUE: the objects, or NULL if the room's objects are not
+ *                 indexed(in which case room_contents_iterate must be
+ *                 used)
+ *   SIDE EFFECTS: none
+ */
+const obj_place_t* room_objects_on_column(const room_t* r, int32_t x, int32_t* n, int32_t* end) {
+    int32_t           idx;  /* index of band holding column */
+    const obj_band_t* band; /* band holding column          */
+
+    if (r->unindexed) {
+        return NULL;
+    }
+    idx = (0 > x ? 0 : (N_COL_BANDS <= (x >> OBJ_BAND_SHIFT) ? N_COL_BANDS - 1 : (x >> OBJ_BAND_SHIFT)));
+    band = &r->col_band[idx];
+    *n = band->count;
+    *end = (N_COL_BANDS - 1 == idx ? INT32_MAX : (idx + 1) << OBJ_BAND_SHIFT);
+    return band->list;
+}
+
+
 /*
  * room_name
  *   DESCRIPTION: Get name for a room.
@@ -714,14 +1467,179 @@ const char* room_name(const room_t* r) {
 
 /*
  * room_photo
- *   DESCRIPTION: Get room photo for a room.
+ *   DESCRIPTION: Get room photo for a room, reading it if it is not in
+ *                memory(see load_photo_slot).  The photo of the room on
+ *                the screen is used for every line drawn, so it is
+ *                returned without updating the LRU list or counters(or
+ *                its preview is returned, if room_pin_photo returned one).
  *   INPUTS: r -- pointer to the room
  *   OUTPUTS: none
- *   RETURN VALUE: a pointer to room r's photo
- *   SIDE EFFECTS: none
+ *   RETURN VALUE: a pointer to room r's photo, or NULL if it cannot be
+ *                 read
+ *   SIDE EFFECTS: may read and free room photos
  */
 photo_t* room_photo(const room_t* r) {
-    return r->view;
+    photo_t* photo; /* room r's photo */
+
+    if (pinned_slot == r->view && NULL != pinned_photo) {
+        return pinned_photo;
+    }
+    (void)pthread_mutex_lock(&photo_lock);
+    photo = load_photo_slot(r->view);
+    (void)pthread_mutex_unlock(&photo_lock);
+    return photo;
+}
+
+
+/*
+ * room_pin_photo
+ *   DESCRIPTION: Get room photo for the room about to be shown on the
+ *                screen, and keep that photo in memory until another
+ *                room's photo is pinned.  The previously pinned photo
+ *                becomes an ordinary member of the LRU list.  Reading
+ *                of the photos of nearby rooms is then started in the
+ *                background(see start_prefetch).
+ *
+ *                If the photo is not in memory and the pool has worker
+ *                threads, the photo is read by a pool job, and a preview
+ *                that needs no palette(see read_photo_preview) is
+ *                returned instead unless the job finishes first.  The
+ *                caller should pin the room again once room_photo_ready
+ *                reports that the photo has been read.  Setting the
+ *                ADVENTURE_PREVIEW environment variable to 0 disables
+ *                previews.
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: a pointer to room r's photo or its preview, or NULL if
+ *                 neither can be read
+ *   SIDE EFFECTS: may read and free room photos; queues pool jobs;
+ *                 frees the preview of the room previously pinned
+ */
+photo_t* room_pin_photo(const room_t* r) {
+    photo_slot_t* slot = r->view; /* record for room r's photo */
+    photo_t*      photo;          /* room r's photo or preview */
+    photo_t*      preview;        /* preview just read         */
+    pool_t*       pool;           /* pool for reading photo    */
+    int32_t       entering;       /* room r was not pinned     */
+    uint64_t      usec;           /* time since room entered   */
+
+    (void)pthread_mutex_lock(&photo_lock);
+    if ((entering = (pinned_slot != slot))) {
+        photo_stats.transitions++;
+        if (NULL != slot->photo) {
+            photo_stats.warm_transitions++;
+        }
+        (void)clock_gettime(CLOCK_MONOTONIC, &entry_time);
+        final_pending = 1;
+
+        /* The old room's preview is no longer drawn. */
+        if (NULL != pinned_preview) {
+            free_photo(pinned_preview);
+            pinned_preview = NULL;
+        }
+    }
+
+    /*
+     * Start reading a photo that is not in memory in the pool, then read
+     * the preview.  If the photo is read before the preview, or no job
+     * can be queued, the photo is used directly.
+     */
+    if (NULL == slot->photo && NULL == pinned_preview && preview_enabled &&
+        NULL != (pool = pool_default()) && 0 < pool_size(pool) &&
+        (slot->loading || 0 == pool_submit(pool, &load_grp, load_job, slot))) {
+        photo_stats.misses++;
+        (void)pthread_mutex_unlock(&photo_lock);
+        preview = read_photo_preview(slot->filename);
+        (void)pthread_mutex_lock(&photo_lock);
+        if (NULL != preview && NULL == slot->photo) {
+            pinned_preview = preview;
+            photo_stats.previews++;
+        }
+        else if (NULL != preview) {
+            free_photo(preview);
+        }
+    }
+    if (NULL != pinned_preview && NULL == slot->photo) {
+        photo = pinned_preview;
+    }
+    else {
+        photo = load_photo_slot(slot);
+        if (NULL != pinned_preview) {
+            free_photo(pinned_preview);
+            pinned_preview = NULL;
+        }
+
+        /* A photo that was far from the screen may have lost its copies. */
+        if (NULL != photo && 0 == slot->copies) {
+            set_slot_copies(slot, 1);
+        }
+    }
+
+    /* Record the time to the first frame and to the photo itself. */
+    usec = usec_since(&entry_time);
+    if (entering) {
+        photo_stats.first_frame_usec += usec;
+        if (photo_stats.first_frame_max_usec < usec) {
+            photo_stats.first_frame_max_usec = usec;
+        }
+    }
+    if (final_pending && NULL != photo && pinned_preview != photo) {
+        final_pending = 0;
+        photo_stats.final_frames++;
+        photo_stats.final_frame_usec += usec;
+        if (photo_stats.final_frame_max_usec < usec) {
+            photo_stats.final_frame_max_usec = usec;
+        }
+    }
+
+    pinned_slot = slot;
+    pinned_photo = photo;
+    if (0 != photo_stats.budget) {
+        evict_photos(NULL, photo_stats.budget);
+    }
+    start_prefetch(r);
+    (void)pthread_mutex_unlock(&photo_lock);
+    return photo;
+}
+
+
+/*
+ * room_photo_ready
+ *   DESCRIPTION: Check whether the photo of the room on the screen has
+ *                been read since room_pin_photo returned a preview of
+ *                it, in which case the room should be pinned and drawn
+ *                again.
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: non-zero if the photo has replaced the preview, or 0
+ *                 if not
+ *   SIDE EFFECTS: none
+ */
+int32_t room_photo_ready(const room_t* r) {
+    int32_t ready; /* photo has been read */
+
+    (void)pthread_mutex_lock(&photo_lock);
+    ready = (pinned_slot == r->view && NULL != pinned_preview &&
+             NULL != r->view->photo);
+    (void)pthread_mutex_unlock(&photo_lock);
+    return ready;
+}
+
+
+/*
+ * room_photo_stats
+ *   DESCRIPTION: Get counters describing room photo residency and
+ *                prefetching for use in tuning the memory budget and
+ *                the prefetch depth.
+ *   INPUTS: none
+ *   OUTPUTS: stats -- the counters
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void room_photo_stats(room_photo_stats_t* stats) {
+    (void)pthread_mutex_lock(&photo_lock);
+    *stats = photo_stats;
+    (void)pthread_mutex_unlock(&photo_lock);
 }
 
 
@@ -734,7 +1652,7 @@ photo_t* room_photo(const room_t* r) {
  *   SIDE EFFECTS: none
  */
 uint32_t room_photo_height(const room_t* r) {
-    return photo_height(r->view);
+    return r->view->hdr.height;
 }
 
 
@@ -747,15 +1665,19 @@ uint32_t room_photo_height(const room_t* r) {
  *   SIDE EFFECTS: none
  */
 uint32_t room_photo_width(const room_t* r) {
-    return photo_width(r->view);
+    return r->view->hdr.width;
 }
 
 
 /*
  * build_world
  *   DESCRIPTION: Builds and connects the rooms, creates objects, and
- *                reads in all image data(could be done lazily with
- *                caching instead).
+ *                reads in object images.  Only the sizes of room photos
+ *                are read here; the photos themselves are read when
+ *                first needed(see room_photo), with the memory they
+ *                hold limited by ADVENTURE_PHOTO_BUDGET, and photos of
+ *                rooms up to ADVENTURE_PREFETCH links away from the room
+ *                on the screen are read in the background.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: 1 on success, or 0 on failure
@@ -763,7 +1685,18 @@ uint32_t room_photo_width(const room_t* r) {
  */
 int32_t build_world() {
     int32_t idx;    /* index over data arrays   */
-    int32_t which;    /* id for current data item */
+    int32_t which;  /* id for current data item */
+    pool_t* pool;   /* pool for reading images  */
+
+    /* No room photos are in memory yet. */
+    (void)memset(&photo_stats, 0, sizeof (photo_stats));
+    photo_stats.budget = photo_budget_from_env();
+    prefetch_depth = (NULL == getenv("ADVENTURE_PREFETCH") ? PREFETCH_DEPTH :
+                      atoi(getenv("ADVENTURE_PREFETCH")));
+    preview_enabled = (NULL == getenv("ADVENTURE_PREVIEW") ||
+                       0 != atoi(getenv("ADVENTURE_PREVIEW")));
+    lru_head = lru_tail = pinned_slot = NULL;
+    pinned_photo = pinned_preview = NULL;
 
     /* Clear all accomplishment flags. */
     (void)memset(player_flags, 0, sizeof (player_flags));
@@ -789,12 +1722,15 @@ int32_t build_world() {
 
         /* Set up the room. */
         room[which].name = room_data[idx].name;
-        room[which].view = read_photo(room_data[idx].filename);
-        if (NULL == room[which].view) {
+        room[which].view = &room_slot[which];
+        if (0 != init_photo_slot(room[which].view, room_data[idx].filename)) {
             fprintf(stderr, "Can't read room photo %s.\n", room_data[idx].filename);
             return 0;
         }
         room[which].contents = NULL;
+        (void)memset(room[which].row_band, 0, sizeof (room[which].row_band));
+        (void)memset(room[which].col_band, 0, sizeof (room[which].col_band));
+        room[which].unindexed = 0;
         room[which].left  = (R_NONE == room_data[idx].left ? NULL : &room[room_data[idx].left]);
         room[which].enter = (R_NONE == room_data[idx].enter ? NULL : &room[room_data[idx].enter]);
         room[which].right = (R_NONE == room_data[idx].right ? NULL : &room[room_data[idx].right]);
@@ -803,6 +1739,21 @@ int32_t build_world() {
     /* Clear object data to enable sanity check for duplication. */
     (void)memset(object, 0, sizeof (object));
 
+    /*
+     * Read the object images in the worker pool(see obj_image_job); the
+     * objects are set up below once all reads finish.  An image that
+     * cannot be queued is read here instead.
+     */
+    pool = pool_default();
+    for (idx = 0; N_OBJECTS > idx; idx++) {
+        if (NULL == pool || 0 != pool_submit(pool, &obj_image_grp, obj_image_job, (void*)&obj_data[idx])) {
+            obj_image_job((void*)&obj_data[idx]);
+        }
+    }
+    if (NULL != pool) {
+        pool_wait(pool, &obj_image_grp);
+    }
+
     /* Loop over object data. */
     for (idx = 0; N_OBJECTS > idx; idx++) {
 
@@ -821,7 +1772,7 @@ int32_t build_world() {
 
         /* Set up the object. */
         object[which].name = obj_data[idx].name;
-        object[which].img = read_obj_image(obj_data[idx].filename);
+        object[which].img = obj_data_img[idx];
         if (NULL == object[which].img) {
             fprintf(stderr, "Can't read object photo %s.\n", obj_data[idx].filename);
             return 0;
@@ -861,9 +1812,9 @@ int32_t build_world() {
             return 0;
         }
 
-        /* Read in the swap photo. */
-        swap_photo[which] = read_photo(swap_data[idx].filename);
-        if (NULL == swap_photo[which]) {
+        /* Record the swap photo. */
+        swap_photo[which] = &swap_slot[which];
+        if (0 != init_photo_slot(swap_photo[which], swap_data[idx].filename)) {
             fprintf(stderr, "Can't read room photo %s.\n", swap_data[idx].filename);
             return 0;
         }
@@ -874,6 +1825,70 @@ int32_t build_world() {
 }
 
 
+/*
+ * room_by_index
+ *   DESCRIPTION: Get a room by its place in the world's table of rooms,
+ *                for programs that visit every room(such as mp2bench).
+ *   INPUTS: idx -- index of the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the room, or NULL if idx is negative or
+ *                 not less than the number of rooms
+ *   SIDE EFFECTS: none
+ */
+room_t* room_by_index(int32_t idx) {
+    return (0 > idx || N_ROOMS <= idx ? NULL : &room[idx]);
+}
+
+
+/*
+ * room_photo_file
+ *   DESCRIPTION: Get the file name of the photo shown for a room.
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: the file name
+ *   SIDE EFFECTS: none
+ */
+const char* room_photo_file(const room_t* r) {
+    return r->view->filename;
+}
+
+
+/*
+ * room_add_objects
+ *   DESCRIPTION: Add objects to a room at random positions within its
+ *                photo, using the images of the game's objects in turn.
+ *                The objects' name starts with a space, which typed
+ *                arguments never do, so the player cannot use them.
+ *                They are never freed; they serve to measure drawing and
+ *                the object index in crowded rooms(see mp2bench).
+ *   INPUTS: r -- pointer to the room
+ *           count -- number of objects to add
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of objects added(fewer than count only if
+ *                 memory runs out)
+ *   SIDE EFFECTS: dynamically allocates memory for the objects; changes
+ *                 the room's contents and object index
+ */
+int32_t room_add_objects(room_t* r, int32_t count) {
+    static int32_t next_img = 0;  /* object whose image is used next */
+    object_t*      o;             /* new object                      */
+    int32_t        i;             /* index over new objects          */
+
+    for (i = 0; count > i; i++) {
+        if (NULL == (o = malloc(sizeof (*o)))) {
+            break;
+        }
+        o->name = " extra";
+        o->next = NULL;
+        o->loc = NULL;
+        o->img = object[next_img].img;
+        next_img = (next_img + 1) % N_OBJECTS;
+        insert_object_at(o, r, rand() % room_photo_width(r), rand() % room_photo_height(r));
+    }
+    return i;
+}
+
+
 /*
  * start_in_room
  *   DESCRIPTION: Get a pointer to the room in which the player begins
@@ -39,23 +39,98 @@
 #include "types.h"
 
 
+/*
+ * An object placed in a room, as listed by room_objects_on_row and
+ * room_objects_on_column.
+ */
+typedef struct obj_place_t obj_place_t;
+struct obj_place_t {
+    const object_t* obj;  /* the object                     */
+    const image_t*  img;  /* object image                   */
+    int32_t         x;    /* x position within room photo   */
+    int32_t         y;    /* y position within room photo   */
+};
+
 /* structure access functions */
 extern uint16_t obj_get_x(const object_t* obj);
 extern uint16_t obj_get_y(const object_t* obj);
 extern image_t* obj_image(const object_t* obj);
 extern object_t* obj_next(const object_t* obj);
 extern object_t* room_contents_iterate(const room_t* r);
+
+/*
+ * Get the objects in a room that may overlap a row(or a column) of the
+ * room photo, in the order given by room_contents_iterate.  The list also
+ * serves the following rows(or columns) up to the one returned in end.
+ * Returns NULL if the room's objects are not indexed, in which case
+ * callers must use room_contents_iterate.
+ */
+extern const obj_place_t* room_objects_on_row(const room_t* r, int32_t y, int32_t* n, int32_t* end);
+extern const obj_place_t* room_objects_on_column(const room_t* r, int32_t x, int32_t* n, int32_t* end);
 extern const char* room_name(const room_t* r);
 extern photo_t* room_photo(const room_t* r);
 extern uint32_t room_photo_height(const room_t* r);
 extern uint32_t room_photo_width(const room_t* r);
 
+/*
+ * Get the photo for the room about to be shown and keep it in memory
+ * until another room's photo is pinned; start reading photos of nearby
+ * rooms in the background.  If the photo is not in memory, it may be
+ * read in the background as well, in which case a preview is returned
+ * (see room_photo_ready).  Returns NULL if the photo cannot be read.
+ */
+extern photo_t* room_pin_photo(const room_t* r);
+
+/*
+ * Check whether a room's photo, shown as a preview by room_pin_photo, has
+ * now been read, so that pinning the room again returns the photo.
+ */
+extern int32_t room_photo_ready(const room_t* r);
+
+/* counters describing room photo residency(see room_photo_stats) */
+typedef struct room_photo_stats_t room_photo_stats_t;
+struct room_photo_stats_t {
+    uint32_t hits;       /* lookups that found the photo in memory */
+    uint32_t misses;     /* lookups that read the photo            */
+    uint32_t waits;      /* lookups that waited for another read   */
+    uint32_t failures;   /* reads that failed                      */
+    uint32_t evictions;  /* photos released to meet the budget     */
+    uint32_t transitions;      /* rooms pinned(room changes)        */
+    uint32_t warm_transitions; /* ... with photo already in memory  */
+    uint32_t prefetches;       /* photos read ahead of need         */
+    uint32_t prefetch_cancels; /* prefetches dropped as stale       */
+    uint32_t previews;         /* room changes shown as a preview first */
+    uint32_t final_frames;     /* room changes that showed the photo    */
+    uint64_t first_frame_usec;     /* total time from room change to   */
+    uint64_t first_frame_max_usec; /* ... first frame(photo or preview) */
+    uint64_t final_frame_usec;     /* total time from room change to   */
+    uint64_t final_frame_max_usec; /* ... frame with the photo itself  */
+    uint32_t resident;   /* photos now in memory                   */
+    uint64_t bytes;      /* memory held by photos now in memory    */
+    uint64_t copy_bytes; /* ... of which in column/plane copies */
+    uint64_t peak_bytes; /* largest value of bytes so far          */
+    uint64_t budget;     /* memory budget in bytes(0 for none)     */
+};
+
+/* Get room photo residency counters. */
+extern void room_photo_stats(room_photo_stats_t* stats);
+
 /* Build the game world.  Returns 0 on failure, or 1 on success. */
 extern int32_t build_world(void);
 
 /* Get pointer to starting room for player. */
 extern room_t* start_in_room(void);
 
+/*
+ * Hooks for programs that measure the world code(see mp2bench.c): get a
+ * room by index(NULL past the last room), get the file name of a room's
+ * photo, and add count objects with the game's images at random places
+ * in a room(returns the number added).
+ */
+extern room_t* room_by_index(int32_t idx);
+extern const char* room_photo_file(const room_t* r);
+extern int32_t room_add_objects(room_t* r, int32_t count);
+
 /*
  * checks for accelerator object ownership; these make horizontal(board)
  * and vertical(jetpack) pixel panning faster